@@ -85,6 +85,7 @@ uint8_t *usr_radio_receive_frame (uint8_t len, uint8_t *frm) ;
 void usr_radio_tx_done (void) ;
 int getChannelRadio(void);
 void setChannelRadio(int c);
+uint8_t getRssiRadio(void);
 
 
 PROCESS(rf2xx_process, "rf2xx driver");
@@ -827,6 +828,20 @@ void setChannelRadio(int c) {
     channel_ = c;
 }
 
+/*
+ * Raw PHY_RSSI register: current RSSI (bits 4:0) and, in receive
+ * state, random bits from the radio noise (RND_VALUE, bits 6:5).
+ * Used to seed the CASAN pseudo-random generator.
+ */
+uint8_t getRssiRadio (void) {
+    uint8_t reg;
+
+    platform_enter_critical();
+    reg = rf2xx_reg_read(RF2XX_DEVICE, RF2XX_REG__PHY_RSSI);
+    platform_exit_critical();
+    return reg;
+}
+
 
 PROCESS_THREAD(rf2xx_process, ev, data)
 {
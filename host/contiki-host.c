@@ -0,0 +1,171 @@
+/**
+ * @file contiki-host.c
+ * @brief Host implementation of the Contiki services used by the libraries
+ *
+ * See contiki/contiki.h. All functions may be called by several
+ * threads, each one running its own engines.
+ */
+
+#include <stdarg.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "contiki.h"
+#include "netstack.h"
+#include "net/packetbuf.h"
+#include "cfs/cfs.h"
+
+int host_verbose = 0 ;
+
+
+/******************************************************************************
+ * Clock
+ */
+
+static struct timespec clock_start ;
+static pthread_once_t clock_once = PTHREAD_ONCE_INIT ;
+
+static void clock_init (void)
+{
+    clock_gettime (CLOCK_MONOTONIC, &clock_start) ;
+}
+
+// microseconds since the first call
+uint64_t host_usec (void)
+{
+    struct timespec ts ;
+
+    pthread_once (&clock_once, clock_init) ;
+    clock_gettime (CLOCK_MONOTONIC, &ts) ;
+    return (uint64_t) (ts.tv_sec - clock_start.tv_sec) * 1000000
+			+ (ts.tv_nsec - clock_start.tv_nsec) / 1000 ;
+}
+
+// milliseconds since the first call
+clock_time_t clock_time (void)
+{
+    return (clock_time_t) (host_usec () / 1000) ;
+}
+
+
+/******************************************************************************
+ * Platform and radio
+ */
+
+/*
+ * An engine (and its ConMsg instance) is only run by one thread at
+ * a time, and frames are delivered by this thread: there is no
+ * interrupt to mask.
+ */
+
+void platform_enter_critical (void) { }
+void platform_exit_critical (void) { }
+void setChannelRadio (int chan) { (void) chan ; }
+void initBuf (uint8_t *buf, int len) { (void) buf ; (void) len ; }
+
+static int radio_init (void) { return 1 ; }
+static int radio_on (void) { return 1 ; }
+static int radio_off (void) { return 1 ; }
+
+// a ConMsg instance without transport has nowhere to send to
+static int radio_send (const void *payload, unsigned short len)
+{
+    (void) payload ; (void) len ;
+    return RADIO_TX_ERR ;
+}
+
+const struct radio_driver NETSTACK_RADIO =
+{
+    radio_init, radio_send, radio_on, radio_off,
+} ;
+
+
+// no radio driver: frame attributes are not set
+packetbuf_attr_t packetbuf_attr (uint8_t type)
+{
+    (void) type ;
+    return 0 ;
+}
+
+
+// random bits used to seed the engine generators (see prng.c)
+uint8_t getRssiRadio (void)
+{
+    static __thread unsigned int seed ;
+
+    if (seed == 0)
+	seed = (unsigned int) clock_time () ^ (unsigned int) pthread_self () ^ 0x5a5a ;
+    return (uint8_t) (rand_r (&seed) >> 7) ;
+}
+
+
+/******************************************************************************
+ * Processes (not used on the host)
+ */
+
+void process_start (struct process *p, process_data_t data) { (void) p ; (void) data ; }
+void process_poll (struct process *p) { (void) p ; }
+
+void etimer_set (struct etimer *et, clock_time_t interval)
+{
+    et->expire = clock_time () + interval ;
+}
+
+int etimer_expired (struct etimer *et)
+{
+    return clock_time () >= et->expire ;
+}
+
+
+/******************************************************************************
+ * File system
+ */
+
+int cfs_open (const char *name, int flags)
+{
+    if (flags == CFS_READ)
+	return open (name, O_RDONLY) ;
+    return open (name, O_WRONLY | O_CREAT | O_TRUNC, 0644) ;
+}
+
+void cfs_close (int fd)
+{
+    close (fd) ;
+}
+
+int cfs_read (int fd, void *buf, unsigned int len)
+{
+    return (int) read (fd, buf, len) ;
+}
+
+int cfs_write (int fd, const void *buf, unsigned int len)
+{
+    return (int) write (fd, buf, len) ;
+}
+
+int cfs_remove (const char *name)
+{
+    return unlink (name) ;
+}
+
+
+/******************************************************************************
+ * Traces
+ */
+
+#undef	printf
+
+int host_printf (const char *fmt, ...)
+{
+    va_list ap ;
+    int n ;
+
+    if (! host_verbose)
+	return 0 ;
+    va_start (ap, fmt) ;
+    n = vprintf (fmt, ap) ;
+    va_end (ap) ;
+    return n ;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file cfs.h
+ * @brief Host shim of the Contiki File System
+ *
+ * Files are regular files of the host, relative to the current
+ * directory (see contiki-host.c).
+ */
+
+#ifndef __CFS_H__
+#define __CFS_H__
+
+#define	CFS_READ	1
+#define	CFS_WRITE	2
+
+int cfs_open (const char *name, int flags) ;
+void cfs_close (int fd) ;
+int cfs_read (int fd, void *buf, unsigned int len) ;
+int cfs_write (int fd, const void *buf, unsigned int len) ;
+int cfs_remove (const char *name) ;
+
+#endif
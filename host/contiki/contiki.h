@@ -0,0 +1,98 @@
+/**
+ * @file contiki.h
+ * @brief Host shim of the Contiki definitions used by the libraries
+ *
+ * This file is only used to build the libraries on a Linux host (see
+ * the host Makefile): it provides the few Contiki services they need
+ * (clock, critical sections, processes and event timers), implemented
+ * in contiki-host.c.
+ *
+ * Processes are not run on the host: the engines are run by the
+ * worker threads of the host program, hence `process_poll` does
+ * nothing.
+ */
+
+#ifndef __CONTIKI_H__
+#define __CONTIKI_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <time.h>
+
+/*
+ * The libraries define their own time_t (milliseconds, 64 bits, see
+ * Casan/time.h): it is renamed such that it does not conflict with
+ * the system one. Host programs must not include a system header
+ * declaring time_t after the libraries headers (it is included above).
+ */
+
+#define	time_t	casan_time_t
+
+typedef unsigned long clock_time_t ;
+
+#define	CLOCK_SECOND	1000		// clock ticks are milliseconds
+
+clock_time_t clock_time (void) ;
+uint64_t host_usec (void) ;		// host only: finer clock for statistics
+
+void platform_enter_critical (void) ;
+void platform_exit_critical (void) ;
+void setChannelRadio (int chan) ;
+void initBuf (uint8_t *buf, int len) ;
+
+/*
+ * Library traces are silent unless the host program enables them
+ * (they are not useful with hundreds of engines).
+ */
+
+extern int host_verbose ;
+int host_printf (const char *fmt, ...) ;
+#define	printf	host_printf
+
+/*
+ * Processes (only what is needed to compile casan_process)
+ */
+
+typedef unsigned char process_event_t ;
+typedef void *process_data_t ;
+
+struct process
+{
+    const char *name ;
+    int lc ;
+    char (*thread) (struct process *, process_event_t, process_data_t) ;
+} ;
+
+struct etimer
+{
+    clock_time_t expire ;
+} ;
+
+#define	PROCESS_EVENT_POLL	0x82
+#define	PROCESS_EVENT_TIMER	0x88
+
+#define	PROCESS_NAME(n)		extern struct process n
+#define	PROCESS_THREAD(n, ev, data) \
+	char process_thread_##n (struct process *process_pt, \
+				process_event_t ev, process_data_t data)
+#define	PROCESS(n, str) \
+	PROCESS_THREAD (n, ev, data) ; \
+	struct process n = { str, 0, process_thread_##n }
+#define	PROCESS_BEGIN()		switch (process_pt->lc) { case 0:
+#define	PROCESS_END()		} process_pt->lc = 0 ; return 3
+#define	PROCESS_WAIT_EVENT() \
+	do { process_pt->lc = __LINE__ ; return 1 ; case __LINE__: ; } while (0)
+#define	PROCESS_WAIT_EVENT_UNTIL(c) \
+	do { process_pt->lc = __LINE__ ; case __LINE__: if (! (c)) return 1 ; } while (0)
+#define	AUTOSTART_PROCESSES(...)
+
+void process_start (struct process *p, process_data_t data) ;
+void process_poll (struct process *p) ;
+void etimer_set (struct etimer *et, clock_time_t interval) ;
+int etimer_expired (struct etimer *et) ;
+
+#endif
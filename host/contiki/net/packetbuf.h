@@ -0,0 +1,24 @@
+/**
+ * @file packetbuf.h
+ * @brief Host shim of the Contiki packet buffer attributes
+ *
+ * Only the link quality attribute, read by ConMsg when the radio
+ * driver delivers a frame, is provided. There is no radio on the
+ * host: transports give the link quality to `deliver_frame`.
+ */
+
+#ifndef __PACKETBUF_H__
+#define __PACKETBUF_H__
+
+#include <stdint.h>
+
+typedef uint16_t packetbuf_attr_t ;
+
+enum
+{
+    PACKETBUF_ATTR_LINK_QUALITY,
+} ;
+
+packetbuf_attr_t packetbuf_attr (uint8_t type) ;
+
+#endif
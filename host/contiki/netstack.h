@@ -0,0 +1,31 @@
+/**
+ * @file netstack.h
+ * @brief Host shim of the Contiki radio driver interface
+ *
+ * There is no radio on the host: frames are sent through the
+ * transport of each ConMsg instance (see `setTransport`). The
+ * driver provided in contiki-host.c only accepts calls.
+ */
+
+#ifndef __NETSTACK_H__
+#define __NETSTACK_H__
+
+struct radio_driver
+{
+    int (*init) (void) ;
+    int (*send) (const void *payload, unsigned short len) ;
+    int (*on) (void) ;
+    int (*off) (void) ;
+} ;
+
+enum
+{
+    RADIO_TX_OK,
+    RADIO_TX_ERR,
+    RADIO_TX_COLLISION,
+    RADIO_TX_NOACK,
+} ;
+
+extern const struct radio_driver NETSTACK_RADIO ;
+
+#endif
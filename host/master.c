@@ -0,0 +1,401 @@
+/**
+ * @file master.c
+ * @brief Emulated master and load generator (see master.h)
+ */
+
+#include <time.h>
+
+#include "master.h"
+
+#define	CASAN_HELLO		"hello=%ld"	// see casan.c
+#define	CASAN_ASSOC_TTL		"ttl=%ld"
+#define	CASAN_ASSOC_MTU		"mtu=%ld"
+
+static const char *resname [] = { "temp", "light", "led" } ;
+
+
+/******************************************************************************
+ * Messages to slaves
+ */
+
+static void push_query (Msg *m, const char *fmt, long int val)
+{
+    char tmpstr [20] ;
+    option *o ;
+
+    snprintf (tmpstr, sizeof tmpstr, fmt, val) ;
+    o = initOptionOpaque (MO_Uri_Query, tmpstr, strlen (tmpstr)) ;
+    push_option (m, o) ;
+    freeOption (o) ;
+}
+
+
+static void send_hello (vmaster *vm)
+{
+    Msg *out = vm->smsg_ ;
+
+    resetMsg (out) ;
+    set_id (out, vm->curid_++) ;
+    set_type (out, COAP_TYPE_NON) ;
+    set_code (out, COAP_CODE_POST) ;
+    mk_ctl_msg (out) ;
+    push_query (out, CASAN_HELLO, vm->hlid_) ;
+    if (sendMsg (out, bcastaddr (vm->l2_)))
+	vm->stat_.hellos++ ;
+}
+
+
+static void send_assoc (vmaster *vm, vmslave *s, l2addr_154 *dest)
+{
+    Msg *out = vm->smsg_ ;
+
+    resetMsg (out) ;
+    s->assocmid = vm->curid_ ;
+    set_id (out, vm->curid_++) ;
+    set_type (out, COAP_TYPE_CON) ;
+    set_code (out, COAP_CODE_POST) ;
+    mk_ctl_msg (out) ;
+    push_query (out, CASAN_ASSOC_TTL, VM_TTL) ;
+    push_query (out, CASAN_ASSOC_MTU, VS_MTU) ;
+    if (sendMsg (out, dest))
+	vm->stat_.assoc_sent++ ;
+}
+
+
+// acknowledge a confirmable message (notification, separate response)
+static void send_ack (vmaster *vm, Msg *in, l2addr_154 *dest)
+{
+    Msg *out = vm->smsg_ ;
+
+    resetMsg (out) ;
+    set_id (out, get_id (in)) ;
+    set_type (out, COAP_TYPE_ACK) ;
+    set_code (out, 0) ;
+    (void) sendMsg (out, dest) ;
+}
+
+
+// send a request to a random associated slave
+static void send_request (vmaster *vm)
+{
+    Msg *out = vm->smsg_ ;
+    l2addr_154 dest ;
+    token tok ;
+    option *o ;
+    uint32_t t ;
+    int r, i ;
+
+    i = vm->assoc_ [rand_r (&vm->seed_) % vm->nassoc_] ;
+    dest.addr_ = vm->base_ + i ;
+
+    t = ++vm->curtok_ ;
+    if (t == 0)
+	t = ++vm->curtok_ ;
+    tok.toklen_ = 4 ;
+    tok.token_ [0] = t >> 24 ;
+    tok.token_ [1] = t >> 16 ;
+    tok.token_ [2] = t >> 8 ;
+    tok.token_ [3] = t ;
+
+    resetMsg (out) ;
+    set_id (out, vm->curid_++) ;
+    set_type (out, COAP_TYPE_CON) ;
+    set_token_msg (out, &tok) ;
+    r = rand_r (&vm->seed_) % (NTAB (resname) + 1) ;
+    if (r < (int) NTAB (resname))
+    {
+	set_code (out, COAP_CODE_GET) ;
+	o = initOptionOpaque (MO_Uri_Path, resname [r], strlen (resname [r])) ;
+    }
+    else
+    {
+	set_code (out, COAP_CODE_PUT) ;	// switch the led
+	o = initOptionOpaque (MO_Uri_Path, "led", 3) ;
+	set_payload_msg (out, (uint8_t *) (t & 1 ? "1" : "0"), 1) ;
+    }
+    push_option (out, o) ;
+    freeOption (o) ;
+
+    vm->pend_ [t % VM_OUTSTANDING].tok = t ;
+    vm->pend_ [t % VM_OUTSTANDING].sent = host_usec () ;
+    if (sendMsg (out, &dest))
+	vm->stat_.requests++ ;
+}
+
+
+/*
+ * Send the requests due according to the rate, since the first
+ * association (a late master does not send more than VM_MAXLATE ms
+ * of requests at once)
+ */
+
+static void send_load (vmaster *vm)
+{
+    uint64_t due, late ;
+
+    if (vm->rate_ <= 0 || vm->nassoc_ == 0)
+	return ;
+
+    due = (uint64_t) ((host_usec () - vm->loadstart_) * vm->rate_ / 1000000) ;
+    late = (uint64_t) (vm->rate_ * VM_MAXLATE / 1000) + 1 ;
+    if (due > vm->loadsent_ + late)
+	vm->loadsent_ = due - late ;
+    while (vm->loadsent_ < due)
+    {
+	send_request (vm) ;
+	vm->loadsent_++ ;
+    }
+}
+
+
+/******************************************************************************
+ * Messages from slaves
+ */
+
+static void response (vmaster *vm, Msg *in)
+{
+    token *tok ;
+    uint32_t t ;
+    uint64_t rtt ;
+    vmreq *r ;
+
+    tok = get_token_msg (in) ;
+    if (tok->toklen_ != 4)
+	return ;
+    t = ((uint32_t) tok->token_ [0] << 24) | (tok->token_ [1] << 16)
+		| (tok->token_ [2] << 8) | tok->token_ [3] ;
+    r = &vm->pend_ [t % VM_OUTSTANDING] ;
+    if (r->tok != t || t == 0)
+	return ;
+    r->tok = 0 ;
+
+    rtt = host_usec () - r->sent ;
+    vm->stat_.responses++ ;
+    vm->stat_.rtt_sum += rtt ;
+    if (rtt > vm->stat_.rtt_max)
+	vm->stat_.rtt_max = rtt ;
+    vm->stat_.hist [bucket_vslave (rtt)]++ ;
+}
+
+
+static void process_msg (vmaster *vm, Msg *in)
+{
+    l2addr_154 *src ;
+    vmslave *s ;
+    int i ;
+
+    src = get_src (vm->l2_) ;
+    i = (int) src->addr_ - (int) vm->base_ ;
+    if (i < 0 || i >= vm->nslaves_)
+    {
+	freel2addr_154 (src) ;
+	return ;
+    }
+    s = &vm->sl_ [i] ;
+
+    if (is_ctl_msg (in) && is_discover (in))
+    {
+	vm->stat_.discovers++ ;
+	send_assoc (vm, s, src) ;
+    }
+    else if (get_type (in) == COAP_TYPE_ACK && get_id (in) == s->assocmid
+			&& get_code (in) != 0)
+    {
+	if (! s->assoc)
+	{
+	    s->assoc = true ;
+	    vm->assoc_ [vm->nassoc_++] = i ;
+	    if (vm->nassoc_ == 1)
+	    {
+		vm->loadstart_ = host_usec () ;
+		vm->loadsent_ = 0 ;
+	    }
+	}
+    }
+    else
+    {
+	if (get_code (in) >= COAP_RETURN_CODE (2, 0))
+	    response (vm, in) ;
+	if (get_type (in) == COAP_TYPE_CON)
+	    send_ack (vm, in, src) ;
+    }
+
+    freel2addr_154 (src) ;
+}
+
+
+/*
+ * Give waiting frames to the ConMsg instance, and process them
+ */
+
+static void process_inbox (vmaster *vm)
+{
+    ConMsg *cm = vm->l2_->cm_ ;
+    bool more = true ;
+
+    while (more)
+    {
+	pthread_mutex_lock (&vm->lock_) ;
+	while (vm->in_ > 0 && nb_received (cm) < getMsgbufsize (cm) - 1)
+	{
+	    vsframe *f = &vm->inbox_ [vm->ihead_] ;
+
+	    (void) deliver_frame (cm, f->frame, f->len, f->lqi) ;
+	    vm->ihead_ = (vm->ihead_ + 1) % VM_INBOX ;
+	    vm->in_-- ;
+	}
+	more = vm->in_ > 0 ;
+	pthread_mutex_unlock (&vm->lock_) ;
+
+	while (pending_frames (vm->l2_) > 0)
+	{
+	    if (recvMsg (vm->rmsg_) == RECV_OK)
+		process_msg (vm, vm->rmsg_) ;
+	}
+    }
+}
+
+
+void input_vmaster (void *arg, const uint8_t *frame, uint8_t len, uint8_t lqi)
+{
+    vmaster *vm = (vmaster *) arg ;
+    vsframe *f ;
+
+    if (len > MAX_PAYLOAD)
+	return ;
+
+    pthread_mutex_lock (&vm->lock_) ;
+    if (vm->in_ >= VM_INBOX)
+	vm->stat_.lost++ ;
+    else
+    {
+	f = &vm->inbox_ [(vm->ihead_ + vm->in_) % VM_INBOX] ;
+	f->arrival = host_usec () ;
+	f->len = len ;
+	f->lqi = lqi ;
+	memcpy (f->frame, frame, len) ;
+	if (vm->in_++ == 0)
+	    pthread_cond_signal (&vm->cond_) ;
+    }
+    pthread_mutex_unlock (&vm->lock_) ;
+}
+
+
+/******************************************************************************
+ * Master thread
+ */
+
+static void *master_main (void *arg)
+{
+    vmaster *vm = (vmaster *) arg ;
+    struct timespec ts ;
+    uint64_t wait, ns ;
+
+    while (! atomic_load (&vm->stop_))
+    {
+	process_inbox (vm) ;
+	if (host_usec () >= vm->nexthello_)
+	{
+	    send_hello (vm) ;
+	    vm->nexthello_ = host_usec () + VM_HELLO * 1000 ;
+	}
+	send_load (vm) ;
+
+	// wait for a frame, or for the next request
+	wait = VM_MAXWAIT * 1000 ;
+	if (vm->rate_ > 0 && vm->nassoc_ > 0 && 1000000 / vm->rate_ < wait)
+	    wait = (uint64_t) (1000000 / vm->rate_) ;
+	clock_gettime (CLOCK_MONOTONIC, &ts) ;
+	ns = (uint64_t) ts.tv_nsec + wait * 1000 ;
+	ts.tv_sec += ns / 1000000000 ;
+	ts.tv_nsec = ns % 1000000000 ;
+
+	pthread_mutex_lock (&vm->lock_) ;
+	if (vm->in_ == 0 && ! atomic_load (&vm->stop_))
+	    pthread_cond_timedwait (&vm->cond_, &vm->lock_, &ts) ;
+	pthread_mutex_unlock (&vm->lock_) ;
+    }
+    return NULL ;
+}
+
+
+/******************************************************************************
+ * Constructor, start and stop
+ */
+
+/**
+ * @brief Create an emulated master and attach it to the transport
+ *
+ * @param addr short address of the master
+ * @param base short address of the first slave
+ * @param nslaves number of slaves (with consecutive addresses)
+ * @param rate requests sent per second (0: none)
+ */
+
+vmaster *initVmaster (uint16_t addr, transport *tr, uint16_t base, int nslaves, double rate)
+{
+    pthread_condattr_t ca ;
+    vmaster *vm ;
+    l2addr_154 a ;
+
+    vm = (vmaster *) calloc (1, sizeof (vmaster)) ;
+    if (vm != NULL)
+    {
+	vm->sl_ = (vmslave *) calloc (nslaves, sizeof (vmslave)) ;
+	vm->assoc_ = (int *) calloc (nslaves, sizeof (int)) ;
+    }
+    if (vm == NULL || vm->sl_ == NULL || vm->assoc_ == NULL)
+    {
+	fprintf (stderr, "Memory allocation failed\n") ;
+	return NULL ;
+    }
+
+    vm->addr_ = addr ;
+    vm->tr_ = tr ;
+    vm->base_ = base ;
+    vm->nslaves_ = nslaves ;
+    vm->rate_ = rate ;
+    vm->seed_ = addr ;
+    vm->curid_ = addr ;
+    vm->hlid_ = rand_r (&vm->seed_) ;
+    pthread_mutex_init (&vm->lock_, NULL) ;
+    pthread_condattr_init (&ca) ;
+    pthread_condattr_setclock (&ca, CLOCK_MONOTONIC) ;
+    pthread_cond_init (&vm->cond_, &ca) ;
+    pthread_condattr_destroy (&ca) ;
+
+    if (! attach_transport (tr, addr, input_vmaster, vm))
+    {
+	fprintf (stderr, "Address %04x already used\n", addr) ;
+	return NULL ;
+    }
+
+    a.addr_ = addr ;
+    vm->l2_ = startL2_154 (&a, VS_CHANNEL, VS_PANID) ;
+    setTransport (vm->l2_->cm_, send_transport, tr) ;
+    vm->rmsg_ = initMsg (vm->l2_) ;
+    vm->smsg_ = initMsg (vm->l2_) ;
+    return vm ;
+}
+
+
+bool start_vmaster (vmaster *vm)
+{
+    atomic_store (&vm->stop_, false) ;
+    if (pthread_create (&vm->thread_, NULL, master_main, vm) != 0)
+    {
+	fprintf (stderr, "Cannot start the master\n") ;
+	return false ;
+    }
+    return true ;
+}
+
+
+void stop_vmaster (vmaster *vm)
+{
+    atomic_store (&vm->stop_, true) ;
+    pthread_mutex_lock (&vm->lock_) ;
+    pthread_cond_signal (&vm->cond_) ;
+    pthread_mutex_unlock (&vm->lock_) ;
+    pthread_join (vm->thread_, NULL) ;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file master.h
+ * @brief Emulated master and load generator
+ *
+ * With the loop transport, there is no real master: this module
+ * plays its role (just enough for the slaves). It broadcasts Hello
+ * messages, answers Discover messages with an Assoc message, and
+ * sends requests (GET or PUT)
+ * to the associated slaves at a given rate, on their resources
+ * (see vslave.c). It measures the round-trip time of each request.
+ *
+ * The master is run by its own thread.
+ */
+
+#ifndef __MASTER_H__
+#define __MASTER_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "vslave.h"
+
+#define	VM_INBOX	1024		// frames waiting for the master
+#define	VM_OUTSTANDING	4096		// requests waiting for a response
+#define	VM_TTL		1200		// slave ttl sent in Assoc (see is_assoc)
+#define	VM_HELLO	2000		// Hello period (ms)
+#define	VM_MAXWAIT	10		// max sleep of the master thread (ms)
+#define	VM_MAXLATE	100		// max burst to catch up the rate (ms)
+
+typedef struct vmslave
+{
+    bool assoc ;			// association acknowledged
+    uint16_t assocmid ;			// message id of the last Assoc
+} vmslave ;
+
+typedef struct vmreq
+{
+    uint32_t tok ;			// token (0: free slot)
+    uint64_t sent ;			// host_usec () at transmission
+} vmreq ;
+
+typedef struct vmstat
+{
+    unsigned long hellos ;		// Hello sent
+    unsigned long discovers ;		// Discover received
+    unsigned long assoc_sent ;		// Assoc sent
+    unsigned long requests ;		// requests sent
+    unsigned long responses ;		// responses received
+    unsigned long lost ;		// frames lost (inbox full)
+    uint64_t rtt_sum ;			// sum of round-trip times (us)
+    uint64_t rtt_max ;
+    uint32_t hist [VS_HBUCKETS] ;	// round-trip time histogram
+} vmstat ;
+
+typedef struct vmaster
+{
+    uint16_t addr_ ;
+    l2net_154 *l2_ ;
+    Msg *rmsg_ ;			// received message
+    Msg *smsg_ ;			// message to send
+    transport *tr_ ;
+    uint16_t curid_ ;			// message id
+    uint32_t curtok_ ;			// token
+    long int hlid_ ;			// hello-id
+    uint64_t nexthello_ ;		// next Hello (us)
+
+    // slaves: addresses base_ .. base_+nslaves_-1
+    uint16_t base_ ;
+    int nslaves_ ;
+    vmslave *sl_ ;
+    int *assoc_ ;			// indexes of associated slaves
+    int nassoc_ ;
+
+    // load
+    double rate_ ;			// requests per second
+    uint64_t loadstart_ ;		// first association (us)
+    uint64_t loadsent_ ;		// requests sent since loadstart_
+
+    vmreq pend_ [VM_OUTSTANDING] ;	// requests sent, by token
+
+    // frames received by the transport
+    pthread_mutex_t lock_ ;
+    pthread_cond_t cond_ ;
+    vsframe inbox_ [VM_INBOX] ;
+    int ihead_ ;
+    int in_ ;
+
+    pthread_t thread_ ;
+    atomic_bool stop_ ;
+    unsigned int seed_ ;
+
+    vmstat stat_ ;
+} vmaster ;
+
+
+vmaster *initVmaster (uint16_t addr, transport *tr, uint16_t base, int nslaves, double rate);
+
+bool start_vmaster (vmaster *vm);
+
+void stop_vmaster (vmaster *vm);
+
+void input_vmaster (void *arg, const uint8_t *frame, uint8_t len, uint8_t lqi);
+
+#endif
@@ -0,0 +1,394 @@
+/**
+ * @file pool.c
+ * @brief Worker pool running the virtual slaves (see pool.h)
+ */
+
+#include <time.h>
+
+#include "pool.h"
+
+#define	NO_TIMER	((unsigned long) -1)
+
+
+/******************************************************************************
+ * Deques
+ */
+
+// returns false if the worker is busy (not waiting for work)
+static bool push_tail (worker *w, vslave *vs)
+{
+    int max = w->pool_->maxslaves_ ;
+    bool idle ;
+
+    pthread_mutex_lock (&w->lock_) ;
+    w->deque_ [(w->head_ + w->n_) % max] = vs ;
+    w->n_++ ;
+    idle = atomic_load (&w->idle_) ;
+    if (idle)
+	pthread_cond_signal (&w->cond_) ;
+    pthread_mutex_unlock (&w->lock_) ;
+    return idle ;
+}
+
+static vslave *pop_head (worker *w)
+{
+    vslave *vs = NULL ;
+
+    pthread_mutex_lock (&w->lock_) ;
+    if (w->n_ > 0)
+    {
+	vs = w->deque_ [w->head_] ;
+	w->head_ = (w->head_ + 1) % w->pool_->maxslaves_ ;
+	w->n_-- ;
+    }
+    pthread_mutex_unlock (&w->lock_) ;
+    return vs ;
+}
+
+static vslave *pop_tail (worker *w)
+{
+    vslave *vs = NULL ;
+
+    pthread_mutex_lock (&w->lock_) ;
+    if (w->n_ > 0)
+    {
+	w->n_-- ;
+	vs = w->deque_ [(w->head_ + w->n_) % w->pool_->maxslaves_] ;
+    }
+    pthread_mutex_unlock (&w->lock_) ;
+    return vs ;
+}
+
+
+/******************************************************************************
+ * Scheduling
+ */
+
+static void wakeup (worker *w)
+{
+    pthread_mutex_lock (&w->lock_) ;
+    pthread_cond_signal (&w->cond_) ;
+    pthread_mutex_unlock (&w->lock_) ;
+}
+
+/*
+ * Queue a slave (in the VS_QUEUED state) on a worker. If this worker
+ * is busy, an idle one is woken up to steal it.
+ */
+
+static void enqueue (pool *p, worker *w, vslave *vs)
+{
+    int i ;
+
+    atomic_fetch_add (&p->queued_, 1) ;
+    if (push_tail (w, vs))
+	return ;
+    for (i = 0 ; i < p->nwk_ ; i++)
+    {
+	if (atomic_load (&p->wk_ [i].idle_))
+	{
+	    wakeup (&p->wk_ [i]) ;
+	    return ;
+	}
+    }
+}
+
+
+/**
+ * @brief A slave has something to do (frame received or timer)
+ *
+ * The slave is queued on its home worker, unless it is already
+ * queued. If it is running, it will be run again by its worker.
+ */
+
+void notify_pool (pool *p, vslave *vs)
+{
+    int s ;
+
+    s = atomic_load (&vs->state_) ;
+    for (;;)
+    {
+	switch (s)
+	{
+	    case VS_IDLE :
+		if (atomic_compare_exchange_weak (&vs->state_, &s, VS_QUEUED))
+		{
+		    enqueue (p, &p->wk_ [vs->home_], vs) ;
+		    return ;
+		}
+		break ;
+	    case VS_RUNNING :
+		if (atomic_compare_exchange_weak (&vs->state_, &s, VS_RERUN))
+		    return ;
+		break ;
+	    default :			// already queued or to be run again
+		return ;
+	}
+    }
+}
+
+
+// lower the next timer of a worker (returns true if lowered)
+static bool lower_timer (worker *w, unsigned long t)
+{
+    unsigned long cur ;
+
+    cur = atomic_load (&w->nexttimer_) ;
+    while (t < cur)
+    {
+	if (atomic_compare_exchange_weak (&w->nexttimer_, &cur, t))
+	    return true ;
+    }
+    return false ;
+}
+
+
+static void run (worker *w, vslave *vs)
+{
+    pool *p = w->pool_ ;
+    uint64_t start ;
+    unsigned long dl ;
+    int s ;
+
+    atomic_store (&vs->state_, VS_RUNNING) ;
+    start = host_usec () ;
+    run_vslave (vs) ;
+    w->stat_.busy_us += host_usec () - start ;
+    w->stat_.runs++ ;
+
+    dl = atomic_load (&vs->deadline_) ;
+    if (dl <= clock_time ())
+    {
+	// still something to do: keep it on this worker
+	atomic_store (&vs->state_, VS_QUEUED) ;
+	enqueue (p, w, vs) ;
+	return ;
+    }
+
+    // the home worker will look at this slave when its timer expires
+    if (lower_timer (&p->wk_ [vs->home_], dl) && vs->home_ != w->idx_)
+	wakeup (&p->wk_ [vs->home_]) ;
+
+    s = VS_RUNNING ;
+    if (! atomic_compare_exchange_strong (&vs->state_, &s, VS_IDLE))
+    {
+	// notified while running
+	atomic_store (&vs->state_, VS_QUEUED) ;
+	enqueue (p, w, vs) ;
+    }
+}
+
+
+static vslave *steal (worker *w)
+{
+    pool *p = w->pool_ ;
+    vslave *vs ;
+    int i, v ;
+
+    v = rand_r (&w->seed_) % p->nwk_ ;
+    for (i = 0 ; i < p->nwk_ ; i++, v = (v + 1) % p->nwk_)
+    {
+	if (v == w->idx_)
+	    continue ;
+	vs = pop_tail (&p->wk_ [v]) ;
+	if (vs != NULL)
+	    return vs ;
+    }
+    return NULL ;
+}
+
+
+/*
+ * Queue the slaves of the shard whose timer has expired, and
+ * compute the next timer of the shard.
+ */
+
+static void scan_timers (worker *w, unsigned long now)
+{
+    unsigned long next, dl ;
+    int i ;
+
+    atomic_store (&w->nexttimer_, NO_TIMER) ;
+    next = NO_TIMER ;
+    for (i = 0 ; i < w->nshard_ ; i++)
+    {
+	vslave *vs = w->shard_ [i] ;
+
+	dl = atomic_load (&vs->deadline_) ;
+	if (dl <= now)
+	{
+	    w->stat_.timers++ ;
+	    notify_pool (w->pool_, vs) ;
+	}
+	else if (dl < next)
+	    next = dl ;
+    }
+    lower_timer (w, next) ;
+}
+
+
+/*
+ * Wait for work or for the next timer of the shard. The deadline is
+ * computed under the worker lock: a timer lowered by another worker
+ * (see run) is either seen here, or its wakeup is signalled while
+ * this worker waits.
+ */
+
+static void sleep_worker (worker *w)
+{
+    pool *p = w->pool_ ;
+    unsigned long now, until ;
+    struct timespec ts ;
+    uint64_t ns ;
+
+    pthread_mutex_lock (&w->lock_) ;
+    atomic_store (&w->idle_, true) ;
+    now = clock_time () ;
+    until = atomic_load (&w->nexttimer_) ;
+    if (until > now + POOL_MAXWAIT)
+	until = now + POOL_MAXWAIT ;
+    if (atomic_load (&p->queued_) == 0 && ! atomic_load (&p->stop_) && until > now)
+    {
+	clock_gettime (CLOCK_MONOTONIC, &ts) ;
+	ns = (uint64_t) ts.tv_nsec + (uint64_t) (until - now) * 1000000 ;
+	ts.tv_sec += ns / 1000000000 ;
+	ts.tv_nsec = ns % 1000000000 ;
+	w->stat_.sleeps++ ;
+	pthread_cond_timedwait (&w->cond_, &w->lock_, &ts) ;
+    }
+    atomic_store (&w->idle_, false) ;
+    pthread_mutex_unlock (&w->lock_) ;
+}
+
+
+static void *worker_main (void *arg)
+{
+    worker *w = (worker *) arg ;
+    pool *p = w->pool_ ;
+    vslave *vs ;
+    unsigned long now ;
+
+    while (! atomic_load (&p->stop_))
+    {
+	vs = pop_head (w) ;
+	if (vs == NULL && (vs = steal (w)) != NULL)
+	    w->stat_.steals++ ;
+	if (vs != NULL)
+	{
+	    atomic_fetch_sub (&p->queued_, 1) ;
+	    run (w, vs) ;
+	    continue ;
+	}
+
+	now = clock_time () ;
+	if (now >= atomic_load (&w->nexttimer_))
+	    scan_timers (w, now) ;
+	else sleep_worker (w) ;
+    }
+    return NULL ;
+}
+
+
+/******************************************************************************
+ * Constructor, start and stop
+ */
+
+/**
+ * @brief Create a pool (workers are not started)
+ *
+ * @param nworkers number of worker threads
+ * @param maxslaves max number of slaves (see `add_pool`)
+ */
+
+pool *initPool (int nworkers, int maxslaves)
+{
+    pthread_condattr_t ca ;
+    pool *p ;
+    int i ;
+
+    p = (pool *) calloc (1, sizeof (pool)) ;
+    if (p == NULL)
+    {
+	fprintf (stderr, "Memory allocation failed\n") ;
+	return NULL ;
+    }
+    p->nwk_ = nworkers ;
+    p->maxslaves_ = maxslaves ;
+    p->wk_ = (worker *) calloc (nworkers, sizeof (worker)) ;
+    if (p->wk_ == NULL)
+    {
+	fprintf (stderr, "Memory allocation failed\n") ;
+	free (p) ;
+	return NULL ;
+    }
+
+    for (i = 0 ; i < nworkers ; i++)
+    {
+	worker *w = &p->wk_ [i] ;
+
+	w->idx_ = i ;
+	w->pool_ = p ;
+	pthread_mutex_init (&w->lock_, NULL) ;
+	pthread_condattr_init (&ca) ;
+	pthread_condattr_setclock (&ca, CLOCK_MONOTONIC) ;
+	pthread_cond_init (&w->cond_, &ca) ;
+	pthread_condattr_destroy (&ca) ;
+	w->deque_ = (vslave **) malloc (maxslaves * sizeof (vslave *)) ;
+	w->shard_ = (vslave **) malloc (maxslaves * sizeof (vslave *)) ;
+	if (w->deque_ == NULL || w->shard_ == NULL)
+	{
+	    fprintf (stderr, "Memory allocation failed\n") ;
+	    return NULL ;
+	}
+	atomic_init (&w->nexttimer_, 0) ;
+	w->seed_ = i + 1 ;
+    }
+    return p ;
+}
+
+
+/**
+ * @brief Add a slave to the shard of a worker (round-robin)
+ *
+ * Must be called before `start_pool`.
+ */
+
+void add_pool (pool *p, vslave *vs)
+{
+    worker *w ;
+
+    vs->home_ = vs->idx_ % p->nwk_ ;
+    w = &p->wk_ [vs->home_] ;
+    w->shard_ [w->nshard_++] = vs ;
+}
+
+
+bool start_pool (pool *p)
+{
+    int i ;
+
+    atomic_store (&p->stop_, false) ;
+    for (i = 0 ; i < p->nwk_ ; i++)
+    {
+	if (pthread_create (&p->wk_ [i].thread_, NULL, worker_main, &p->wk_ [i]) != 0)
+	{
+	    fprintf (stderr, "Cannot start worker %d\n", i) ;
+	    p->nwk_ = i ;
+	    stop_pool (p) ;
+	    return false ;
+	}
+    }
+    return true ;
+}
+
+
+void stop_pool (pool *p)
+{
+    int i ;
+
+    atomic_store (&p->stop_, true) ;
+    for (i = 0 ; i < p->nwk_ ; i++)
+	wakeup (&p->wk_ [i]) ;
+    for (i = 0 ; i < p->nwk_ ; i++)
+	pthread_join (p->wk_ [i].thread_, NULL) ;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file pool.h
+ * @brief Worker pool running the virtual slaves
+ *
+ * Slaves are sharded among the workers (round-robin): a worker
+ * runs the slaves of its shard when they receive a frame or when
+ * one of their timers expires. Runnable slaves are queued in the
+ * deque of their home worker; an idle worker steals runnable slaves
+ * from the other deques, such that busy shards are helped by the
+ * others. A slave is never run by two workers at the same time
+ * (see the VS_* states in vslave.h).
+ */
+
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "vslave.h"
+
+#define	POOL_MAXWAIT	100		// max sleep of an idle worker (ms)
+
+typedef struct wkstat
+{
+    unsigned long runs ;		// slaves run
+    unsigned long steals ;		// slaves stolen from other workers
+    unsigned long timers ;		// slaves run for a timer
+    unsigned long sleeps ;		// idle waits
+    uint64_t busy_us ;			// time spent running slaves
+} wkstat ;
+
+typedef struct worker
+{
+    int idx_ ;
+    pthread_t thread_ ;
+    struct pool *pool_ ;
+
+    // runnable slaves (owner pops at head, thieves at tail)
+    pthread_mutex_t lock_ ;
+    pthread_cond_t cond_ ;		// idle worker waits here
+    atomic_bool idle_ ;
+    vslave **deque_ ;
+    int head_ ;
+    int n_ ;
+
+    // shard: slaves owned by this worker
+    vslave **shard_ ;
+    int nshard_ ;
+    atomic_ulong nexttimer_ ;		// min deadline of the shard (ms)
+
+    unsigned int seed_ ;		// victim selection
+    wkstat stat_ ;
+} worker ;
+
+typedef struct pool
+{
+    worker *wk_ ;
+    int nwk_ ;
+    int maxslaves_ ;
+
+    atomic_int queued_ ;		// slaves in all deques
+    atomic_bool stop_ ;
+} pool ;
+
+
+pool *initPool (int nworkers, int maxslaves);
+
+void add_pool (pool *p, vslave *vs);
+
+bool start_pool (pool *p);
+
+void stop_pool (pool *p);
+
+void notify_pool (pool *p, vslave *vs);
+
+#endif
@@ -0,0 +1,337 @@
+/**
+ * @file transport.c
+ * @brief Frame transports of the host program (see transport.h)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "transport.h"
+#include "netstack.h"
+
+#define	UDP_RXTIMEOUT	100		// ms, to check the stop flag
+
+
+/******************************************************************************
+ * Endpoints
+ */
+
+static transport *initTransport (const char *name, trsend_t send, int maxep)
+{
+    transport *tr ;
+    int i ;
+
+    tr = (transport *) calloc (1, sizeof (transport)) ;
+    if (tr == NULL)
+    {
+	fprintf (stderr, "Memory allocation failed\n") ;
+	return NULL ;
+    }
+    tr->name_ = name ;
+    tr->send_ = send ;
+    tr->maxep_ = maxep ;
+    tr->ep_ = (trendpoint *) calloc (maxep, sizeof (trendpoint)) ;
+    tr->byaddr_ = (int *) malloc (TR_NADDR * sizeof (int)) ;
+    if (tr->ep_ == NULL || tr->byaddr_ == NULL)
+    {
+	fprintf (stderr, "Memory allocation failed\n") ;
+	freeTransport (tr) ;
+	return NULL ;
+    }
+    for (i = 0 ; i < TR_NADDR ; i++)
+	tr->byaddr_ [i] = -1 ;
+    tr->sock_ = -1 ;
+    return tr ;
+}
+
+
+void freeTransport (transport *tr)
+{
+    if (tr->sock_ != -1)
+	close (tr->sock_) ;
+    free (tr->ep_) ;
+    free (tr->byaddr_) ;
+    free (tr) ;
+}
+
+
+/**
+ * @brief Attach an endpoint to the transport
+ *
+ * Must be called before `start_transport`.
+ *
+ * @param addr short address of the endpoint (not the broadcast one)
+ * @param input function called for each frame sent to this endpoint
+ * @return false if the address is already used or the table is full
+ */
+
+bool attach_transport (transport *tr, uint16_t addr, trinput_t input, void *arg)
+{
+    trendpoint *ep ;
+
+    if (addr == TR_BCAST || tr->byaddr_ [addr] != -1 || tr->nep_ >= tr->maxep_)
+	return false ;
+    ep = &tr->ep_ [tr->nep_] ;
+    ep->addr = addr ;
+    ep->input = input ;
+    ep->arg = arg ;
+    tr->byaddr_ [addr] = tr->nep_++ ;
+    return true ;
+}
+
+
+/**
+ * @brief Dispatch a frame to the attached endpoints
+ *
+ * A broadcast frame is given to all endpoints but its sender.
+ */
+
+void input_transport (transport *tr, const uint8_t *frame, uint8_t len, uint8_t lqi)
+{
+    uint16_t dst, src ;
+    int i ;
+
+    if (len < TR_HDRLEN)
+    {
+	atomic_fetch_add (&tr->stat_.errors, 1) ;
+	return ;
+    }
+
+    dst = TR_DST (frame) ;
+    if (dst == TR_BCAST)
+    {
+	src = TR_SRC (frame) ;
+	for (i = 0 ; i < tr->nep_ ; i++)
+	{
+	    if (tr->ep_ [i].addr != src)
+	    {
+		(*tr->ep_ [i].input) (tr->ep_ [i].arg, frame, len, lqi) ;
+		atomic_fetch_add (&tr->stat_.delivered, 1) ;
+	    }
+	}
+    }
+    else if ((i = tr->byaddr_ [dst]) != -1)
+    {
+	(*tr->ep_ [i].input) (tr->ep_ [i].arg, frame, len, lqi) ;
+	atomic_fetch_add (&tr->stat_.delivered, 1) ;
+    }
+    else atomic_fetch_add (&tr->stat_.unknown, 1) ;
+}
+
+
+/**
+ * @brief Send a frame (ConMsg transport function, see `setTransport`)
+ *
+ * @param tr transport
+ * @return RADIO_TX_* code
+ */
+
+int send_transport (void *tr, const uint8_t *frame, uint8_t len)
+{
+    transport *t = (transport *) tr ;
+
+    atomic_fetch_add (&t->stat_.sent, 1) ;
+    return (*t->send_) (t, frame, len) ;
+}
+
+
+/******************************************************************************
+ * Loop transport
+ */
+
+static int loop_send (transport *tr, const uint8_t *frame, uint8_t len)
+{
+    uint16_t dst ;
+
+    dst = TR_DST (frame) ;
+    if (len >= TR_HDRLEN && dst != TR_BCAST && tr->byaddr_ [dst] == -1)
+    {
+	atomic_fetch_add (&tr->stat_.unknown, 1) ;
+	return RADIO_TX_NOACK ;		// nobody to acknowledge the frame
+    }
+    input_transport (tr, frame, len, TR_LQI) ;
+    return RADIO_TX_OK ;
+}
+
+
+/**
+ * @brief Create an in-process network
+ *
+ * @param maxep max number of endpoints
+ */
+
+transport *initLoopTransport (int maxep)
+{
+    return initTransport ("loop", loop_send, maxep) ;
+}
+
+
+/******************************************************************************
+ * UDP transport
+ *
+ * The socket is connected: read/write are used since the library
+ * defines its own send and recv functions (see l2-154.c).
+ */
+
+static int udp_send (transport *tr, const uint8_t *frame, uint8_t len)
+{
+    if (write (tr->sock_, frame, len) != (ssize_t) len)
+    {
+	atomic_fetch_add (&tr->stat_.errors, 1) ;
+	return RADIO_TX_ERR ;
+    }
+    return RADIO_TX_OK ;
+}
+
+
+static void *udp_receiver (void *arg)
+{
+    transport *tr = (transport *) arg ;
+    uint8_t frame [256] ;
+    ssize_t n ;
+
+    while (! atomic_load (&tr->stop_))
+    {
+	n = read (tr->sock_, frame, sizeof frame) ;
+	if (n < 0)
+	    continue ;			// timeout (or error): check stop flag
+	atomic_fetch_add (&tr->stat_.received, 1) ;
+	if (n > 127)
+	{
+	    atomic_fetch_add (&tr->stat_.errors, 1) ;
+	    continue ;
+	}
+	input_transport (tr, frame, (uint8_t) n, TR_LQI) ;
+    }
+    return NULL ;
+}
+
+
+/**
+ * @brief Create a UDP bridge
+ *
+ * @param maxep max number of endpoints
+ * @param peer "host:port" of the remote peer
+ * @param lport local UDP port (0: any)
+ * @return NULL if the peer cannot be resolved or the socket created
+ */
+
+transport *initUdpTransport (int maxep, const char *peer, int lport)
+{
+    transport *tr ;
+    struct addrinfo hints, *res ;
+    struct sockaddr_storage local ;
+    struct timeval tv ;
+    char host [256], *port ;
+    int r ;
+
+    snprintf (host, sizeof host, "%s", peer) ;
+    port = strrchr (host, ':') ;
+    if (port == NULL)
+    {
+	fprintf (stderr, "%s: peer must be host:port\n", peer) ;
+	return NULL ;
+    }
+    *port++ = '\0' ;
+    if (host [0] == '[' && port [-2] == ']')	// [ipv6]:port
+    {
+	port [-2] = '\0' ;
+	memmove (host, host + 1, strlen (host)) ;
+    }
+
+    memset (&hints, 0, sizeof hints) ;
+    hints.ai_family = AF_UNSPEC ;
+    hints.ai_socktype = SOCK_DGRAM ;
+    r = getaddrinfo (host, port, &hints, &res) ;
+    if (r != 0)
+    {
+	fprintf (stderr, "%s: %s\n", peer, gai_strerror (r)) ;
+	return NULL ;
+    }
+
+    tr = initTransport ("udp", udp_send, maxep) ;
+    if (tr == NULL)
+    {
+	freeaddrinfo (res) ;
+	return NULL ;
+    }
+
+    tr->sock_ = socket (res->ai_family, res->ai_socktype, res->ai_protocol) ;
+    if (tr->sock_ == -1)
+    {
+	perror ("socket") ;
+	goto fail ;
+    }
+
+    // bind to the local port with the same (wildcard) address family
+    memset (&local, 0, sizeof local) ;
+    memcpy (&local, res->ai_addr, res->ai_addrlen) ;
+    if (res->ai_family == AF_INET6)
+    {
+	struct sockaddr_in6 *a = (struct sockaddr_in6 *) &local ;
+	a->sin6_addr = in6addr_any ;
+	a->sin6_port = htons (lport) ;
+    }
+    else
+    {
+	struct sockaddr_in *a = (struct sockaddr_in *) &local ;
+	a->sin_addr.s_addr = htonl (INADDR_ANY) ;
+	a->sin_port = htons (lport) ;
+    }
+    if (bind (tr->sock_, (struct sockaddr *) &local, res->ai_addrlen) == -1)
+    {
+	perror ("bind") ;
+	goto fail ;
+    }
+    if (connect (tr->sock_, res->ai_addr, res->ai_addrlen) == -1)
+    {
+	perror ("connect") ;
+	goto fail ;
+    }
+
+    tv.tv_sec = 0 ;
+    tv.tv_usec = UDP_RXTIMEOUT * 1000 ;
+    setsockopt (tr->sock_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv) ;
+
+    freeaddrinfo (res) ;
+    return tr ;
+
+fail:
+    freeaddrinfo (res) ;
+    freeTransport (tr) ;
+    return NULL ;
+}
+
+
+/******************************************************************************
+ * Start and stop
+ */
+
+bool start_transport (transport *tr)
+{
+    atomic_store (&tr->stop_, false) ;
+    if (tr->sock_ != -1)
+    {
+	if (pthread_create (&tr->rxthread_, NULL, udp_receiver, tr) != 0)
+	{
+	    fprintf (stderr, "Cannot start the %s receiver\n", tr->name_) ;
+	    return false ;
+	}
+	tr->rxrun_ = true ;
+    }
+    return true ;
+}
+
+
+void stop_transport (transport *tr)
+{
+    atomic_store (&tr->stop_, true) ;
+    if (tr->rxrun_)
+	pthread_join (tr->rxthread_, NULL) ;
+    tr->rxrun_ = false ;
+}
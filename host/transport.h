@@ -0,0 +1,96 @@
+/**
+ * @file transport.h
+ * @brief Frame transports of the host program
+ *
+ * A transport carries complete IEEE 802.15.4 frames (MAC header
+ * included, FCS excluded) between the endpoints attached to it
+ * (virtual slaves, emulated master) and the outside world:
+ * * the `loop` transport is an in-process network: a frame sent by
+ *	an endpoint is delivered to the endpoint with the destination
+ *	address, or to all other endpoints if it is a broadcast frame
+ * * the `udp` transport bridges frames to a remote peer (a master,
+ *	or a radio gateway), one frame per UDP datagram; received frames
+ *	are dispatched to local endpoints according to their destination
+ *
+ * Endpoints are attached with `attach_transport`, and frames are sent
+ * with `send_transport` (which may be used as a ConMsg transport, see
+ * `setTransport`). Frames are delivered to endpoints by the thread
+ * which sends them (loop) or by the receiver thread (udp): the input
+ * function of an endpoint must only queue the frame.
+ */
+
+#ifndef __TRANSPORT_H__
+#define __TRANSPORT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define	TR_NADDR	65536		// 16 bits short addresses
+#define	TR_BCAST	0xffff		// broadcast address
+#define	TR_LQI		255		// link quality of delivered frames
+
+// frame fields used for dispatching (see ConMsg sendto)
+#define	TR_HDRLEN	9		// MAC header length
+#define	TR_DST(f)	((uint16_t) ((f) [5] | ((f) [6] << 8)))
+#define	TR_SRC(f)	((uint16_t) ((f) [7] | ((f) [8] << 8)))
+
+typedef void (*trinput_t) (void *arg, const uint8_t *frame, uint8_t len, uint8_t lqi) ;
+
+typedef struct trendpoint
+{
+    uint16_t addr ;			// short address
+    trinput_t input ;			// called for each frame received
+    void *arg ;				// argument of input
+} trendpoint ;
+
+typedef struct trstat
+{
+    atomic_ulong sent ;			// frames sent by endpoints
+    atomic_ulong delivered ;		// frames given to endpoints
+    atomic_ulong unknown ;		// frames for unknown destinations
+    atomic_ulong received ;		// datagrams received (udp)
+    atomic_ulong errors ;		// send or receive errors (udp)
+} trstat ;
+
+struct transport ;
+
+typedef int (*trsend_t) (struct transport *tr, const uint8_t *frame, uint8_t len) ;
+
+typedef struct transport
+{
+    const char *name_ ;
+    trsend_t send_ ;			// returns a RADIO_TX_* code
+    trendpoint *ep_ ;			// attached endpoints
+    int nep_ ;
+    int maxep_ ;
+    int *byaddr_ ;			// endpoint index by address (or -1)
+
+    // udp transport
+    int sock_ ;
+    pthread_t rxthread_ ;
+    bool rxrun_ ;			// receiver thread started
+    atomic_bool stop_ ;
+
+    trstat stat_ ;
+} transport ;
+
+
+transport *initLoopTransport (int maxep) ;
+
+transport *initUdpTransport (int maxep, const char *peer, int lport) ;
+
+void freeTransport (transport *tr) ;
+
+bool attach_transport (transport *tr, uint16_t addr, trinput_t input, void *arg) ;
+
+bool start_transport (transport *tr) ;
+
+void stop_transport (transport *tr) ;
+
+int send_transport (void *tr, const uint8_t *frame, uint8_t len) ;
+
+void input_transport (transport *tr, const uint8_t *frame, uint8_t len, uint8_t lqi) ;
+
+#endif
@@ -0,0 +1,393 @@
+/**
+ * @file vslave.c
+ * @brief Virtual slave (see vslave.h)
+ */
+
+#include "vslave.h"
+#include "pool.h"
+
+/*
+ * Resource handlers have no context argument: the worker sets the
+ * slave it runs before running the engine.
+ */
+
+static __thread vslave *vs_current ;
+
+
+/******************************************************************************
+ * Resources
+ */
+
+static uint8_t process_temp (Msg *in, Msg *out)
+{
+    char payload [10] ;
+    vslave *vs = vs_current ;
+
+    (void) in ;
+    set_max_age (out, true, 0) ;		// answer is not cachable
+    vs->served_++ ;
+    snprintf (payload, sizeof payload, "%ld.%ld",
+		    20 + vs->slaveid_ % 10, (long int) (vs->served_ % 10)) ;
+    set_payload_msg (out, (uint8_t *) payload, strlen (payload)) ;
+    return COAP_CODE_OK ;
+}
+
+static uint8_t process_light (Msg *in, Msg *out)
+{
+    char payload [10] ;
+    vslave *vs = vs_current ;
+
+    (void) in ;
+    set_max_age (out, true, 0) ;
+    vs->served_++ ;
+    snprintf (payload, sizeof payload, "%ld", (long int) (vs->served_ * 7 % 1000)) ;
+    set_payload_msg (out, (uint8_t *) payload, strlen (payload)) ;
+    return COAP_CODE_OK ;
+}
+
+static uint8_t process_led_get (Msg *in, Msg *out)
+{
+    char payload [2] ;
+    vslave *vs = vs_current ;
+
+    (void) in ;
+    set_max_age (out, true, 0) ;
+    vs->served_++ ;
+    payload [0] = vs->led_ ? '1' : '0' ;
+    set_payload_msg (out, (uint8_t *) payload, 1) ;
+    return COAP_CODE_OK ;
+}
+
+static uint8_t process_led_put (Msg *in, Msg *out)
+{
+    vslave *vs = vs_current ;
+
+    (void) out ;
+    vs->served_++ ;
+    if (get_paylen_msg (in) != 1)
+	return COAP_CODE_BAD_REQUEST ;
+    vs->led_ = get_payload_msg (in) [0] == '1' ;
+    return COAP_RETURN_CODE (2, 4) ;		// changed
+}
+
+
+/******************************************************************************
+ * Latency measurement
+ */
+
+// histogram bucket of a latency (us)
+int bucket_vslave (uint64_t v)
+{
+    int e ;
+
+    if (v > UINT32_MAX)
+	v = UINT32_MAX ;
+    if (v < VS_HSUB)
+	return (int) v ;
+    e = 63 - __builtin_clzll (v) ;		// v in [2^e, 2^(e+1))
+    return (e - 1) * VS_HSUB + (int) ((v >> (e - 2)) & (VS_HSUB - 1)) ;
+}
+
+// upper bound of the values in the bucket
+static uint64_t hist_value (int b)
+{
+    int e ;
+
+    if (b < VS_HSUB)
+	return b ;
+    e = b / VS_HSUB + 1 ;
+    return ((uint64_t) (VS_HSUB + b % VS_HSUB + 1) << (e - 2)) - 1 ;
+}
+
+
+/**
+ * @brief Value (us) under which a proportion p of the latencies lie
+ */
+
+uint64_t percentile_vslave (const uint32_t *hist, double p)
+{
+    uint64_t total, n, target ;
+    int b ;
+
+    total = 0 ;
+    for (b = 0 ; b < VS_HBUCKETS ; b++)
+	total += hist [b] ;
+    if (total == 0)
+	return 0 ;
+    target = (uint64_t) (p * total + 0.5) ;
+    if (target == 0)
+	target = 1 ;
+    n = 0 ;
+    for (b = 0 ; b < VS_HBUCKETS ; b++)
+    {
+	n += hist [b] ;
+	if (n >= target)
+	    break ;
+    }
+    return hist_value (b) ;
+}
+
+
+void add_hist_vslave (uint32_t *hist, const uint32_t *h)
+{
+    int b ;
+
+    for (b = 0 ; b < VS_HBUCKETS ; b++)
+	hist [b] += h [b] ;
+}
+
+
+/*
+ * CoAP header of a frame (see ConMsg sendto for the MAC header):
+ * returns false if the frame is too short to hold it
+ */
+
+static bool coap_header (const uint8_t *frame, uint8_t len,
+			    uint8_t *type, uint8_t *code, uint16_t *mid,
+			    uint8_t *tkl, const uint8_t **tok)
+{
+    const uint8_t *p = frame + TR_HDRLEN ;
+
+    if (len < TR_HDRLEN + 4)
+	return false ;
+    *type = (p [0] >> 4) & 0x3 ;
+    *tkl = p [0] & 0xf ;
+    *code = p [1] ;
+    *mid = (p [2] << 8) | p [3] ;
+    *tok = p + 4 ;
+    return *tkl <= COAP_MAX_TOKLEN && len >= TR_HDRLEN + 4 + *tkl ;
+}
+
+
+/*
+ * A request is given to the engine: remember its arrival time.
+ * Only requests sent to this slave are counted (not the broadcast
+ * Discover messages of other slaves, for example).
+ */
+
+static void note_request (vslave *vs, const vsframe *f)
+{
+    uint8_t type, code, tkl ;
+    uint16_t mid ;
+    const uint8_t *tok ;
+    vsreq *r ;
+
+    if (TR_DST (f->frame) != getAddr2 (vs->l2_->cm_))
+	return ;
+    if (! coap_header (f->frame, f->len, &type, &code, &mid, &tkl, &tok))
+	return ;
+    if (code == 0 || code >= COAP_RETURN_CODE (1, 0))
+	return ;
+
+    vs->stat_.requests++ ;
+    r = &vs->inflight_ [vs->infnext_] ;	// oldest one if all are used
+    vs->infnext_ = (vs->infnext_ + 1) % VS_INFLIGHT ;
+    r->used = true ;
+    r->tkl = tkl ;
+    memcpy (r->tok, tok, tkl) ;
+    r->mid = mid ;
+    r->arrival = f->arrival ;
+}
+
+
+// a response is sent: account for the latency of its request
+static void note_response (vslave *vs, const uint8_t *frame, uint8_t len)
+{
+    uint8_t type, code, tkl ;
+    uint16_t mid ;
+    const uint8_t *tok ;
+    uint64_t lat ;
+    int i ;
+
+    if (! coap_header (frame, len, &type, &code, &mid, &tkl, &tok))
+	return ;
+    if (code < COAP_RETURN_CODE (2, 0))
+	return ;
+
+    for (i = 0 ; i < VS_INFLIGHT ; i++)
+    {
+	vsreq *r = &vs->inflight_ [i] ;
+
+	if (r->used && r->tkl == tkl && memcmp (r->tok, tok, tkl) == 0
+			&& (tkl > 0 || r->mid == mid))
+	{
+	    r->used = false ;
+	    lat = host_usec () - r->arrival ;
+	    vs->stat_.responses++ ;
+	    vs->stat_.lat_sum += lat ;
+	    if (lat > vs->stat_.lat_max)
+		vs->stat_.lat_max = lat ;
+	    vs->stat_.hist [bucket_vslave (lat)]++ ;
+	    break ;
+	}
+    }
+}
+
+
+/******************************************************************************
+ * Frames
+ */
+
+// ConMsg transport: called by the engine, hence by a worker
+static int vs_tx (void *arg, const uint8_t *frame, uint8_t len)
+{
+    vslave *vs = (vslave *) arg ;
+
+    vs->stat_.tx_frames++ ;
+    note_response (vs, frame, len) ;
+    return send_transport (vs->tr_, frame, len) ;
+}
+
+
+/**
+ * @brief Queue a frame received by the transport (transport input
+ *	function, see `attach_transport`)
+ *
+ * The frame is given to the engine by the next run of the slave.
+ */
+
+void input_vslave (void *arg, const uint8_t *frame, uint8_t len, uint8_t lqi)
+{
+    vslave *vs = (vslave *) arg ;
+    vsframe *f ;
+
+    if (len > MAX_PAYLOAD)
+	return ;
+
+    pthread_mutex_lock (&vs->lock_) ;
+    if (vs->in_ >= VS_INBOX)
+    {
+	pthread_mutex_unlock (&vs->lock_) ;
+	atomic_fetch_add (&vs->inlost_, 1) ;
+	return ;
+    }
+    f = &vs->inbox_ [(vs->ihead_ + vs->in_) % VS_INBOX] ;
+    f->arrival = host_usec () ;
+    f->len = len ;
+    f->lqi = lqi ;
+    memcpy (f->frame, frame, len) ;
+    vs->in_++ ;
+    pthread_mutex_unlock (&vs->lock_) ;
+
+    notify_pool (vs->pool_, vs) ;
+}
+
+
+/*
+ * Move frames from the inbox to the ConMsg reception buffer,
+ * as the radio does. Returns the number of frames moved.
+ */
+
+static int drain_inbox (vslave *vs)
+{
+    ConMsg *cm = vs->l2_->cm_ ;
+    int n = 0 ;
+
+    pthread_mutex_lock (&vs->lock_) ;
+    while (vs->in_ > 0 && nb_received (cm) < getMsgbufsize (cm) - 1)
+    {
+	vsframe *f = &vs->inbox_ [vs->ihead_] ;
+
+	if (deliver_frame (cm, f->frame, f->len, f->lqi))
+	    note_request (vs, f) ;
+	else vs->stat_.rx_dropped++ ;	// radio off (queue mode)
+	vs->ihead_ = (vs->ihead_ + 1) % VS_INBOX ;
+	vs->in_-- ;
+	n++ ;
+    }
+    pthread_mutex_unlock (&vs->lock_) ;
+    return n ;
+}
+
+
+/**
+ * @brief Run the engine (called by a worker)
+ *
+ * Waiting frames are given to the engine, which is run until they
+ * are handled (at most VS_MAXROUNDS times, such that a busy slave
+ * does not hold a worker). The next engine deadline is then updated:
+ * it is now if frames are still waiting.
+ */
+
+void run_vslave (vslave *vs)
+{
+    int round, moved ;
+    time_t next ;
+
+    vs_current = vs ;
+    vs->stat_.runs++ ;
+    for (round = 0 ; round < VS_MAXROUNDS ; round++)
+    {
+	moved = drain_inbox (vs) ;
+	loop (vs->ca_) ;
+	if (moved == 0 && pending_frames (vs->l2_) == 0)
+	    break ;
+    }
+
+    pthread_mutex_lock (&vs->lock_) ;
+    moved = vs->in_ ;
+    pthread_mutex_unlock (&vs->lock_) ;
+    if (moved > 0 || pending_frames (vs->l2_) > 0)
+	next = vs->ca_->curtime_ ;
+    else next = casan_next_deadline (vs->ca_) ;
+    atomic_store (&vs->deadline_, (unsigned long) next) ;
+    vs_current = NULL ;
+}
+
+
+/******************************************************************************
+ * Constructor
+ */
+
+/**
+ * @brief Create a virtual slave and attach it to the transport
+ *
+ * @param idx index of the slave in the host program
+ * @param addr short address of the slave
+ * @param slaveid CASAN slave-id
+ * @return NULL if the address is already used on the transport
+ */
+
+vslave *initVslave (int idx, uint16_t addr, long int slaveid, transport *tr, struct pool *pool)
+{
+    vslave *vs ;
+    l2addr_154 a ;
+
+    vs = (vslave *) calloc (1, sizeof (vslave)) ;
+    if (vs == NULL)
+    {
+	fprintf (stderr, "Memory allocation failed\n") ;
+	return NULL ;
+    }
+    vs->idx_ = idx ;
+    vs->slaveid_ = slaveid ;
+    vs->tr_ = tr ;
+    vs->pool_ = pool ;
+    pthread_mutex_init (&vs->lock_, NULL) ;
+    atomic_init (&vs->state_, VS_IDLE) ;
+    atomic_init (&vs->deadline_, 0) ;	// run as soon as possible
+
+    if (! attach_transport (tr, addr, input_vslave, vs))
+    {
+	fprintf (stderr, "Address %04x already used\n", addr) ;
+	free (vs) ;
+	return NULL ;
+    }
+
+    a.addr_ = addr ;
+    vs->l2_ = startL2_154 (&a, VS_CHANNEL, VS_PANID) ;
+    setTransport (vs->l2_->cm_, vs_tx, vs) ;
+    vs->ca_ = initCasan (vs->l2_, VS_MTU, slaveid) ;
+
+    vs->res_ [0] = initResource ("temp", "Temperature", "celsius") ;
+    setHandlerResource (vs->res_ [0], COAP_CODE_GET, process_temp) ;
+    vs->res_ [1] = initResource ("light", "Light", "lux") ;
+    setHandlerResource (vs->res_ [1], COAP_CODE_GET, process_light) ;
+    vs->res_ [2] = initResource ("led", "Led", "light") ;
+    setHandlerResource (vs->res_ [2], COAP_CODE_GET, process_led_get) ;
+    setHandlerResource (vs->res_ [2], COAP_CODE_PUT, process_led_put) ;
+    for (idx = 0 ; idx < VS_NRES ; idx++)
+	register_resource (vs->ca_, vs->res_ [idx]) ;
+
+    return vs ;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file vslave.h
+ * @brief Virtual slave: a CASAN engine run by the host program
+ *
+ * Each virtual slave has its own L2 object (hence its own ConMsg
+ * instance and short address), its own engine, slave-id and
+ * resources. Frames are sent through a transport (see transport.h)
+ * and received frames are queued in an inbox by the transport; the
+ * engine itself is only run by the worker pool (see pool.h), by one
+ * worker at a time.
+ *
+ * The slave measures its request latency: from the arrival of a
+ * request in the inbox to the transmission of the response (with
+ * the same token), including the time spent waiting for a worker.
+ */
+
+#ifndef __VSLAVE_H__
+#define __VSLAVE_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "transport.h"
+#include "../libraries/L2-154/l2-154.h"
+#include "../libraries/Casan/casan.h"
+
+#define	VS_CHANNEL	15		// same as the example program
+#define	VS_PANID	CONST16 (0xca, 0xfe)
+#define	VS_MTU		127
+
+#define	VS_INBOX	32		// frames waiting for the engine
+#define	VS_INFLIGHT	8		// requests waiting for a response
+#define	VS_NRES		3		// resources of each slave
+#define	VS_MAXROUNDS	4		// max engine loops per run
+
+// latency histogram: 4 buckets per power of 2 (microseconds)
+#define	VS_HSUB		4
+#define	VS_HBUCKETS	(32 * VS_HSUB)
+
+// scheduling state (see pool.c)
+enum
+{
+    VS_IDLE,				// waiting for a frame or a timer
+    VS_QUEUED,				// in a worker queue
+    VS_RUNNING,				// run by a worker
+    VS_RERUN,				// run again when the current run ends
+} ;
+
+struct pool ;
+
+typedef struct vsframe
+{
+    uint64_t arrival ;			// host_usec () at input
+    uint8_t len ;
+    uint8_t lqi ;
+    uint8_t frame [MAX_PAYLOAD] ;
+} vsframe ;
+
+typedef struct vsreq
+{
+    bool used ;
+    uint8_t tkl ;			// token length
+    uint8_t tok [COAP_MAX_TOKLEN] ;
+    uint16_t mid ;			// message id (for empty tokens)
+    uint64_t arrival ;
+} vsreq ;
+
+typedef struct vsstat
+{
+    unsigned long requests ;		// requests given to the engine
+    unsigned long responses ;		// responses sent to these requests
+    unsigned long rx_dropped ;		// frames lost (inbox or ConMsg full)
+    unsigned long tx_frames ;		// frames sent
+    unsigned long runs ;		// engine runs
+    uint64_t lat_sum ;			// sum of latencies (us)
+    uint64_t lat_max ;			// max latency (us)
+    uint32_t hist [VS_HBUCKETS] ;	// latency histogram
+} vsstat ;
+
+typedef struct vslave
+{
+    int idx_ ;				// index in the host program
+    long int slaveid_ ;
+    l2net_154 *l2_ ;
+    Casan *ca_ ;
+    Resource *res_ [VS_NRES] ;
+    transport *tr_ ;
+
+    // frames received by the transport
+    pthread_mutex_t lock_ ;
+    vsframe inbox_ [VS_INBOX] ;
+    int ihead_ ;
+    int in_ ;
+    atomic_ulong inlost_ ;		// frames lost (inbox full)
+
+    // scheduling (see pool.c)
+    atomic_int state_ ;
+    int home_ ;				// worker owning this slave
+    atomic_ulong deadline_ ;		// next engine timer (ms)
+    struct pool *pool_ ;
+
+    vsreq inflight_ [VS_INFLIGHT] ;
+    int infnext_ ;			// next slot to reuse
+
+    // resource state
+    int led_ ;
+    unsigned long served_ ;
+
+    vsstat stat_ ;
+} vslave ;
+
+
+vslave *initVslave (int idx, uint16_t addr, long int slaveid, transport *tr, struct pool *pool);
+
+void input_vslave (void *arg, const uint8_t *frame, uint8_t len, uint8_t lqi);
+
+void run_vslave (vslave *vs);
+
+int bucket_vslave (uint64_t us);
+
+uint64_t percentile_vslave (const uint32_t *hist, double p);
+
+void add_hist_vslave (uint32_t *hist, const uint32_t *h);
+
+#endif
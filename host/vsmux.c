@@ -0,0 +1,271 @@
+/*
+ * vsmux: run several virtual CASAN slaves on a Linux host
+ *
+ * Each slave has its own address, slave-id, resources and engine.
+ * Slaves are run by a pool of worker threads, and attached to a
+ * frame transport:
+ * - loop: in-process network with an emulated master, which
+ *	associates the slaves and sends them requests at a given rate
+ * - udp: frames are bridged to a remote peer (real master, or
+ *	radio gateway), one frame per UDP datagram
+ *
+ * At the end of the run, request throughput and latency are reported
+ * for each slave and for all of them.
+ */
+
+#include <unistd.h>
+#include <time.h>
+
+#include "transport.h"
+#include "vslave.h"
+#include "pool.h"
+#include "master.h"
+
+#define	DEF_SLAVES	10
+#define	DEF_DURATION	10		// seconds
+#define	DEF_RATE	100		// requests per second (loop)
+#define	DEF_ADDR	0x0100		// address of the first slave
+#define	DEF_SLAVEID	1000		// slave-id of the first slave
+#define	MASTER_ADDR	0x0001		// emulated master (loop)
+
+static void usage (const char *prog)
+{
+    fprintf (stderr, "usage: %s [-n slaves] [-w workers] [-t loop|udp] [-u host:port]\n"
+		"\t[-l localport] [-a addr] [-i slaveid] [-r rate] [-d duration] [-q] [-v]\n"
+		"  -n: number of slaves (default %d)\n"
+		"  -w: number of worker threads (default: number of CPUs)\n"
+		"  -t: transport (default loop, with an emulated master)\n"
+		"  -u: remote peer (udp transport)\n"
+		"  -l: local UDP port (udp transport)\n"
+		"  -a: short address of the first slave, in hex (default %04x)\n"
+		"  -i: slave-id of the first slave (default %d)\n"
+		"  -r: requests per second sent by the emulated master (default %d)\n"
+		"  -d: duration of the run in seconds (default %d)\n"
+		"  -q: only report aggregate statistics\n"
+		"  -v: print library traces\n",
+		prog, DEF_SLAVES, DEF_ADDR, DEF_SLAVEID, DEF_RATE, DEF_DURATION) ;
+    exit (1) ;
+}
+
+
+static const char *status_name (slave_status s)
+{
+    switch (s)
+    {
+	case SL_COLDSTART :		return "cold" ;
+	case SL_WAITING_UNKNOWN :	return "waitu" ;
+	case SL_RUNNING :		return "run" ;
+	case SL_RENEW :			return "renew" ;
+	case SL_WAITING_KNOWN :		return "waitk" ;
+    }
+    return "?" ;
+}
+
+
+static double mean (uint64_t sum, unsigned long n)
+{
+    return n == 0 ? 0 : (double) sum / n ;
+}
+
+
+// percentile from the histogram (the bucket bound may exceed the max)
+static unsigned long pct (const uint32_t *hist, double p, uint64_t max)
+{
+    uint64_t v ;
+
+    v = percentile_vslave (hist, p) ;
+    return (unsigned long) (v > max ? max : v) ;
+}
+
+
+/******************************************************************************
+ * Report
+ */
+
+static void report (vslave **vs, int n, pool *p, transport *tr, vmaster *vm,
+			double duration, bool quiet)
+{
+    static uint32_t hist [VS_HBUCKETS] ;
+    unsigned long req, resp, lost, runs ;
+    uint64_t sum, max ;
+    int nassoc, i ;
+
+    if (! quiet)
+    {
+	fprintf (stdout, "%5s %4s %8s %5s %8s %8s %8s %8s %8s %8s %8s %6s\n",
+			"slave", "addr", "slaveid", "state", "requests",
+			"req/s", "mean-us", "p50-us", "p99-us", "max-us",
+			"lost", "runs") ;
+    }
+
+    req = resp = lost = runs = 0 ;
+    sum = max = 0 ;
+    nassoc = 0 ;
+    for (i = 0 ; i < n ; i++)
+    {
+	vsstat *st = &vs [i]->stat_ ;
+	unsigned long l ;
+
+	l = st->rx_dropped + atomic_load (&vs [i]->inlost_) ;
+	if (! quiet)
+	{
+	    fprintf (stdout, "%5d %04x %8ld %5s %8lu %8.1f %8.0f %8lu %8lu %8lu %8lu %6lu\n",
+			i, getAddr2 (vs [i]->l2_->cm_), vs [i]->slaveid_,
+			status_name (vs [i]->ca_->status_),
+			st->requests, st->responses / duration,
+			mean (st->lat_sum, st->responses),
+			pct (st->hist, 0.50, st->lat_max),
+			pct (st->hist, 0.99, st->lat_max),
+			(unsigned long) st->lat_max, l, st->runs) ;
+	}
+	req += st->requests ;
+	resp += st->responses ;
+	lost += l ;
+	runs += st->runs ;
+	sum += st->lat_sum ;
+	if (st->lat_max > max)
+	    max = st->lat_max ;
+	add_hist_vslave (hist, st->hist) ;
+	if (vs [i]->ca_->status_ == SL_RUNNING || vs [i]->ca_->status_ == SL_RENEW)
+	    nassoc++ ;
+    }
+
+    fprintf (stdout, "\n%d slaves (%d associated), %d workers, %s transport, %.1f s\n",
+			n, nassoc, p->nwk_, tr->name_, duration) ;
+    fprintf (stdout, "requests %lu, responses %lu, %.1f req/s, lost frames %lu, runs %lu\n",
+			req, resp, resp / duration, lost, runs) ;
+    fprintf (stdout, "latency (us): mean %.0f, p50 %lu, p90 %lu, p99 %lu, max %lu\n",
+			mean (sum, resp),
+			pct (hist, 0.50, max),
+			pct (hist, 0.90, max),
+			pct (hist, 0.99, max),
+			(unsigned long) max) ;
+
+    for (i = 0 ; i < p->nwk_ ; i++)
+    {
+	wkstat *ws = &p->wk_ [i].stat_ ;
+
+	fprintf (stdout, "worker %d: %d slaves, runs %lu, stolen %lu, timers %lu, busy %.1f%%\n",
+			i, p->wk_ [i].nshard_, ws->runs, ws->steals, ws->timers,
+			100.0 * ws->busy_us / (duration * 1000000)) ;
+    }
+
+    fprintf (stdout, "transport: sent %lu, delivered %lu, unknown dest %lu",
+			atomic_load (&tr->stat_.sent), atomic_load (&tr->stat_.delivered),
+			atomic_load (&tr->stat_.unknown)) ;
+    if (tr->sock_ != -1)
+	fprintf (stdout, ", received %lu, errors %lu", atomic_load (&tr->stat_.received),
+			atomic_load (&tr->stat_.errors)) ;
+    fprintf (stdout, "\n") ;
+
+    if (vm != NULL)
+    {
+	vmstat *ms = &vm->stat_ ;
+
+	fprintf (stdout, "master: hellos %lu, discovers %lu, assoc %lu, associated %d, requests %lu, responses %lu, lost %lu\n",
+			ms->hellos, ms->discovers, ms->assoc_sent, vm->nassoc_,
+			ms->requests, ms->responses, ms->lost) ;
+	fprintf (stdout, "master rtt (us): mean %.0f, p50 %lu, p99 %lu, max %lu\n",
+			mean (ms->rtt_sum, ms->responses),
+			pct (ms->hist, 0.50, ms->rtt_max),
+			pct (ms->hist, 0.99, ms->rtt_max),
+			(unsigned long) ms->rtt_max) ;
+    }
+}
+
+
+/******************************************************************************
+ * Main
+ */
+
+int main (int argc, char *argv [])
+{
+    int nslaves = DEF_SLAVES ;
+    int nworkers = 0 ;
+    const char *trname = "loop" ;
+    const char *peer = NULL ;
+    int lport = 0 ;
+    long int addr = DEF_ADDR ;
+    long int slaveid = DEF_SLAVEID ;
+    double rate = DEF_RATE ;
+    double duration = DEF_DURATION ;
+    bool quiet = false ;
+    transport *tr ;
+    pool *p ;
+    vslave **vs ;
+    vmaster *vm = NULL ;
+    struct timespec ts ;
+    uint64_t start ;
+    int c, i ;
+
+    while ((c = getopt (argc, argv, "n:w:t:u:l:a:i:r:d:qv")) != -1)
+    {
+	switch (c)
+	{
+	    case 'n' : nslaves = atoi (optarg) ; break ;
+	    case 'w' : nworkers = atoi (optarg) ; break ;
+	    case 't' : trname = optarg ; break ;
+	    case 'u' : peer = optarg ; break ;
+	    case 'l' : lport = atoi (optarg) ; break ;
+	    case 'a' : addr = strtol (optarg, NULL, 16) ; break ;
+	    case 'i' : slaveid = atol (optarg) ; break ;
+	    case 'r' : rate = atof (optarg) ; break ;
+	    case 'd' : duration = atof (optarg) ; break ;
+	    case 'q' : quiet = true ; break ;
+	    case 'v' : host_verbose = 1 ; break ;
+	    default : usage (argv [0]) ;
+	}
+    }
+    if (optind != argc || nslaves <= 0 || duration <= 0
+		|| addr <= MASTER_ADDR || addr + nslaves > TR_BCAST)
+	usage (argv [0]) ;
+    if (nworkers <= 0)
+	nworkers = (int) sysconf (_SC_NPROCESSORS_ONLN) ;
+    if (nworkers > nslaves)
+	nworkers = nslaves ;
+
+    if (strcmp (trname, "loop") == 0)
+	tr = initLoopTransport (nslaves + 1) ;
+    else if (strcmp (trname, "udp") == 0 && peer != NULL)
+	tr = initUdpTransport (nslaves, peer, lport) ;
+    else usage (argv [0]) ;
+    if (tr == NULL)
+	exit (1) ;
+
+    p = initPool (nworkers, nslaves) ;
+    vs = (vslave **) calloc (nslaves, sizeof (vslave *)) ;
+    if (p == NULL || vs == NULL)
+	exit (1) ;
+    for (i = 0 ; i < nslaves ; i++)
+    {
+	vs [i] = initVslave (i, addr + i, slaveid + i, tr, p) ;
+	if (vs [i] == NULL)
+	    exit (1) ;
+	add_pool (p, vs [i]) ;
+    }
+    if (tr->sock_ == -1)
+    {
+	vm = initVmaster (MASTER_ADDR, tr, addr, nslaves, rate) ;
+	if (vm == NULL)
+	    exit (1) ;
+    }
+
+    if (! start_transport (tr) || ! start_pool (p))
+	exit (1) ;
+    if (vm != NULL && ! start_vmaster (vm))
+	exit (1) ;
+    start = host_usec () ;
+
+    ts.tv_sec = (long int) duration ;
+    ts.tv_nsec = (long) ((duration - ts.tv_sec) * 1e9) ;
+    while (nanosleep (&ts, &ts) == -1)
+	;
+
+    if (vm != NULL)
+	stop_vmaster (vm) ;
+    stop_pool (p) ;
+    stop_transport (tr) ;
+
+    report (vs, nslaves, p, tr, vm, (host_usec () - start) / 1e6, quiet) ;
+    exit (0) ;
+}
@@ -0,0 +1,456 @@
+/**
+ * @file block.c
+ * @brief Block-wise transfers implementation
+ */
+
+#include "block.h"
+
+/*
+ * Space to reserve in the message for the Block2 option (up to 1 byte
+ * for header, 1 byte for extended delta and 3 bytes for value) and the
+ * Size2 option (1 byte for header and 2 bytes for value)
+ */
+
+#define	BLOCK_OPT_RESERVE	(5 + 3)
+
+
+/******************************************************************************
+ * Transfer states
+ */
+
+static void free_state (blockstate *bs)
+{
+    if (bs->buf_ != NULL)
+		free (bs->buf_) ;
+    bs->buf_ = NULL ;
+    bs->len_ = 0 ;
+    bs->type_ = BL_NONE ;
+}
+
+
+/*
+ * Key of a transfer: besides the token (which may be empty or reused
+ * by the peer), the Uri-Path of the request (FNV-1a hash) and the
+ * source of the last received frame
+ */
+
+static uint32_t path_hash (Msg *in)
+{
+    uint32_t h = 2166136261u ;
+    option *o ;
+    uint8_t *v ;
+    int i, len ;
+
+    reset_next_option (in) ;
+    for (o = next_option (in) ; o != NULL ; o = next_option (in))
+    {
+		if (getOptcode (o) != MO_Uri_Path)
+		    continue ;
+		v = (uint8_t *) getOptval (o, &len) ;
+		h = (h ^ (uint8_t) len) * 16777619u ;	// separates segments
+		for (i = 0 ; i < len ; i++)
+		    h = (h ^ v [i]) * 16777619u ;
+    }
+    return h ;
+}
+
+
+static addr2_t request_src (Msg *in)
+{
+    l2net_154 *l2 = in->l2_ ;
+
+    return l2->curframe_ != NULL ? l2->curframe_->srcaddr : 0 ;
+}
+
+
+static blockstate *find_state (Blocks *bl, blocktype_t type, Msg *in)
+{
+    uint32_t path = path_hash (in) ;
+    addr2_t src = request_src (in) ;
+    blockstate *bs ;
+    int i ;
+
+    for (i = 0 ; i < BLOCK_MAX ; i++)
+    {
+		bs = &bl->bs_ [i] ;
+		if (bs->type_ == type && isEqualToken (bs->tok_, *get_token_msg (in))
+				&& bs->path_ == path && bs->src_ == src)
+		    return bs ;
+    }
+    return NULL ;
+}
+
+
+/*
+ * Get a new transfer state: the state of the same transfer if it
+ * is restarted, a free slot if any, or else the transfer which will
+ * expire first
+ */
+
+static blockstate *new_state (Blocks *bl, blocktype_t type, Msg *in)
+{
+    blockstate *bs ;
+    int i ;
+
+    bs = find_state (bl, type, in) ;
+    if (bs == NULL)
+    {
+		bs = &bl->bs_ [0] ;
+		for (i = 0 ; i < BLOCK_MAX ; i++)
+		{
+		    if (bl->bs_ [i].type_ == BL_NONE)
+		    {
+				bs = &bl->bs_ [i] ;
+				break ;
+		    }
+		    if (bl->bs_ [i].expire_ < bs->expire_)
+				bs = &bl->bs_ [i] ;
+		}
+    }
+
+    free_state (bs) ;
+    bs->type_ = type ;
+    bs->tok_ = *get_token_msg (in) ;
+    bs->path_ = path_hash (in) ;
+    bs->src_ = request_src (in) ;
+    sync_time (bl->curtime_) ;
+    bs->expire_ = *bl->curtime_ + BLOCK_LIFETIME ;
+    return bs ;
+}
+
+
+Blocks *initBlocks (time_t *curtime)
+{
+	Blocks *bl = (Blocks *) malloc (sizeof (Blocks)) ;
+	int i ;
+
+	if (bl == NULL)
+		printf("Memory allocation failed\n");
+    bl->curtime_ = curtime ;
+    for (i = 0 ; i < BLOCK_MAX ; i++)
+    {
+		bl->bs_ [i].type_ = BL_NONE ;
+		bl->bs_ [i].buf_ = NULL ;
+		bl->bs_ [i].len_ = 0 ;
+    }
+    return bl ;
+}
+
+
+void freeBlocks (Blocks *bl)
+{
+    resetBlocks (bl) ;
+    free (bl) ;
+}
+
+
+void resetBlocks (Blocks *bl)
+{
+    int i ;
+
+    for (i = 0 ; i < BLOCK_MAX ; i++)
+		free_state (&bl->bs_ [i]) ;
+}
+
+
+// expire unfinished transfers
+void loopBlocks (Blocks *bl, time_t *curtime)
+{
+    int i ;
+
+    for (i = 0 ; i < BLOCK_MAX ; i++)
+		if (bl->bs_ [i].type_ != BL_NONE && bl->bs_ [i].expire_ <= *curtime)
+		    free_state (&bl->bs_ [i]) ;
+}
+
+
+/******************************************************************************
+ * Block options
+ */
+
+/**
+ * @brief Decode a Block1 or Block2 option
+ *
+ * @return true if the option is present in the message
+ */
+
+bool get_block_option (Msg *m, optcode_t c, uint32_t *num, bool *more, int *szx)
+{
+    option *o ;
+    uint v ;
+
+    o = search_option (m, c) ;
+    if (o == NULL)
+		return false ;
+
+    v = getOptvalInteger (o) ;
+    *num = v >> 4 ;
+    *more = ((v >> 3) & 0x1) != 0 ;
+    *szx = v & 0x7 ;
+    if (*szx > BLOCK_SZX_MAX)		// 7 is reserved
+		*szx = BLOCK_SZX_MAX ;
+    return true ;
+}
+
+
+/**
+ * @brief Add a Block1 or Block2 option to the message
+ */
+
+void set_block_option (Msg *m, optcode_t c, uint32_t num, bool more, int szx)
+{
+    option *o ;
+
+    o = initOptionInteger (c, (num << 4) | ((more ? 1 : 0) << 3) | szx) ;
+    push_option (m, o) ;
+    freeOption (o) ;
+}
+
+
+/**
+ * @brief Compute the largest block size which fits in the message
+ *
+ * The block size is computed from the current MTU and the space
+ * already used by the message (header, token and options, excluding
+ * the payload).
+ *
+ * @param out message to send
+ * @param maxszx largest block size exponent (e.g. requested by the peer)
+ * @return block size exponent (SZX)
+ */
+
+int block_szx (Msg *out, int maxszx)
+{
+    size_t base, maxpayld ;
+    int szx ;
+
+    base = coap_size (out, true) - get_paylen_msg (out) + BLOCK_OPT_RESERVE ;
+    maxpayld = maxpayload (out->l2_) ;
+
+    szx = maxszx ;
+    while (szx > 0 && base + BLOCK_SIZE (szx) > maxpayld)
+		szx-- ;
+    return szx ;
+}
+
+
+/******************************************************************************
+ * Block-wise transfers
+ */
+
+static void mk_answer (Msg *in, Msg *out, uint8_t code)
+{
+    set_type (out, COAP_TYPE_ACK) ;
+    set_id (out, get_id (in)) ;
+    set_token_msg (out, get_token_msg (in)) ;
+    set_code (out, code) ;
+}
+
+
+/**
+ * @brief Handle an incoming block (Block1 option) of a PUT/POST request
+ *
+ * Intermediate blocks are acknowledged with a 2.31 (Continue) code.
+ * When the last block is received, the whole payload is stored in the
+ * incoming message such that the resource handler can process it, and
+ * a Block1 option is added to the response.
+ *
+ * @param in incoming request
+ * @param out response
+ * @return BLK_NONE if this is not a block-wise request, BLK_COMPLETE
+ *	if the request is complete, BLK_ANSWERED if the response is
+ *	already built.
+ */
+
+blockres_t block1_request (Blocks *bl, Msg *in, Msg *out)
+{
+    blockstate *bs ;
+    uint32_t num ;
+    bool more ;
+    int szx ;
+    size_t off ;
+    uint16_t paylen ;
+    uint8_t *nbuf ;
+
+    if (! get_block_option (in, MO_Block1, &num, &more, &szx))
+		return BLK_NONE ;
+
+    if (num == 0)
+		bs = new_state (bl, BL_BLOCK1, in) ;	// (re)start
+    else
+		bs = find_state (bl, BL_BLOCK1, in) ;
+
+    off = num * BLOCK_SIZE (szx) ;
+    if (bs == NULL || bs->len_ != off)
+    {
+		// missing block: restart from the beginning
+		if (bs != NULL)
+		    free_state (bs) ;
+		mk_answer (in, out, COAP_CODE_INCOMPLETE) ;
+		return BLK_ANSWERED ;
+    }
+
+    paylen = get_paylen_msg (in) ;
+    if (off + paylen > BLOCK_MAXSIZE)
+    {
+		option *o ;
+
+		free_state (bs) ;
+		mk_answer (in, out, COAP_CODE_TOO_LARGE) ;
+		o = initOptionInteger (MO_Size1, BLOCK_MAXSIZE) ;
+		push_option (out, o) ;
+		freeOption (o) ;
+		return BLK_ANSWERED ;
+    }
+
+    nbuf = (uint8_t *) realloc (bs->buf_, off + paylen) ;
+    if (nbuf == NULL && off + paylen > 0)
+    {
+		printf("Memory allocation failed\n");
+		free_state (bs) ;
+		mk_answer (in, out, COAP_CODE_TOO_LARGE) ;
+		return BLK_ANSWERED ;
+    }
+    bs->buf_ = nbuf ;
+    memcpy (bs->buf_ + off, get_payload_msg (in), paylen) ;
+    bs->len_ = off + paylen ;
+    bs->expire_ = *bl->curtime_ + BLOCK_LIFETIME ;
+
+    if (more)
+    {
+		mk_answer (in, out, COAP_CODE_CONTINUE) ;
+		set_block_option (out, MO_Block1, num, true, szx) ;
+		return BLK_ANSWERED ;
+    }
+
+    // last block: give the whole payload to the resource handler
+    set_payload_msg (in, bs->buf_, bs->len_) ;
+    free_state (bs) ;
+    set_block_option (out, MO_Block1, num, false, szx) ;
+    return BLK_COMPLETE ;
+}
+
+
+/*
+ * Copy block num of a representation in the response, with the
+ * appropriate Block2 (and Size2 for the first block) options.
+ * Returns true if there are more blocks after this one.
+ */
+
+static bool put_block (Msg *out, uint8_t *buf, uint16_t len, uint32_t num, int szx)
+{
+    size_t off, size ;
+    bool more ;
+
+    size = BLOCK_SIZE (szx) ;
+    off = num * size ;
+    if (off >= len && ! (off == 0 && len == 0))
+    {
+		set_payload_msg (out, NULL, 0) ;
+		set_code (out, COAP_CODE_BAD_OPTION) ;
+		return false ;
+    }
+
+    more = off + size < len ;
+    set_payload_msg (out, buf + off, more ? size : len - off) ;
+    set_block_option (out, MO_Block2, num, more, szx) ;
+    if (num == 0)
+    {
+		option *o ;
+
+		o = initOptionInteger (MO_Size2, len) ;
+		push_option (out, o) ;
+		freeOption (o) ;
+    }
+    return more ;
+}
+
+
+/**
+ * @brief Serve a block of a previously built response
+ *
+ * If the request asks for a block (Block2 option) of a response
+ * kept from a previous exchange with the same token, Uri-Path and
+ * source, the response
+ * is built from the kept representation without calling the
+ * resource handler again.
+ *
+ * @return true if the response has been built
+ */
+
+bool block2_serve (Blocks *bl, Msg *in, Msg *out)
+{
+    blockstate *bs ;
+    uint32_t num ;
+    bool more ;
+    int szx ;
+
+    if (! get_block_option (in, MO_Block2, &num, &more, &szx) || num == 0)
+		return false ;
+
+    bs = find_state (bl, BL_BLOCK2, in) ;
+    if (bs == NULL)
+		return false ;
+
+    mk_answer (in, out, bs->code_) ;
+    if (bs->cf_ != cf_none)
+		set_content_format (out, true, bs->cf_) ;
+    szx = block_szx (out, szx) ;
+    bs->expire_ = *bl->curtime_ + BLOCK_LIFETIME ;
+    if (! put_block (out, bs->buf_, bs->len_, num, szx))
+		free_state (bs) ;		// last block has been sent
+    return true ;
+}
+
+
+/**
+ * @brief Split a response in blocks if needed
+ *
+ * If the response does not fit in a frame (or if the peer asked
+ * for a specific block), its full payload is kept in order to
+ * serve next blocks, and only the requested block is left in
+ * the response.
+ *
+ * @param in incoming request (or NULL)
+ * @param out response built by the resource handler
+ */
+
+void block2_response (Blocks *bl, Msg *in, Msg *out)
+{
+    blockstate *bs ;
+    uint32_t num ;
+    bool more, asked ;
+    int szx ;
+    uint8_t *buf ;
+    uint16_t len ;
+
+    num = 0 ;
+    szx = BLOCK_SZX_MAX ;
+    asked = in != NULL && get_block_option (in, MO_Block2, &num, &more, &szx) ;
+    if (! asked && coap_size (out, false) <= maxpayload (out->l2_))
+		return ;				// fits in a single frame
+    if ((get_code (out) >> 5) != 2)
+		return ;				// do not split errors
+
+    // copy the payload since it will be replaced by the block
+    len = get_paylen_msg (out) ;
+    buf = (uint8_t *) malloc (len > 0 ? len : 1) ;
+    if (buf == NULL)
+    {
+		printf("Memory allocation failed\n");
+		return ;
+    }
+    memcpy (buf, get_payload_msg (out), len) ;
+
+    szx = block_szx (out, szx) ;
+    if (put_block (out, buf, len, num, szx) && in != NULL)
+    {
+		// keep the representation for the next blocks
+		bs = new_state (bl, BL_BLOCK2, in) ;
+		bs->code_ = get_code (out) ;
+		bs->cf_ = get_content_format (out) ;
+		bs->buf_ = buf ;
+		bs->len_ = len ;
+    }
+    else free (buf) ;
+}
@@ -0,0 +1,89 @@
+#ifndef __BLOCK_H__
+#define __BLOCK_H__
+
+/*
+ * Block-wise transfers (RFC 7959)
+ *
+ * This class keeps the state of block-wise transfers, indexed by the
+ * token, the target (Uri-Path) and the source of the exchange, such
+ * that an empty or reused token does not mix two transfers:
+ * - Block2: a response which does not fit in a frame is kept in its
+ *	entirety, and served block by block on subsequent requests
+ * - Block1: an incoming PUT/POST payload is reassembled before the
+ *	resource handler is called
+ *
+ * Block size is adapted to the current MTU such that each block
+ * uses the available frame space as much as possible.
+ * The loop function must be called periodically in order to expire
+ * unfinished transfers.
+ */
+
+#include "msg.h"
+#include "time.h"
+
+#define	BLOCK_MAX	2		// max number of simultaneous transfers
+#define	BLOCK_MAXSIZE	1024		// max size of a reassembled request
+#define	BLOCK_LIFETIME	30000		// transfer state lifetime (ms)
+
+#define	BLOCK_SZX_MAX	6		// 1024 bytes
+#define	BLOCK_SIZE(szx)	(16 << (szx))
+
+
+typedef enum
+{
+    BL_NONE = 0,			// unused slot
+    BL_BLOCK1,				// request being reassembled
+    BL_BLOCK2,				// response being served
+} blocktype_t ;
+
+/** Return values of `block1_request` */
+typedef enum
+{
+    BLK_NONE = 0,			// not a block-wise request
+    BLK_COMPLETE,			// request payload reassembled
+    BLK_ANSWERED,			// response already built
+} blockres_t ;
+
+
+typedef struct blockstate
+{
+    blocktype_t type_ ;
+    token tok_ ;			// token of the exchange
+    uint32_t path_ ;			// hash of the request Uri-Path
+    addr2_t src_ ;			// requesting peer
+    uint8_t code_ ;			// response code (Block2)
+    content_format cf_ ;		// response content format (Block2)
+    uint8_t *buf_ ;			// full representation
+    uint16_t len_ ;
+    time_t expire_ ;
+} blockstate;
+
+
+typedef struct blocks {
+	blockstate bs_ [BLOCK_MAX] ;
+	time_t *curtime_ ;		// engine current time
+} Blocks;
+
+
+Blocks *initBlocks (time_t *curtime);
+
+void freeBlocks (Blocks *bl);
+
+void resetBlocks (Blocks *bl);
+
+void loopBlocks (Blocks *bl, time_t *curtime);
+
+bool get_block_option (Msg *m, optcode_t c, uint32_t *num, bool *more, int *szx);
+
+void set_block_option (Msg *m, optcode_t c, uint32_t num, bool more, int szx);
+
+int block_szx (Msg *out, int maxszx);
+
+blockres_t block1_request (Blocks *bl, Msg *in, Msg *out);
+
+bool block2_serve (Blocks *bl, Msg *in, Msg *out);
+
+void block2_response (Blocks *bl, Msg *in, Msg *out);
+
+
+#endif
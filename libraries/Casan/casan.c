@@ -4,6 +4,7 @@
  */
 
 #include "casan.h"
+#include "prng.h"
 
 #define	CASAN_NAMESPACE1	".well-known"
 #define	CASAN_NAMESPACE2	"casan"
@@ -12,12 +13,49 @@
 #define	CASAN_DISCOVER_MTU	"mtu=%ld"
 #define	CASAN_ASSOC_TTL		"ttl=%ld"
 #define	CASAN_ASSOC_MTU		CASAN_DISCOVER_MTU
+#define	CASAN_DISCOVER_SLEEP	"sleep=%ld"	// queue mode: wakeup period (ms)
+#define	CASAN_DISCOVER_LISTEN	"listen=%ld"	// queue mode: listen window (ms)
+#define	CASAN_AWAKE		"awake=%ld"	// awake message (listen window)
+#define	CASAN_DELTA_ADD		"res=add"
+#define	CASAN_DELTA_DEL		"res=del"
 
 #define	CASAN_BUF_LEN		50	// > sizeof hello=.../slave=..../etc
 
 
 #define CASAN_RESOURCES_ALL	"resources"
 
+/*
+ * Leisure (RFC 7252, section 8.2) used to answer broadcast requests:
+ *	leisure = S * G / R
+ * where S is the response size, G the group size and R the data rate.
+ * The rate is the 802.15.4 raw rate (31250 bytes/s) reduced to account
+ * for CSMA backoffs, MAC acknowledgements and turnaround times.
+ */
+
+#define	CASAN_LEISURE_RATE	8000	// bytes/s
+#define	CASAN_DEFAULT_GROUPSIZE	10	// # of slaves until one is heard
+#define	CASAN_DEFAULT_LEISURE	5000	// max leisure (ms), RFC 7252
+
+/*
+ * Observe: triggers are polled at CASAN_OBS_POLL interval, and an
+ * observed resource is notified at least every CASAN_OBS_PMAX even
+ * if its trigger does not fire (keepalive). Values in ms.
+ * The event-driven engine (see casan_process) never sleeps longer
+ * than CASAN_MAXSLEEP.
+ */
+
+#define	CASAN_OBS_POLL		1000
+#define	CASAN_OBS_PMAX		60000
+#define	CASAN_MAXSLEEP		3600000
+
+#define	CASAN_DEFAULT_RXBUDGET	4	// max # of frames handled by loop
+#define	CASAN_DEFAULT_TXBUDGET	4	// max # of frames sent by loop
+
+#define	CASAN_NV_MAGIC		0xca5a	// master record in NV storage
+#define	CASAN_NV_WAIT		5000	// wait for the saved master at boot
+
+#define	CASAN_STANDBY_RETRY	2000	// retry to refresh the standby assoc
+
 
 
 static struct
@@ -56,22 +94,48 @@ Casan *initCasan (l2net_154 *l2, int mtu, long int slaveid)
 		printf("Memory allocation failed\n");
     ca->l2_ = l2 ;
     ca->slaveid_ = slaveid ;
-    curtime = 0 ;			// global variable
+    ca->curtime_ = 0 ;
     ca->master_ = NULL;
 
-    sync_time (&curtime) ;
+    sync_time (&ca->curtime_) ;
     ca->defmtu_ = getMTU (l2) ;		// get default L2 MTU
     if (mtu > 0 && mtu < ca->defmtu_)
 		ca->defmtu_ = mtu ;			// set a different default MTU
     reset_master (ca) ;			// master_ is reset (broadcast addr, mtu)
     ca->hlid_ = -1 ;
-    ca->curid_ = 1 ;
-    ca->retrans_ = initRetrans();
+    prng_seed_node (&ca->prng_, l2->myaddr_, slaveid) ;
+    ca->curid_ = prng_rand (&ca->prng_) & 0xffff ;	// randomized initial message id
+    ca->retrans_ = initRetrans (l2, &ca->curtime_, &ca->prng_) ;
     master (ca->retrans_, &ca->master_) ;
+    ca->pending_ = initPending () ;
+    ca->blocks_ = initBlocks (&ca->curtime_) ;
+    ca->dedup_ = initDedup () ;
+    ca->outq_ = initOutq (l2) ;
+    outqRetrans (ca->retrans_, ca->outq_) ;
+    outqPending (ca->pending_, ca->outq_) ;
+    resetTimers (&ca->timers_) ;
+    timersRetrans (ca->retrans_, &ca->timers_) ;
+    timersPending (ca->pending_, &ca->timers_) ;
+    memset (ca->groupmap_, 0, sizeof ca->groupmap_) ;
+    ca->groupheard_ = 0 ;
+    set_leisure (ca, 0, CASAN_DEFAULT_LEISURE) ;	// estimated group size
+    set_rx_budget (ca, CASAN_DEFAULT_RXBUDGET) ;
+    set_tx_budget (ca, CASAN_DEFAULT_TXBUDGET) ;
+    ca->sleepperiod_ = 0 ;		// queue mode disabled
+    ca->listen_ = 0 ;
+    ca->awake_ = true ;
+    ca->radiosince_ = ca->curtime_ ;
+    ca->ackwait_ = 0 ;
+    ca->nv_ = NULL ;
+    memset (&ca->nvlast_, 0, sizeof ca->nvlast_) ;
+    memset (ca->masters_, 0, sizeof ca->masters_) ;
+    ca->standby_ = -1 ;
+    ca->renewtries_ = 0 ;
     ca->status_ = SL_COLDSTART ;
 
     ca->reslist_ = NULL;
-    
+    ca->catver_ = catalog_version (ca) ;
+    memset (&ca->stat_, 0, sizeof ca->stat_) ;
 
     return ca;
 }
@@ -90,7 +154,7 @@ Casan *initCasan (l2net_154 *l2, int mtu, long int slaveid)
 void resetCasan (Casan *ca)
 {
     ca->status_ = SL_COLDSTART ;
-    ca->curid_ = 1 ;
+    ca->curid_ = prng_rand (&ca->prng_) & 0xffff ;
 
     // remove resources from the list
     while (ca->reslist_ != NULL)
@@ -103,6 +167,19 @@ void resetCasan (Casan *ca)
     }
 
     resetRetrans (ca->retrans_) ;
+    resetPending (ca->pending_) ;
+    resetBlocks (ca->blocks_) ;
+    resetDedup (ca->dedup_) ;
+    resetOutq (ca->outq_) ;
+    stopTimer (&ca->timers_, TM_DISCOVER) ;
+    stopTimer (&ca->timers_, TM_EXPIRE) ;
+    stopTimer (&ca->timers_, TM_OBSERVE) ;
+    stopTimer (&ca->timers_, TM_SLEEP) ;
+    stopTimer (&ca->timers_, TM_STANDBY) ;
+    set_radio (ca->l2_, true) ;
+    ca->awake_ = true ;
+    memset (ca->masters_, 0, sizeof ca->masters_) ;
+    ca->standby_ = -1 ;
     reset_master (ca) ;
 }
 
@@ -159,10 +236,16 @@ Master handling
 
 void reset_master (Casan *ca)
 {	
-    if (ca->master_ != NULL)
-		freel2addr_154(ca->master_) ; 
+    l2addr_154 *old = ca->master_ ;
 
     ca->master_ = NULL ;
+    if (old != NULL)
+    {
+		// CON messages to other destinations are kept
+		cancelRetrans (ca->retrans_, old) ;
+		freel2addr_154 (old) ;
+    }
+
     ca->hlid_ = -1 ;
     reset_mtu (ca) ;			// reset MTU to default
     printf ("Master reset to broadcast address and default MTU\n") ;
@@ -225,6 +308,195 @@ void change_master (Casan *ca, long int hlid, int mtu)
 }
 
 
+/**
+ * @brief Keep track of a master heard on the L2 network
+ *
+ * The entry of the master is created if needed, replacing the least
+ * recently heard master (but neither the current master nor the
+ * standby one). It is updated with the time and link quality of
+ * the current received frame. A new hello-id means that the master
+ * has restarted: its association with this slave is lost.
+ *
+ * @param a master address (source of the current received frame)
+ * @param hlid hello-id, or -1 if not given in the current frame
+ * @return entry of the master, or NULL if the table is full
+ */
+
+casanmaster *track_master (Casan *ca, l2addr_154 *a, long int hlid)
+{
+    casanmaster *m, *victim ;
+    int i ;
+
+    m = victim = NULL ;
+    for (i = 0 ; i < CASAN_MAXMASTERS && m == NULL ; i++)
+    {
+		casanmaster *e = &ca->masters_ [i] ;
+
+		if (e->used && isEqualAddr (&e->addr, a))
+		    m = e ;
+		else if (i == ca->standby_ || (e->used && same_master (ca, &e->addr)))
+		    continue ;
+		else if (victim == NULL
+			|| (victim->used && (! e->used || e->lastseen < victim->lastseen)))
+		    victim = e ;
+    }
+
+    if (m == NULL)
+    {
+		if (victim == NULL)
+		    return NULL ;
+		m = victim ;
+		memset (m, 0, sizeof *m) ;
+		m->used = true ;
+		m->addr = *a ;
+		m->hlid = -1 ;
+		m->lq = get_lqi (ca->l2_) ;
+    }
+    else
+		m->lq = (3 * m->lq + get_lqi (ca->l2_)) / 4 ;
+
+    if (hlid != -1)
+    {
+		if (m->hlid != -1 && m->hlid != hlid)
+		{
+		    m->sttl = 0 ;		// association lost
+		    if (m - ca->masters_ == ca->standby_)
+				ca->standby_ = -1 ;
+		}
+		m->hlid = hlid ;
+    }
+    m->lastseen = ca->curtime_ ;
+    return m ;
+}
+
+
+/**
+ * @brief Return the standby master
+ *
+ * @return entry of the standby master, or NULL if there is no
+ *	standby master or if its association has expired
+ */
+
+casanmaster *get_standby (Casan *ca)
+{
+    casanmaster *m ;
+
+    if (ca->standby_ == -1)
+		return NULL ;
+    m = &ca->masters_ [ca->standby_] ;
+    if (m->sttl == 0 || ca->curtime_ >= m->assoctime + m->sttl)
+		return NULL ;
+    return m ;
+}
+
+
+
+/******************************************************************************
+Master persistence
+******************************************************************************/
+
+/**
+ * @brief Set the non-volatile store used to remember the master
+ *
+ * This method must be called before the first call to `loop`, such
+ * that the saved master is used at boot.
+ *
+ * @param nv store (see nvstore.h), or NULL for none
+ */
+
+void set_nvstore (Casan *ca, NvStore *nv)
+{
+    ca->nv_ = nv ;
+}
+
+
+static uint16_t nv_sum (CasanNv *r)
+{
+    uint8_t *p = (uint8_t *) r ;
+    uint16_t sum ;
+    size_t i ;
+
+    sum = 0 ;
+    for (i = 0 ; i < offsetof (CasanNv, sum) ; i++)
+		sum = (sum << 1 | sum >> 15) + p [i] ;
+    return sum ;
+}
+
+
+/**
+ * @brief Save the current master in the non-volatile store
+ *
+ * The record is written only if it has changed, in order to
+ * spare the flash memory: a renewal with the same master does
+ * not write anything.
+ *
+ * @return true if the record is in the store
+ */
+
+bool save_master (Casan *ca)
+{
+    CasanNv r ;
+
+    if (ca->nv_ == NULL || ca->master_ == NULL)
+		return false ;
+
+    memset (&r, 0, sizeof r) ;		// no garbage in padding
+    r.magic = CASAN_NV_MAGIC ;
+    r.master = ca->master_->addr_ ;
+    r.hlid = ca->hlid_ ;
+    r.mtu = ca->curmtu_ ;
+    r.sttl = ca->sttl_ ;
+    r.sum = nv_sum (&r) ;
+
+    if (memcmp (&r, &ca->nvlast_, sizeof r) == 0)
+		return true ;
+    if (! writeNvStore (ca->nv_, &r, sizeof r))
+    {
+		printf ("%s", RED ("Cannot save the master\n")) ;
+		return false ;
+    }
+    ca->nvlast_ = r ;
+    ca->stat_.nv_saved++ ;
+    return true ;
+}
+
+
+/**
+ * @brief Restore the master saved in the non-volatile store
+ *
+ * Master address, hello-id, MTU and slave TTL are set from the
+ * saved record, if any.
+ *
+ * @return true if a valid record has been found
+ */
+
+bool restore_master (Casan *ca)
+{
+    CasanNv r ;
+    l2addr_154 a ;
+
+    if (ca->nv_ == NULL || ! readNvStore (ca->nv_, &r, sizeof r))
+		return false ;
+    if (r.magic != CASAN_NV_MAGIC || r.sum != nv_sum (&r))
+		return false ;
+
+    if (ca->master_ != NULL)
+		freel2addr_154 (ca->master_) ;
+    a.addr_ = r.master ;
+    ca->master_ = init_l2addr_154_addr (&a) ;
+    ca->hlid_ = r.hlid ;
+    ca->sttl_ = r.sttl ;
+    negociate_mtu (ca, r.mtu) ;
+    ca->nvlast_ = r ;
+    ca->stat_.nv_restored++ ;
+
+    printf ("Master restored: ") ;
+    printAddr (ca->master_) ;
+    printf (", helloid= %ld, mtu= %d\n", (long int) ca->hlid_, ca->curmtu_) ;
+    return true ;
+}
+
+
 
 /******************************************************************************
 Resource handling
@@ -236,11 +508,10 @@ Resource handling
  * This method is used to register a resource with the CASAN engine.
  * This resource will then be advertised with the `/.well-known/casan`
  * resource during the next association or with a specific request
- * from the master. Thus, registering a resource after an association
- * (when the slave returns an association answer containing the
- * `/.well-known/casan`) will not provoke a new association. One must
- * wait the next association renewal for the resource to be published
- * and thus known by the master.
+ * from the master. If the slave is already associated, the new
+ * resource is immediately pushed to the master (see
+ * `send_catalog_delta`) such that it does not have to wait for the
+ * next association renewal.
  *
  * @param res Address of the resource to register
  */
@@ -248,6 +519,7 @@ Resource handling
 void register_resource (Casan *ca, Resource *res)
 {
     reslist *newr, *prev, *cur ;
+    uint32_t oldver ;
 
     /*
      * Register resource in last position of the list to respect
@@ -267,6 +539,50 @@ void register_resource (Casan *ca, Resource *res)
     else
 		ca->reslist_ = newr ;
     newr->next = NULL ;
+
+    oldver = ca->catver_ ;
+    ca->catver_ = catalog_version (ca) ;
+    send_catalog_delta (ca, res, true, oldver) ;
+}
+
+
+/**
+ * @brief Unregister a resource from the CASAN engine
+ *
+ * The resource is removed from the `/.well-known/casan` list and,
+ * if the slave is associated, the removal is pushed to the master.
+ * The resource itself is not freed.
+ *
+ * @param res Address of the resource to unregister
+ */
+
+void unregister_resource (Casan *ca, Resource *res)
+{
+    reslist *prev, *cur ;
+    uint32_t oldver ;
+
+    prev = NULL ;
+    for (cur = ca->reslist_ ; cur != NULL ; cur = cur->next)
+    {
+		if (cur->res == res)
+		    break ;
+		prev = cur ;
+    }
+    if (cur == NULL)
+		return ;
+
+    if (prev != NULL)
+		prev->next = cur->next ;
+    else
+		ca->reslist_ = cur->next ;
+    free (cur) ;
+
+    if (res->observed_)
+		observedResource (res, false, NULL) ;
+
+    oldver = ca->catver_ ;
+    ca->catver_ = catalog_version (ca) ;
+    send_catalog_delta (ca, res, false, oldver) ;
 }
 
 
@@ -274,11 +590,14 @@ void register_resource (Casan *ca, Resource *res)
  * @brief Process an incoming message requesting for a resource
  *
  * This methods:
+ * * handle block-wise transfers (reassemble a request, or serve the
+ *	next block of a kept response)
  * * analyze uri_path option to find the resource
  * * either give answer if this is the /resources URI
  * * or call the handler for user-defined resources
  * * or return 4.04 code
- * * pack the answer in the outgoing message
+ * * pack the answer in the outgoing message, splitting it in blocks
+ *	if it does not fit in a frame
  *
  * This method is made public for testing purpose.
  *
@@ -293,6 +612,11 @@ void process_request (Casan *ca, Msg *in, Msg *out)
     option *o ;
     bool rfound = false ;		// resource found
 
+    if (block1_request (ca->blocks_, in, out) == BLK_ANSWERED)
+	return ;
+    if (block2_serve (ca->blocks_, in, out))
+	return ;
+
     reset_next_option (in) ;
     for (o = next_option (in) ; o != NULL ; o = next_option (in))
     {
@@ -328,7 +652,11 @@ void process_request (Casan *ca, Msg *in, Msg *out)
 						obsval = getOptvalInteger (obs) ;
 
 				    if (obs != NULL && obsval == 0)
+				    {
 						observedResource (res, true, in) ;
+						res->obs_last_ = TICKS (ca->curtime_) ;
+						setTimer (&ca->timers_, TM_OBSERVE, TICKS (ca->curtime_)) ;
+				    }
 				    else
 						observedResource (res, false, NULL) ;
 
@@ -359,6 +687,8 @@ void process_request (Casan *ca, Msg *in, Msg *out)
 		set_token_msg (out, get_token_msg (in)) ;
 		set_code (out, COAP_CODE_NOT_FOUND) ;
     }
+
+    block2_response (ca->blocks_, in, out) ;
 }
 
 
@@ -381,10 +711,11 @@ void request_resource (Msg *pin, Msg *pout, Resource *res)
     handler_res_t h ;
     uint8_t code ;
 
-    h = getHandlerResource (res, (coap_code_t) get_code (pin)) ;
+    // observe notifications (pin == NULL) are built by the GET handler
+    h = getHandlerResource (res, pin != NULL ? (coap_code_t) get_code (pin) : COAP_CODE_GET) ;
     if (h == NULL)
     {
-		code = COAP_CODE_BAD_REQUEST ;
+		code = COAP_CODE_NOT_ALLOWED ;	// method not supported (RFC 8132)
     }
     else
     {
@@ -397,152 +728,1114 @@ void request_resource (Msg *pin, Msg *pout, Resource *res)
 
 
 /**
- * Check all observed resources in order to detect changes and
- * send appropriate observe message.
+ * @brief Check the No-Response option of a request
  *
- * @param out an output message
+ * The requester may indicate (with the No-Response option, RFC 7967)
+ * that it is not interested in some classes of responses. This is
+ * typically the case for fire-and-forget requests broadcast by
+ * the master to all slaves.
+ *
+ * @param in incoming request
+ * @param code response code
+ * @return true if the response must not be sent
  */
 
-void check_observed_resources (Casan *ca, Msg *out)
+bool is_response_suppressed (Msg *in, uint8_t code)
 {
-    Resource *res ;
-    reslist *rl ;
+    option *o ;
+    uint nr ;
+    bool suppressed = false ;
 
-    for (rl = ca->reslist_ ; rl != NULL ; rl = rl->next)
+    o = search_option (in, MO_No_Response) ;
+    if (o != NULL)
     {
-		res = rl->res ;
-		if (check_trigger (res))
-		{
-		    resetMsg (out) ;
+	nr = getOptvalInteger (o) ;
+	switch (code >> 5)		// response class
+	{
+	    case 2 :
+		suppressed = (nr & NR_SUPPRESS_2XX) != 0 ;
+		break ;
+	    case 4 :
+		suppressed = (nr & NR_SUPPRESS_4XX) != 0 ;
+		break ;
+	    case 5 :
+		suppressed = (nr & NR_SUPPRESS_5XX) != 0 ;
+		break ;
+	    default :
+		break ;
+	}
+    }
+    return suppressed ;
+}
 
-		    set_type (out, COAP_TYPE_ACK) ;
-		    set_token_msg (out, get_token (res)) ;
 
-		    option *obs = initOptionInteger(MO_Observe, next_serial (res)) ;
-		    push_option (out, obs) ;
+/*
+ * Group size estimated from the number b of bits set in the linear
+ * counting bitmap (m bits, see `group_heard`):
+ *	n = -m ln (1 - b/m) ~ b + b^2 / 2m
+ * plus this slave.
+ */
 
-		    request_resource (NULL, out, res) ;
-		}
-    }
+static int group_estimate (Casan *ca)
+{
+    int b = ca->groupheard_ ;
+
+    if (b == 0)
+		return CASAN_DEFAULT_GROUPSIZE ;
+    return 1 + b + (b * b) / (2 * CASAN_GROUPMAP_BITS) ;
 }
 
 
+/**
+ * @brief Set parameters used to delay responses to broadcast requests
+ *
+ * By default, the group size is estimated from the slaves heard
+ * sending Discover messages (see `group_heard`), and is
+ * CASAN_DEFAULT_GROUPSIZE until another slave is heard.
+ *
+ * @param groupsize number of slaves which will answer a broadcast
+ *	request, or 0 to estimate it
+ * @param maxleisure upper bound of the delay (in ms)
+ */
 
-bool get_well_known (Casan *ca, Msg *out) 
+void set_leisure (Casan *ca, int groupsize, time_t maxleisure)
 {
-    char *buf ;
-    size_t size ;
-    reslist *rl ;
-    size_t avail ;
-    bool reset ;
+    ca->groupfixed_ = groupsize > 0 ;
+    ca->groupsize_ = ca->groupfixed_ ? groupsize : group_estimate (ca) ;
+    ca->maxleisure_ = maxleisure ;
+}
 
-    reset = false ;
-    set_content_format (out, reset, cf_text_plain) ;
-    //printMsg(out );
-    avail = avail_space (out) ;	
-    buf = (char *) malloc (avail) ;
 
-    size = 0 ;
-    for (rl = ca->reslist_ ; rl != NULL ; rl = rl->next) 
-    {
-		int len ;
+/**
+ * @brief Count a slave heard sending a Discover message
+ *
+ * Slaves are counted with a linear counting bitmap: each address is
+ * hashed to one bit, such that only CASAN_GROUPMAP_BITS / 8 bytes
+ * are needed, whatever the number of slaves. The group size used
+ * for the leisure is updated, unless it has been given to
+ * `set_leisure`.
+ *
+ * @param src address of the slave
+ */
 
-		if (size > 0)			// separator "," between resources
-		{
-		    if (size + 2 < avail)
-		    {
-				buf [size++] = ',' ;
-				buf [size] = '\0' ;
-		    }
-		    else break ;		// too large
-		}
+void group_heard (Casan *ca, l2addr_154 *src)
+{
+    int h ;
+    uint32_t bit ;
+
+    // multiplicative hash of the 16-bit address: 8 upper bits
+    h = (uint16_t) (src->addr_ * 40503u) >> (16 - 8) ;
+    bit = (uint32_t) 1 << (h & 31) ;
+    if (ca->groupmap_ [h >> 5] & bit)
+		return ;
+    ca->groupmap_ [h >> 5] |= bit ;
+    ca->groupheard_++ ;
+    if (! ca->groupfixed_)
+		ca->groupsize_ = group_estimate (ca) ;
+}
 
-		len = well_known (rl->res, buf + size, avail - size) ;
-		if (len == -1)
-		    break ;
 
-		size += len - 1 ;		// exclude '\0'
-    }
+/**
+ * @brief Set the maximum number of received frames processed by
+ *	each call to `loop`
+ *
+ * @param budget number of frames (at least 1)
+ */
 
-    set_payload_msg (out, (uint8_t *) buf, size) ;
-    free (buf) ;
+void set_rx_budget (Casan *ca, int budget)
+{
+    ca->rxbudget_ = budget > 0 ? budget : 1 ;
+}
 
 
-    /*
-     * Did all resources fitted in the message, or do we left the loop
-     * before its term?
-     */
+/**
+ * @brief Set the maximum number of queued frames sent by each call
+ *	to `loop`
+ *
+ * @param budget number of frames (at least 1)
+ */
+
+void set_tx_budget (Casan *ca, int budget)
+{
+    ca->txbudget_ = budget > 0 ? budget : 1 ;
+}
+
+
+/**
+ * @brief Set the queue mode (sleepy node)
+ *
+ * In queue mode, the radio of an associated slave is switched off,
+ * except during a listen window after each periodic wakeup. When it
+ * wakes up, the slave sends an "awake" message to the master, which
+ * may then send the requests it has queued for this slave. The mode
+ * is announced to the master in Discover messages.
+ *
+ * The radio is always on while the slave is not associated, while it
+ * renews its association, and while frames are waiting to be sent.
+ * The listen window is extended while CON messages sent by the slave
+ * wait for their ACK, for at most CASAN_ACKWAIT_MAX.
+ *
+ * @param period wakeup period (ms), or 0 to keep the radio always on
+ * @param listen listen window (ms), smaller than period
+ */
 
-    if (rl != NULL)
+void set_queue_mode (Casan *ca, time_t period, time_t listen)
+{
+    if (listen > period)
+		listen = period ;
+    ca->sleepperiod_ = period ;
+    ca->listen_ = listen ;
+    ca->ackwait_ = 0 ;
+    if (period == 0)
     {
-		printf ("%s",B_RED "Resource '") ;
-		printf ("%s",get_name (rl->res)) ;
-		printf ("' do not fit in buffer of %d", avail) ;
-		printf (" bytes %s\n", C_RESET) ;
+		stopTimer (&ca->timers_, TM_SLEEP) ;
+		set_radio (ca->l2_, true) ;
+		ca->awake_ = true ;
     }
+    else if (ca->status_ == SL_RUNNING && ca->awake_)	// start a listen window
+		setTimer (&ca->timers_, TM_SLEEP, TICKS (ca->curtime_ + listen)) ;
+}
+
+
+/*
+ * Encode a message and give it to the outbound queue
+ */
 
-    return rl == NULL ;			// true if all res are in the message
+static bool queue_msg (Casan *ca, oqclass_t cls, Msg *m, l2addr_154 *dest)
+{
+    if (! encodeMsg (m))
+		return false ;
+    return addOutq (ca->outq_, cls, dest, m->encoded_, m->enclen_) ;
 }
 
 
 /**
- * Find a particular resource by its name
+ * @brief Compute the leisure for a response to a broadcast request
+ *
+ * The leisure is the time window needed to let all slaves of the
+ * group send a response of the same size.
+ *
+ * @param out encoded response
+ * @return leisure in ms
  */
 
-Resource *get_resource (Casan *ca, const char *name)
+time_t get_leisure (Casan *ca, Msg *out)
 {
-    reslist *rl ;
+    time_t leisure ;
 
-    for (rl = ca->reslist_ ; rl != NULL ; rl = rl->next)
-    	if (strcmp (name, get_name (rl->res)) == 0)
-			break ;
-    return rl != NULL ? rl->res : NULL ;
+    leisure = ((time_t) out->enclen_ * ca->groupsize_ * 1000) / CASAN_LEISURE_RATE ;
+    if (leisure > ca->maxleisure_)
+	leisure = ca->maxleisure_ ;
+    return leisure ;
 }
 
 
+/**
+ * @brief Send the response to a request
+ *
+ * The response is not encoded nor sent if the requester asked
+ * for its suppression. In this case, a CON request is nevertheless
+ * acknowledged with an empty ACK, as required by CoAP.
+ *
+ * If the request has been received on the broadcast address, the
+ * response is delayed by a random time in the leisure window, in
+ * order to avoid collisions with responses from other slaves.
+ *
+ * The response goes to the sender of the request, which may be
+ * a standby master and not the current one.
+ *
+ * @param in incoming request
+ * @param out response built by `process_request`
+ * @param dest source address of the request
+ */
+
+void send_response (Casan *ca, Msg *in, Msg *out, l2addr_154 *dest)
+{
+    if (is_response_suppressed (in, get_code (out)))
+    {
+	ca->stat_.resp_suppressed++ ;
+	if (get_type (in) != COAP_TYPE_CON)
+	    return ;
+
+	resetMsg (out) ;
+	set_type (out, COAP_TYPE_ACK) ;
+	set_code (out, COAP_CODE_EMPTY) ;
+	set_id (out, get_id (in)) ;
+	resetToken (get_token_msg (out)) ;
+    }
+
+    if (is_bcast_dst (ca->l2_) && encodeMsg (out))
+    {
+	time_t delay ;
+
+	delay = prng_range (&ca->prng_, 0, get_leisure (ca, out)) ;
+	if (addPending (ca->pending_, out, dest, ca->curtime_ + delay))
+	{
+	    ca->stat_.resp_delayed++ ;
+	    return ;
+	}
+    }
+    if (! queue_msg (ca, OQ_RESPONSE, out, dest))
+	printf ("%s", RED ("Cannot queue the response\n")) ;
+}
 
-/******************************************************************************
-Main CASAN loop
-******************************************************************************/
 
 /**
- * @brief Main CASAN loop
+ * @brief Answer a duplicate request from the deduplication cache
  *
- * This method must be called regularly (typically in the loop function
- * of the Arduino framework) in order to process CASAN events.
+ * If the request (source address, message id) has already been
+ * processed during the exchange lifetime, the response sent at
+ * this time is sent again, without calling the resource handler.
+ * A duplicate without response (suppressed) is silently ignored.
+ *
+ * Only CON and NON requests are deduplicated: the id of an ACK or
+ * RST comes from our own id space, not from the requester's one.
+ *
+ * @param in received request
+ * @param src source address of the request
+ * @return true if the request is a duplicate
  */
 
-void loop (Casan *ca)
+bool deduplicate (Casan *ca, Msg *in, l2addr_154 *src)
 {
-	
-    Msg *in = initMsg(ca->l2_) ;
-    Msg *out = initMsg(ca->l2_) ;
-    l2_recv_t ret ;
-    uint8_t oldstatus ;
-    long int hlid = 0;
-    l2addr_154 *srcaddr ;
-    int mtu ;				// mtu announced by master in assoc msg
+    dedupent *de ;
 
-    oldstatus = ca->status_ ;		// keep old value for debug display
-    sync_time (&curtime) ;		// get current time
-    loopRetrans (ca->retrans_, ca->l2_, &curtime) ;	// check needed retransmissions
+    if (! is_request (in))
+	return false ;
+    de = getDedup (ca->dedup_, src, get_id (in)) ;
+    if (de == NULL)
+	return false ;
 
-    srcaddr = NULL ;
+    if (de->frame != NULL)
+    {
+	ca->stat_.dup_replayed++ ;
+	if (! addOutq (ca->outq_, OQ_RESPONSE, src, de->frame, de->len))
+	    printf ("%s", RED ("Cannot queue the cached response\n")) ;
+    }
+    else ca->stat_.dup_dropped++ ;
+    return true ;
+}
 
-    ret = recvMsg (in) ;			// get received message
-    if (ret == RECV_OK)
-		srcaddr = get_src (ca->l2_) ;	// get a new address
 
-    switch (ca->status_)
+/**
+ * @brief Send a CON message reliably
+ *
+ * The message gets a new message id and is sent as a CON message.
+ * It is then retransmitted (see the Retrans class) until it is
+ * acknowledged by the destination. At most NSTART messages may be
+ * outstanding for a destination: others wait in a bounded queue.
+ *
+ * The encoded frame is kept by the CASAN engine, such that the
+ * message still belongs to the caller, who may reset or free it as
+ * soon as this function returns.
+ *
+ * @param m message to send
+ * @param dest destination address, or NULL for the current master
+ * @param cb callback called on ACK (with the piggybacked response,
+ *	if any), RST or timeout, with the RTT (may be NULL)
+ * @param arg argument given to the callback
+ * @return CON_SENT or CON_QUEUED if the message has been accepted,
+ *	CON_FULL if the queue is full (the application should try
+ *	later), CON_ERROR if there is no destination or if the message
+ *	cannot be encoded
+ */
+
+constatus_t send_confirmable (Casan *ca, Msg *m, l2addr_154 *dest, con_cb_t cb, void *arg)
+{
+    if (dest == NULL && ca->master_ == NULL)
+	return CON_ERROR ;
+    // a message sent again (e.g. after CON_FULL) must be re-encoded
+    // with its new id: encodeMsg keeps an existing encoding
+    if (m->encoded_ != NULL)
     {
-	case SL_COLDSTART :
-	    send_discover (ca, out) ;
-	    ca->twait_ = initTwait (&curtime) ;
-	    ca->status_ = SL_WAITING_UNKNOWN ;
-	    break ;
+		free (m->encoded_) ;
+		m->encoded_ = NULL ;
+    }
+    set_type (m, COAP_TYPE_CON) ;
+    set_id (m, ca->curid_++) ;
+    return sendConRetrans (ca->retrans_, m, dest, cb, arg) ;
+}
 
-	case SL_WAITING_UNKNOWN :
-	    if (ret == RECV_OK)
+
+/**
+ * @brief Send an observe notification for a resource
+ *
+ * The notification is sent as a CON message to the master. At most
+ * NSTART notifications may be outstanding: others wait in a bounded
+ * queue. If this queue is full, the notification is not sent and
+ * the application should retry later.
+ *
+ * @param res observed resource whose state has changed
+ * @return CON_SENT or CON_QUEUED if the notification has been
+ *	accepted, CON_FULL if the application must retry later,
+ *	CON_ERROR if the resource is not observed or if the slave
+ *	is not associated
+ */
+
+constatus_t notify_resource (Casan *ca, Resource *res)
+{
+    Msg *m ;
+    option *obs ;
+    constatus_t r ;
+
+    if ((ca->status_ != SL_RUNNING && ca->status_ != SL_RENEW)
+		|| ! get_observed (res))
+	return CON_ERROR ;
+    if (fullRetrans (ca->retrans_))
+    {
+	ca->stat_.notif_rejected++ ;
+	return CON_FULL ;
+    }
+
+    m = initMsg (ca->l2_) ;
+    set_token_msg (m, get_token (res)) ;
+    obs = initOptionInteger (MO_Observe, next_serial (res)) ;
+    push_option (m, obs) ;
+    freeOption (obs) ;
+    request_resource (NULL, m, res) ;
+
+    r = send_confirmable (ca, m, NULL, NULL, NULL) ;
+    switch (r)
+    {
+	case CON_SENT :
+	    ca->stat_.notif_sent++ ;
+	    res->obs_last_ = TICKS (ca->curtime_) ;
+	    break ;
+	case CON_QUEUED :
+	    ca->stat_.notif_queued++ ;
+	    res->obs_last_ = TICKS (ca->curtime_) ;
+	    break ;
+	default :
+	    ca->stat_.notif_rejected++ ;
+	    break ;
+    }
+    freeMsg (m) ;
+    return r ;
+}
+
+
+/**
+ * Check all observed resources in order to detect changes and
+ * send appropriate observe message. A resource whose last
+ * notification is older than CASAN_OBS_PMAX is notified anyway.
+ *
+ * Triggers are not checked while the notification queue is full,
+ * such that a pending change is detected again later.
+ *
+ * The next check is registered as the TM_OBSERVE timer.
+ *
+ * @param out an output message (unused)
+ */
+
+void check_observed_resources (Casan *ca, Msg *out)
+{
+    Resource *res ;
+    reslist *rl ;
+
+    stopTimer (&ca->timers_, TM_OBSERVE) ;
+    for (rl = ca->reslist_ ; rl != NULL ; rl = rl->next)
+    {
+		res = rl->res ;
+		if (! get_observed (res))
+		    continue ;
+		setTimer (&ca->timers_, TM_OBSERVE, TICKS (ca->curtime_) + CASAN_OBS_POLL) ;
+		if (fullRetrans (ca->retrans_))
+		    break ;
+		if (check_trigger (res)
+			|| TICK_REACHED (TICKS (ca->curtime_), res->obs_last_ + CASAN_OBS_PMAX))
+		    (void) notify_resource (ca, res) ;
+    }
+}
+
+
+
+/**
+ * @brief Render the `/.well-known/casan` list of all resources
+ *
+ * @param len address of the length of the rendered list (without '\0')
+ * @return newly allocated string (to free after use) or NULL
+ */
+
+char *render_well_known (Casan *ca, size_t *len)
+{
+    char *buf ;
+    size_t size, total ;
+    reslist *rl ;
+
+    // compute the needed space, including separators and final '\0'
+    total = 1 ;
+    for (rl = ca->reslist_ ; rl != NULL ; rl = rl->next) 
+	total += well_known (rl->res, NULL, 0) ;
+
+    buf = (char *) malloc (total) ;
+    if (buf == NULL)
+    {
+	printf("Memory allocation failed\n");
+	return NULL ;
+    }
+
+    size = 0 ;
+    buf [0] = '\0' ;
+    for (rl = ca->reslist_ ; rl != NULL ; rl = rl->next) 
+    {
+	int l ;
+
+	if (size > 0)			// separator "," between resources
+	    buf [size++] = ',' ;
+
+	l = well_known (rl->res, buf + size, total - size) ;
+	if (l == -1)
+	    break ;
+
+	size += l - 1 ;		// exclude '\0'
+    }
+
+    *len = size ;
+    return buf ;
+}
+
+
+/**
+ * @brief Build the `/.well-known/casan` payload
+ *
+ * All registered resources are listed in the payload. If the list
+ * does not fit in a frame, it will be sent with a block-wise
+ * transfer (see `block2_response`). The catalog version is given
+ * in an ETag option.
+ *
+ * @param out message to fill
+ * @return true if all resources are in the message
+ */
+
+bool get_well_known (Casan *ca, Msg *out) 
+{
+    char *buf ;
+    size_t size ;
+    bool reset ;
+
+    reset = false ;
+    set_content_format (out, reset, cf_text_plain) ;
+    push_catalog_etag (out, MO_Etag, ca->catver_) ;
+
+    buf = render_well_known (ca, &size) ;
+    if (buf == NULL)
+	return false ;
+
+    set_payload_msg (out, (uint8_t *) buf, size) ;
+    free (buf) ;
+
+    return true ;
+}
+
+
+/******************************************************************************
+Resource catalog versioning
+******************************************************************************/
+
+/**
+ * @brief Compute the resource catalog version
+ *
+ * The version is a hash (32 bits FNV-1a) of the `/.well-known/casan`
+ * list. It is sent in an ETag option with the list, such that the
+ * master can give it back in its Assoc messages: if the catalog has
+ * not changed, the assoc answer only contains the version.
+ *
+ * @return catalog version
+ */
+
+uint32_t catalog_version (Casan *ca)
+{
+    char *buf ;
+    size_t len, i ;
+    uint32_t h ;
+
+    h = 2166136261UL ;			// FNV offset basis
+    buf = render_well_known (ca, &len) ;
+    if (buf != NULL)
+    {
+	for (i = 0 ; i < len ; i++)
+	{
+	    h ^= (uint8_t) buf [i] ;
+	    h *= 16777619UL ;		// FNV prime
+	}
+	free (buf) ;
+    }
+    return h ;
+}
+
+
+/*
+ * Add an ETag-like option (ETag or If-Match) with a catalog version
+ */
+
+void push_catalog_etag (Msg *m, optcode_t c, uint32_t ver)
+{
+    uint8_t val [4] ;
+    option *o ;
+
+    val [0] = (ver >> 24) & 0xff ;
+    val [1] = (ver >> 16) & 0xff ;
+    val [2] = (ver >>  8) & 0xff ;
+    val [3] = (ver      ) & 0xff ;
+    o = initOptionOpaque (c, val, sizeof val) ;
+    push_option (m, o) ;
+    freeOption (o) ;
+}
+
+
+/*
+ * Does the message carry the given catalog version in an ETag option?
+ */
+
+bool is_catalog_etag (Msg *m, uint32_t ver)
+{
+    option *o ;
+    uint8_t *val ;
+    int len ;
+
+    o = search_option (m, MO_Etag) ;
+    if (o == NULL)
+	return false ;
+    val = (uint8_t *) getOptval (o, &len) ;
+    return len == 4
+	    && val [0] == ((ver >> 24) & 0xff)
+	    && val [1] == ((ver >> 16) & 0xff)
+	    && val [2] == ((ver >>  8) & 0xff)
+	    && val [3] == ((ver      ) & 0xff) ;
+}
+
+
+/**
+ * @brief Push a catalog change to the master
+ *
+ * When a resource is registered or unregistered while the slave is
+ * associated, a CON POST message is sent to the master on the
+ * `/.well-known/casan` control resource:
+ * * Uri-Query `res=add` with the resource description as payload
+ * * Uri-Query `res=del` with `<name>` as payload
+ * The If-Match option gives the catalog version to which the change
+ * applies, and the ETag option the new version. A master which does
+ * not know the previous version should request the whole list.
+ *
+ * @param res added or removed resource
+ * @param added true if the resource has been registered
+ * @param oldver catalog version before the change
+ */
+
+void send_catalog_delta (Casan *ca, Resource *res, bool added, uint32_t oldver)
+{
+    Msg *m ;
+    option *o ;
+    char *buf ;
+    int len ;
+
+    // if not associated, the next association will carry the whole list
+    if ((ca->status_ != SL_RUNNING && ca->status_ != SL_RENEW)
+		|| ca->master_ == NULL)
+	return ;
+
+    m = initMsg (ca->l2_) ;
+    set_code (m, COAP_CODE_POST) ;
+    mk_ctl_msg (m) ;
+
+    if (added)
+	o = initOptionOpaque (MO_Uri_Query, CASAN_DELTA_ADD, sizeof CASAN_DELTA_ADD - 1) ;
+    else
+	o = initOptionOpaque (MO_Uri_Query, CASAN_DELTA_DEL, sizeof CASAN_DELTA_DEL - 1) ;
+    push_option (m, o) ;
+    freeOption (o) ;
+
+    push_catalog_etag (m, MO_If_Match, oldver) ;
+    push_catalog_etag (m, MO_Etag, ca->catver_) ;
+
+    len = well_known (res, NULL, 0) ;
+    buf = (char *) malloc (len) ;
+    if (buf == NULL)
+    {
+	printf("Memory allocation failed\n");
+	freeMsg (m) ;
+	return ;
+    }
+    if (added)
+	len = well_known (res, buf, len) - 1 ;
+    else
+	len = snprintf (buf, len, "<%s>", get_name (res)) ;
+    set_payload_msg (m, (uint8_t *) buf, len) ;
+    free (buf) ;
+
+    printf ("Sending catalog delta\n") ;
+    switch (send_confirmable (ca, m, NULL, NULL, NULL))
+    {
+	case CON_SENT :
+	case CON_QUEUED :
+	    ca->stat_.cat_delta++ ;
+	    break ;
+	default :
+	    printf ("%s", RED ("Catalog delta not sent\n")) ;
+	    break ;
+    }
+    freeMsg (m) ;
+}
+
+
+/**
+ * Find a particular resource by its name
+ */
+
+Resource *get_resource (Casan *ca, const char *name)
+{
+    reslist *rl ;
+
+    for (rl = ca->reslist_ ; rl != NULL ; rl = rl->next)
+    	if (strcmp (name, get_name (rl->res)) == 0)
+			break ;
+    return rl != NULL ? rl->res : NULL ;
+}
+
+
+
+/******************************************************************************
+Main CASAN loop
+******************************************************************************/
+
+static void min_time (time_t *t, time_t cand)
+{
+    if (cand < *t)
+	*t = cand ;
+}
+
+static void rx_depth_stat (Casan *ca, int depth) ;
+static void loop_step (Casan *ca) ;
+static void queue_wake (Casan *ca) ;
+static void queue_sleep (Casan *ca) ;
+static void discover_to (Casan *ca, Msg *out, l2addr_154 *dest) ;
+static void overhear (Casan *ca, Msg *in) ;
+
+
+/*
+ * State transitions: (re)start timers of the new state. Timers of the
+ * old state which are not used in the new state are stopped, since
+ * an armed timer is reported as due until it is consumed.
+ */
+
+static void enter_waiting (Casan *ca, slave_status st)
+{
+    initTwait (&ca->twait_, &ca->timers_, &ca->curtime_, &ca->prng_) ;
+    if (st == SL_WAITING_UNKNOWN)
+		stopTimer (&ca->timers_, TM_EXPIRE) ;	// no limit in this state
+    stopTimer (&ca->timers_, TM_OBSERVE) ;
+    stopTimer (&ca->timers_, TM_SLEEP) ;	// radio on until associated
+    stopTimer (&ca->timers_, TM_STANDBY) ;	// refreshed when associated
+    ca->status_ = st ;
+}
+
+// queue mode: start with a listen window (TM_SLEEP is stopped while not running)
+static void start_listen (Casan *ca)
+{
+    if (ca->sleepperiod_ > 0)
+		setTimer (&ca->timers_, TM_SLEEP, TICKS (ca->curtime_ + ca->listen_)) ;
+}
+
+static void enter_running (Casan *ca)
+{
+    casanmaster *sb ;
+
+    initTrenew (&ca->trenew_, &ca->timers_, &ca->curtime_, ca->sttl_) ;
+    ca->renewtries_ = 0 ;
+    setTimer (&ca->timers_, TM_OBSERVE, TICKS (ca->curtime_)) ;
+    start_listen (ca) ;
+    if (ca->standby_ != -1 && same_master (ca, &ca->masters_ [ca->standby_].addr))
+		ca->standby_ = -1 ;		// standby master is now the master
+    sb = get_standby (ca) ;
+    if (sb != NULL && ! activeTimer (&ca->timers_, TM_STANDBY))
+		setTimer (&ca->timers_, TM_STANDBY, TICKS (sb->assoctime + sb->sttl / 2)) ;
+    ca->status_ = SL_RUNNING ;
+    (void) save_master (ca) ;
+}
+
+
+/*
+ * Liveness evidence: a frame from the current master (request, ACK
+ * of one of our CON messages, Hello with the same hello-id) shows
+ * that the association is alive. The renewal is postponed, such that
+ * renewal Discovers are only sent when the link has been quiet for
+ * half the slave TTL.
+ */
+
+static void master_alive (Casan *ca)
+{
+    aliveTrenew (&ca->trenew_, &ca->curtime_) ;
+    if (ca->status_ == SL_RENEW)	// leave the renew state
+    {
+		ca->status_ = SL_RUNNING ;
+		ca->renewtries_ = 0 ;
+		start_listen (ca) ;		// resume the sleep schedule
+    }
+    ca->stat_.alive_frames++ ;
+}
+
+
+/*
+ * Standby master: a Hello from another master while associated.
+ * If there is no standby master yet, ask it for an association.
+ */
+
+static void standby_hello (Casan *ca, casanmaster *m, Msg *out)
+{
+    if (get_standby (ca) == NULL && m->sttl == 0)
+		discover_to (ca, out, &m->addr) ;
+}
+
+
+/*
+ * Standby master: association with a master other than the current
+ * one. Answer it, and keep it as the standby master if there is no
+ * other one, or if its link is better.
+ */
+
+static void standby_assoc (Casan *ca, casanmaster *m, time_t sttl, int mtu,
+			    Msg *in, Msg *out)
+{
+    casanmaster *sb ;
+
+    send_assoc_answer (ca, in, out) ;
+    m->sttl = sttl ;
+    m->mtu = mtu ;
+    m->assoctime = ca->curtime_ ;
+    ca->stat_.standby_assoc++ ;
+
+    sb = get_standby (ca) ;
+    if (sb == NULL || sb == m || m->lq > sb->lq)
+    {
+		ca->standby_ = m - ca->masters_ ;
+		setTimer (&ca->timers_, TM_STANDBY, TICKS (ca->curtime_ + sttl / 2)) ;
+    }
+}
+
+
+/*
+ * Standby master: keep the association warm with a unicast Discover
+ * in the middle of the association, and retry until the standby
+ * master answers or the association expires.
+ */
+
+static void standby_refresh (Casan *ca, Msg *out)
+{
+    casanmaster *sb ;
+
+    if (! expiredTimer (&ca->timers_, TM_STANDBY, TICKS (ca->curtime_)))
+		return ;
+    sb = get_standby (ca) ;
+    if (sb == NULL)
+    {
+		ca->standby_ = -1 ;		// association expired
+		stopTimer (&ca->timers_, TM_STANDBY) ;
+		return ;
+    }
+    discover_to (ca, out, &sb->addr) ;
+    setTimer (&ca->timers_, TM_STANDBY, TICKS (ca->curtime_ + CASAN_STANDBY_RETRY)) ;
+}
+
+
+/*
+ * Failover: the current master did not answer during the renew
+ * state, switch to the standby master. Its association is still
+ * valid, hence the slave stays associated: observed resources are
+ * kept, and notifications go to the new master (masters are assumed
+ * to share their observe state, see casan.h). The renewal is
+ * scheduled from the remaining time of the standby association.
+ *
+ * Returns false if there is no valid standby master.
+ */
+
+static bool failover (Casan *ca)
+{
+    casanmaster *sb ;
+    time_t left ;
+
+    sb = get_standby (ca) ;
+    if (sb == NULL)
+		return false ;
+
+    if (ca->master_ != NULL)
+		freel2addr_154 (ca->master_) ;
+    ca->master_ = init_l2addr_154_addr (&sb->addr) ;
+    ca->hlid_ = sb->hlid ;
+    ca->sttl_ = sb->sttl ;
+    negociate_mtu (ca, sb->mtu) ;
+    left = sb->assoctime + sb->sttl - ca->curtime_ ;
+    ca->standby_ = -1 ;
+    stopTimer (&ca->timers_, TM_STANDBY) ;
+    ca->stat_.failovers++ ;
+
+    enter_running (ca) ;
+    initTrenew (&ca->trenew_, &ca->timers_, &ca->curtime_, left) ;
+
+    printf ("Failover to master ") ;
+    printAddr (ca->master_) ;
+    printf (", helloid= %ld, mtu= %d\n", ca->hlid_, ca->curmtu_) ;
+    return true ;
+}
+
+
+/*
+ * Send a renewal Discover to the current master. With a standby
+ * master, the current master is only given CASAN_FAILOVER_TRIES
+ * Discovers, CASAN_FAILOVER_WAIT apart: if none is answered (any
+ * answer leaves the renew state, see master_alive), the slave fails
+ * over instead of waiting for the end of the association.
+ */
+
+static void renew_discover (Casan *ca, Msg *out)
+{
+    if (get_standby (ca) != NULL)
+    {
+		if (ca->renewtries_ >= CASAN_FAILOVER_TRIES && failover (ca))
+		    return ;
+		setTimer (&ca->timers_, TM_DISCOVER, TICKS (ca->curtime_ + CASAN_FAILOVER_WAIT)) ;
+    }
+    send_discover (ca, out) ;
+    ca->stat_.renew_sent++ ;
+    ca->renewtries_++ ;
+}
+
+
+
+/**
+ * @brief Main CASAN loop
+ *
+ * This method must be called regularly (typically in the loop function
+ * of the Arduino framework) in order to process CASAN events.
+ *
+ * Up to `rxbudget_` received frames are processed by each call (see
+ * `set_rx_budget`), such that a burst of frames does not overrun
+ * the reception buffer. Timers (retransmissions, delayed responses,
+ * observe triggers, etc.) are checked before each frame, such that
+ * they are not delayed by a burst.
+ *
+ * Frames are not sent while processing: they are queued (see outq.h)
+ * and up to `txbudget_` of them are sent at the end of each call,
+ * highest priority first. Remaining frames are sent by the next call.
+ *
+ * In queue mode, the radio is switched on before sending frames, and
+ * switched off at the end of the listen window.
+ */
+
+void loop (Casan *ca)
+{
+    int n ;
+
+    sync_time (&ca->curtime_) ;		// get current time
+    rx_depth_stat (ca, pending_frames (ca->l2_)) ;
+
+    n = 0 ;
+    do
+    {
+		loop_step (ca) ;
+		n++ ;
+    } while (n < ca->rxbudget_ && pending_frames (ca->l2_) > 0) ;
+
+    queue_wake (ca) ;
+    (void) loopOutq (ca->outq_, ca->txbudget_) ;
+    queue_sleep (ca) ;
+}
+
+
+/*
+ * Queue mode: switch the radio on or off, and keep track of the
+ * time spent in each mode.
+ */
+
+static void switch_radio (Casan *ca, bool on)
+{
+    uint32_t d ;
+
+    d = (uint32_t) (ca->curtime_ - ca->radiosince_) ;
+    if (ca->awake_)
+		ca->stat_.awake_ms += d ;
+    else
+		ca->stat_.asleep_ms += d ;
+    ca->radiosince_ = ca->curtime_ ;
+    ca->awake_ = on ;
+    set_radio (ca->l2_, on) ;
+}
+
+
+/*
+ * Queue mode: wake up when the sleep period is over, when there are
+ * frames to send (notifications, retransmissions), or when the
+ * association is lost or being renewed. The master is told with an
+ * "awake" message, and may send its queued requests during the
+ * listen window.
+ */
+
+static void queue_wake (Casan *ca)
+{
+    Msg *out ;
+
+    if (ca->awake_)
+		return ;
+    if (ca->status_ == SL_RUNNING && lenOutq (ca->outq_) == 0
+		&& ! expiredTimer (&ca->timers_, TM_SLEEP, TICKS (ca->curtime_)))
+		return ;
+
+    switch_radio (ca, true) ;
+    if (ca->status_ != SL_RUNNING)
+		return ;			// radio stays on, no listen window
+
+    ca->stat_.wakeups++ ;
+    setTimer (&ca->timers_, TM_SLEEP, TICKS (ca->curtime_ + ca->listen_)) ;
+    out = initMsg (ca->l2_) ;
+    send_awake (ca, out) ;
+    freeMsg (out) ;
+}
+
+
+/*
+ * Queue mode: go to sleep at the end of the listen window, when all
+ * frames have been sent. The listen window is only extended while
+ * our CON messages wait for their ACK (which the master cannot queue),
+ * and at most for CASAN_ACKWAIT_MAX: requests received later are
+ * queued by the master until the next wakeup.
+ */
+
+static void queue_sleep (Casan *ca)
+{
+    bool acked ;
+
+    if (ca->sleepperiod_ == 0)
+		return ;
+    acked = ca->retrans_->nused_ == 0 ;
+    if (! expiredTimer (&ca->timers_, TM_SLEEP, TICKS (ca->curtime_))
+		&& ! (ca->ackwait_ != 0 && acked))
+		return ;
+
+    if (ca->status_ != SL_RUNNING)
+    {
+		stopTimer (&ca->timers_, TM_SLEEP) ;	// re-armed when associated
+		ca->ackwait_ = 0 ;
+		return ;
+    }
+    if (lenOutq (ca->outq_) > 0)
+		return ;			// sleep after the next call
+
+    if (! acked && ca->ackwait_ == 0)
+    {
+		ca->stat_.ackwaits++ ;
+		ca->ackwait_ = ca->curtime_ + CASAN_ACKWAIT_MAX ;
+		setTimer (&ca->timers_, TM_SLEEP, TICKS (ca->ackwait_)) ;
+		return ;
+    }
+
+    ca->ackwait_ = 0 ;
+    switch_radio (ca, false) ;
+    setTimer (&ca->timers_, TM_SLEEP,
+		TICKS (ca->curtime_ + ca->sleepperiod_ - ca->listen_)) ;
+}
+
+
+/*
+ * Keep statistics on the number of frames waiting in the reception
+ * buffer when `loop` is called, in order to size this buffer.
+ */
+
+static void rx_depth_stat (Casan *ca, int depth)
+{
+    if (depth > ca->stat_.rx_depth_max)
+		ca->stat_.rx_depth_max = depth ;
+    if (depth >= CASAN_RXDEPTH_HIST)
+		depth = CASAN_RXDEPTH_HIST - 1 ;
+    ca->stat_.rx_depth [depth]++ ;
+}
+
+
+/*
+ * Frames sent to other nodes are overheard. Discovers sent by other
+ * slaves to their master are counted to estimate the group size.
+ * Discover scheduling (see Twait): while waiting for a master, these
+ * Discovers may suppress our own Discovers, while frames from our
+ * master show that it is not silent.
+ */
+
+static void overhear (Casan *ca, Msg *in)
+{
+    l2addr_154 *src ;
+    bool waiting ;
+
+    if (! coap_decode (in, get_payload (ca->l2_, 0), get_paylen (ca->l2_), false))
+		return ;
+    waiting = ca->status_ == SL_WAITING_UNKNOWN || ca->status_ == SL_WAITING_KNOWN ;
+    src = get_src (ca->l2_) ;
+    if (same_master (ca, src))
+    {
+		if (waiting)
+		    masterTwait (&ca->twait_) ;
+    }
+    else if (is_ctl_msg (in) && is_discover (in))
+    {
+		group_heard (ca, src) ;
+		if (waiting)
+		{
+		    overheardTwait (&ca->twait_) ;
+		    ca->stat_.discover_heard++ ;
+		}
+    }
+    freel2addr_154 (src) ;
+}
+
+
+/*
+ * One step of the main loop: check timers, process at most one
+ * received frame and run the state machine.
+ */
+
+static void loop_step (Casan *ca)
+{
+    Msg *in, *out ;
+    l2_recv_t ret ;
+    uint8_t oldstatus ;
+    long int hlid = 0;
+    l2addr_154 *srcaddr ;
+    int mtu ;				// mtu announced by master in assoc msg
+    time_t sttl ;			// slave ttl announced in assoc msg
+    casanmaster *m ;
+
+    oldstatus = ca->status_ ;		// keep old value for debug display
+    sync_time (&ca->curtime_) ;		// get current time
+    loopRetrans (ca->retrans_, ca->l2_, &ca->curtime_) ;	// check needed retransmissions
+    loopPending (ca->pending_, ca->l2_, &ca->curtime_) ;	// send delayed responses
+    loopBlocks (ca->blocks_, &ca->curtime_) ;		// expire block transfers
+    loopDedup (ca->dedup_, &ca->curtime_) ;		// expire processed requests
+
+    in = initMsg (ca->l2_) ;
+    out = initMsg (ca->l2_) ;
+    srcaddr = NULL ;
+
+    ret = recvMsg (in) ;			// get received message
+    if (ret == RECV_OK)
+    {
+		srcaddr = get_src (ca->l2_) ;	// get a new address
+		ca->stat_.rx_frames++ ;
+    }
+    else if (ret == RECV_WRONG_DEST && ca->status_ != SL_COLDSTART)
+		overhear (ca, in) ;
+
+    switch (ca->status_)
+    {
+	case SL_COLDSTART :
+	    // first Discover at a random point of the first interval,
+	    // such that nodes powered on together do not send together
+	    if (restore_master (ca))
+	    {
+			// unicast Discover to the saved master, broadcast later
+			enter_waiting (ca, SL_WAITING_KNOWN) ;
+			setTimer (&ca->timers_, TM_EXPIRE, TICKS (ca->curtime_ + CASAN_NV_WAIT)) ;
+	    }
+	    else enter_waiting (ca, SL_WAITING_UNKNOWN) ;
+	    break ;
+
+	case SL_WAITING_UNKNOWN :
+	    if (ret == RECV_OK)
 	    {	
 			check_msg_received (ca->retrans_, in) ;
 
@@ -551,24 +1844,30 @@ void loop (Casan *ca)
 			    if (is_hello (in, &hlid))
 			    {
 					printf("Received a CTL HELLO msg\n") ;
+					(void) track_master (ca, srcaddr, hlid) ;
 					change_master (ca, hlid, -1) ;	// don't change mtu
-					ca->twait_ = initTwait (&curtime) ;
-					ca->status_ = SL_WAITING_KNOWN ;
+					enter_waiting (ca, SL_WAITING_KNOWN) ;
 			    }
 			    else if (is_assoc (in, &ca->sttl_, &mtu))
 			    {
 
 					printf ("Received a CTL ASSOC msg UNKNOWN\n") ;
+					(void) track_master (ca, srcaddr, -1) ;
 					change_master (ca, -1, mtu) ;	// "unknown" hlid
 					send_assoc_answer (ca, in, out) ;
-					ca->trenew_ = initTrenew (&curtime, ca->sttl_) ;
-					ca->status_ = SL_RUNNING ;
+					enter_running (ca) ;
+			    }
+			    else if (is_discover (in))
+			    {
+					group_heard (ca, srcaddr) ;	// another slave
+					overheardTwait (&ca->twait_) ;
+					ca->stat_.discover_heard++ ;
 			    }
 			    else printf ("%s\n",RED ("Unkwnon CTL")) ;
 			}
 
 	    }
-	    if (ca->status_ == SL_WAITING_UNKNOWN && nextTwait (ca->twait_, &curtime)){
+	    if (ca->status_ == SL_WAITING_UNKNOWN && nextTwait (&ca->twait_, &ca->curtime_)){
 			send_discover (ca, out) ;
 		}
 	
@@ -584,15 +1883,25 @@ void loop (Casan *ca)
 			    if (is_hello (in, &hlid))
 			    {
 					printf ("Received a CTL HELLO msg\n") ;
+					(void) track_master (ca, srcaddr, hlid) ;
+					masterTwait (&ca->twait_) ;
+					if (hlid != ca->hlid_)
+					    resetTwait (&ca->twait_, &ca->curtime_) ;
 					change_master (ca, hlid, -1) ;	// don't change mtu
 			    }
 			    else if (is_assoc (in, &ca->sttl_, &mtu))
 			    {
 					printf ("Received a CTL ASSOC msg KNOWN\n") ;
+					(void) track_master (ca, srcaddr, -1) ;
 					change_master (ca, -1, mtu) ;	// unknown hlid
 					send_assoc_answer (ca, in, out) ;
-					ca->trenew_ = initTrenew (&curtime, ca->sttl_) ;
-					ca->status_ = SL_RUNNING ;
+					enter_running (ca) ;
+			    }
+			    else if (is_discover (in))
+			    {
+					group_heard (ca, srcaddr) ;	// another slave
+					overheardTwait (&ca->twait_) ;
+					ca->stat_.discover_heard++ ;
 			    }
 			    else printf ("%s\n", RED ("Unkwnon CTL")) ;
 			}
@@ -600,14 +1909,13 @@ void loop (Casan *ca)
 
 	    if (ca->status_ == SL_WAITING_KNOWN)
 	    {
-			if (expiredTwait (ca->twait_, &curtime))
+			if (expiredTwait (&ca->twait_, &ca->curtime_))
 			{
 			    reset_master (ca) ;		// master_ is no longer known
 			    send_discover (ca, out) ;
-			    ca->twait_ = initTwait (&curtime) ;	// reset timer
-			    ca->status_ = SL_WAITING_UNKNOWN ;
+			    enter_waiting (ca, SL_WAITING_UNKNOWN) ;	// reset timer
 			}
-			else if (nextTwait (ca->twait_, &curtime))
+			else if (nextTwait (&ca->twait_, &ca->curtime_))
 			{
 			    send_discover (ca, out) ;
 			}
@@ -619,43 +1927,68 @@ void loop (Casan *ca)
 	case SL_RENEW :
 	    if (ret == RECV_OK)
 	    {	
-			check_msg_received (ca->retrans_, in) ;
-
-			if (is_ctl_msg (in))
+			if (get_type (in) == COAP_TYPE_ACK || get_type (in) == COAP_TYPE_RST)
+			{
+			    // answer to one of our CON: nothing else to do
+			    if (check_msg_received (ca->retrans_, in) && same_master (ca, srcaddr))
+					master_alive (ca) ;
+			}
+			else if (is_ctl_msg (in))
 			{
 			    if (is_hello (in, &hlid))
 			    {
 					printf ("Received a CTL HELLO msg\n") ;
-					if (! same_master (ca, srcaddr) || hlid != ca->hlid_)
+					m = track_master (ca, srcaddr, hlid) ;
+					if (! same_master (ca, srcaddr))
+					{
+					    // another master: candidate for standby
+					    if (m != NULL)
+							standby_hello (ca, m, out) ;
+					}
+					else if (hlid == ca->hlid_)
+					    master_alive (ca) ;
+					else
 					{
 					    int oldhlid = ca->hlid_ ;
 
 					    change_master (ca, hlid, 0) ;	// reset mtu
 					    if (oldhlid != -1)
 					    {
-							ca->twait_ = initTwait (&curtime) ;
-							ca->status_ = SL_WAITING_KNOWN ;
+							enter_waiting (ca, SL_WAITING_KNOWN) ;
 					    }
+					    else
+							master_alive (ca) ;	// hello-id learnt
 					}
 			    }
-			    else if (is_assoc (in, &ca->sttl_, &mtu))
+			    else if (is_assoc (in, &sttl, &mtu))
 			    {
 					printf ("Received a CTL ASSOC msg RENEW\n") ;
+					m = track_master (ca, srcaddr, -1) ;
 					if (same_master (ca, srcaddr))
 					{
+					    ca->sttl_ = sttl ;
 					    negociate_mtu (ca, mtu) ;
 					    send_assoc_answer (ca, in, out) ;
-					    ca->trenew_ = initTrenew (&curtime, ca->sttl_) ;
-					    ca->status_ = SL_RUNNING ;
+					    enter_running (ca) ;
 					}
+					else if (m != NULL)
+					    standby_assoc (ca, m, sttl, mtu, in, out) ;
 			    }
+			    else if (is_discover (in))
+					group_heard (ca, srcaddr) ;	// another slave
 			    else printf ("%s\n",RED ("Unkwnon CTL")) ;
 			}
-			else		// request for a normal resource
+			else if (is_request (in))	// request for a normal resource
 			{
-			    // deduplicate () ;
-			    process_request (ca, in, out) ;
-			    sendMsg (out, ca->master_) ;
+			    (void) track_master (ca, srcaddr, -1) ;
+			    if (same_master (ca, srcaddr))
+					master_alive (ca) ;
+			    if (! deduplicate (ca, in, srcaddr))
+			    {
+					process_request (ca, in, out) ;
+					send_response (ca, in, out, srcaddr) ;
+					addDedup (ca->dedup_, srcaddr, get_id (in), out, &ca->curtime_) ;
+			    }
 			}
 	    }
 	    else if (ret == RECV_TRUNCATED)
@@ -667,31 +2000,29 @@ void loop (Casan *ca)
 			option *o = initOptionInteger(MO_Size1, getMTU (ca->l2_)) ;
 			push_option (out, o) ;
 			set_code (out, COAP_CODE_TOO_LARGE) ;
-			sendMsg (out, ca->master_) ;
+			(void) queue_msg (ca, OQ_RESPONSE, out, ca->master_) ;
 	    }
 
-	    check_observed_resources (ca, out) ;
+	    if (expiredTimer (&ca->timers_, TM_OBSERVE, TICKS (ca->curtime_)))
+			check_observed_resources (ca, out) ;
+	    if (ca->status_ == SL_RUNNING || ca->status_ == SL_RENEW)
+			standby_refresh (ca, out) ;
 	    //printf("ici fin\n");
 	    //printf("%d   %d  \n",curtime , &curtime);
-	    if (ca->status_ == SL_RUNNING && renewTrenew (ca->trenew_, &curtime))
+	    if (ca->status_ == SL_RUNNING && renewTrenew (&ca->trenew_, &ca->curtime_))
 	    {
-	    	
-			send_discover (ca, out) ;
 			ca->status_ = SL_RENEW ;
+			renew_discover (ca, out) ;
 	    }
+	    else if (ca->status_ == SL_RENEW && nextTrenew (&ca->trenew_, &ca->curtime_))
+			renew_discover (ca, out) ;
 
-	    if (ca->status_ == SL_RENEW && nextTrenew (ca->trenew_, &curtime))
-	    {
-	    	
-			send_discover (ca, out) ;
-	    }
-
-	    if (ca->status_ == SL_RENEW && expiredTrenew (ca->trenew_, &curtime))
+	    if (ca->status_ == SL_RENEW && expiredTrenew (&ca->trenew_, &ca->curtime_)
+			&& ! failover (ca))
 	    {
 			reset_master (ca) ;	// master_ is no longer known
 			send_discover (ca, out) ;
-			ca->twait_ = initTwait ( &curtime) ;	// reset timer
-			ca->status_ = SL_WAITING_UNKNOWN ;
+			enter_waiting (ca, SL_WAITING_UNKNOWN) ;	// reset timer
 	    }
 
 	    break ;
@@ -714,7 +2045,116 @@ void loop (Casan *ca)
 
     if (srcaddr != NULL)
 		freel2addr_154(srcaddr) ;
+    freeMsg (in) ;
+    freeMsg (out) ;
+}
+
+
 
+/**
+ * @brief Next time the engine needs to run
+ *
+ * This function returns the earliest deadline of all engine timers
+ * registered in the timer service: Discover and association timers
+ * of the current state, next retransmission, next delayed response
+ * and next observe check. Frames still waiting in the outbound queue
+ * must be sent immediately. It runs in constant time, such that
+ * it may be called after each `loop` to program a single wakeup
+ * and sleep until then.
+ *
+ * Note that `loop` must also be called when a frame is received.
+ *
+ * @return deadline (same scale as `curtime_`), at most
+ *	CASAN_MAXSLEEP ms from now, or `curtime_` if the engine
+ *	must run immediately
+ */
+
+time_t casan_next_deadline (Casan *ca)
+{
+    time_t t ;
+    tick_t now, next ;
+
+    if (ca->status_ == SL_COLDSTART || lenOutq (ca->outq_) > 0)
+		return ca->curtime_ ;
+
+    t = ca->curtime_ + CASAN_MAXSLEEP ;
+    now = TICKS (ca->curtime_) ;
+    if (nextTimer (&ca->timers_, &next))
+    {
+		if (TICK_REACHED (now, next))
+		    return ca->curtime_ ;
+		min_time (&t, ca->curtime_ + (tick_t) (next - now)) ;
+    }
+    return t ;
+}
+
+
+
+/******************************************************************************
+Contiki process
+******************************************************************************/
+
+PROCESS (casan_process, "CASAN engine") ;
+
+static Casan *casan_proc_ca ;		// engine run by casan_process
+
+/**
+ * @brief Run the CASAN engine as a Contiki process
+ *
+ * Instead of calling `loop` periodically, the application may start
+ * this process, which runs the engine only when needed:
+ * * when a frame is received or sent (the process is polled by the
+ *	radio interrupt routines, see `setProcess`)
+ * * when the earliest timer of the engine (Discover, renewal,
+ *	retransmission, delayed response, etc.) expires
+ * * when the application calls `casan_poll` (for example when
+ *	the value of an observed resource changes)
+ *
+ * There is only one such process: it runs the given engine.
+ *
+ * @param ca CASAN engine, already initialized
+ */
+
+void start_casan_process (Casan *ca)
+{
+    casan_proc_ca = ca ;
+    process_start (&casan_process, NULL) ;
+    setProcess (ca->l2_->cm_, &casan_process) ;
+}
+
+
+/**
+ * @brief Wake up the CASAN process as soon as possible
+ */
+
+void casan_poll (void)
+{
+    process_poll (&casan_process) ;
+}
+
+
+PROCESS_THREAD (casan_process, ev, data)
+{
+    static struct etimer et ;
+
+    PROCESS_BEGIN () ;
+
+    while (1)
+    {
+	time_t next ;
+
+	loop (casan_proc_ca) ;
+
+	next = casan_next_deadline (casan_proc_ca) ;
+	if (pending_frames (casan_proc_ca->l2_) > 0 || next <= casan_proc_ca->curtime_)
+	    process_poll (&casan_process) ;	// more work to do now
+	else
+	    etimer_set (&et, (clock_time_t) (((next - casan_proc_ca->curtime_) * CLOCK_SECOND + 999) / 1000)) ;
+
+	PROCESS_WAIT_EVENT () ;
+    }
+
+    PROCESS_END () ;
 }
 
 
@@ -756,6 +2196,21 @@ bool is_ctl_msg (Msg *m)
 }
 
 
+/**
+ * Check if the message is a CON or NON request (GET..iPATCH), to
+ * be given to a resource handler. Empty messages and responses are
+ * not requests.
+ */
+
+bool is_request (Msg *m)
+{
+    uint8_t code = get_code (m) ;
+
+    return (get_type (m) == COAP_TYPE_CON || get_type (m) == COAP_TYPE_NON)
+		&& code >= COAP_CODE_GET && code <= COAP_CODE_IPATCH ;
+}
+
+
 /**
  * Check if the control message is a Hello message from the master
  * and returns the contained hello-id
@@ -786,6 +2241,40 @@ bool is_hello (Msg *m, long int *hlid)
 
 
 
+/**
+ * Check if the control message is a Discover message from another
+ * slave (an awake message also carries a slave-id, but it is sent
+ * to the master by an associated slave)
+ */
+
+bool is_discover (Msg *m)
+{
+    bool found = false ;
+    long int n ;
+
+    if (get_type (m) == COAP_TYPE_NON && get_code (m) == COAP_CODE_POST)
+    {
+		reset_next_option (m) ;
+		option *o;
+		for ( o = next_option (m) ; o != NULL ; o = next_option (m))
+		{
+		    if (getOptcode (o) == MO_Uri_Query)
+		    {
+				const char *q = (const char *) getOptval (o, (int *) 0) ;
+
+				if (sscanf (q, CASAN_DISCOVER_SLAVEID, &n) == 1)
+				    found = true ;
+				else if (sscanf (q, CASAN_AWAKE, &n) == 1)
+				    return false ;
+		    }
+		}
+    }
+
+    return found ;
+}
+
+
+
 /**
  * Check if the control message is an Assoc message from the master
  * and returns the contained slave-ttl
@@ -855,13 +2344,19 @@ void mk_ctl_msg (Msg *out)
 
 
 /**
- * Send a discover message
+ * Send a discover message to the current master (or broadcast
+ * it if the master is not known)
  */
 
 void send_discover (Casan *ca, Msg *out)
+{
+    discover_to (ca, out, (ca->master_ != NULL) ? ca->master_ : bcastaddr (ca->l2_)) ;
+}
+
+
+static void discover_to (Casan *ca, Msg *out, l2addr_154 *dest)
 {
     char tmpstr [CASAN_BUF_LEN] ;
-    l2addr_154 *dest ;
 
     printf ("Sending Discover\n") ;
     
@@ -880,9 +2375,23 @@ void send_discover (Casan *ca, Msg *out)
     option *o2 = initOptionOpaque(MO_Uri_Query, tmpstr, strlen (tmpstr)) ;
     push_option (out, o2) ;
 
-    dest = (ca->master_ != NULL) ? ca->master_ : bcastaddr () ;
+    if (ca->sleepperiod_ > 0)		// announce queue mode
+    {
+		option *o ;
+
+		snprintf (tmpstr, sizeof tmpstr, CASAN_DISCOVER_SLEEP, (long int) ca->sleepperiod_) ;
+		o = initOptionOpaque (MO_Uri_Query, tmpstr, strlen (tmpstr)) ;
+		push_option (out, o) ;
+		freeOption (o) ;
+		snprintf (tmpstr, sizeof tmpstr, CASAN_DISCOVER_LISTEN, (long int) ca->listen_) ;
+		o = initOptionOpaque (MO_Uri_Query, tmpstr, strlen (tmpstr)) ;
+		push_option (out, o) ;
+		freeOption (o) ;
+    }
+
     //printMsg(out);
-    sendMsg (out, dest) ;
+    if (! queue_msg (ca, OQ_CONTROL, out, dest))
+		printf ("%s", RED ("Cannot queue the discover message\n")) ;
 
     freeOption(o1);
     freeOption(o2);
@@ -890,6 +2399,37 @@ void send_discover (Casan *ca, Msg *out)
 }
 
 
+/**
+ * Send an awake message (queue mode): the slave listens during
+ * the given window, and the master may send its queued requests
+ */
+
+void send_awake (Casan *ca, Msg *out)
+{
+    char tmpstr [CASAN_BUF_LEN] ;
+    option *o ;
+
+    resetMsg (out) ;
+    set_id (out, ca->curid_++) ;
+    set_type (out, COAP_TYPE_NON) ;
+    set_code (out, COAP_CODE_POST) ;
+    mk_ctl_msg (out) ;
+
+    snprintf (tmpstr, sizeof tmpstr, CASAN_DISCOVER_SLAVEID, ca->slaveid_) ;
+    o = initOptionOpaque (MO_Uri_Query, tmpstr, strlen (tmpstr)) ;
+    push_option (out, o) ;
+    freeOption (o) ;
+
+    snprintf (tmpstr, sizeof tmpstr, CASAN_AWAKE, (long int) ca->listen_) ;
+    o = initOptionOpaque (MO_Uri_Query, tmpstr, strlen (tmpstr)) ;
+    push_option (out, o) ;
+    freeOption (o) ;
+
+    if (! queue_msg (ca, OQ_CONTROL, out, ca->master_))
+		printf ("%s", RED ("Cannot queue the awake message\n")) ;
+}
+
+
 /**
  * Send the answer to an association message
  * (the association task itself is handled in the CASAN main loop)
@@ -901,16 +2441,32 @@ void send_assoc_answer (Casan *ca, Msg *in, Msg *out)
 
     dest = get_src (ca->l2_) ;
 
-    // send back an acknowledgement message
-    set_type (out, COAP_TYPE_ACK) ;
-    set_code (out, COAP_CODE_OK) ;
-    set_id (out, get_id (in)) ;
-
-    // will get the resources and set them in the payload in the right format
-    (void) get_well_known (ca, out) ;
+    // the master may ask for the next block of a long resource list
+    if (! block2_serve (ca->blocks_, in, out))
+    {
+	// send back an acknowledgement message
+	set_type (out, COAP_TYPE_ACK) ;
+	set_code (out, COAP_CODE_OK) ;
+	set_id (out, get_id (in)) ;
+	set_token_msg (out, get_token_msg (in)) ;
+
+	if (is_catalog_etag (in, ca->catver_))
+	{
+	    // master already knows our resources: just send the version
+	    set_code (out, COAP_CODE_VALID) ;
+	    push_catalog_etag (out, MO_Etag, ca->catver_) ;
+	    ca->stat_.assoc_valid++ ;
+	}
+	else
+	{
+	    // will get the resources and set them in the payload in the right format
+	    (void) get_well_known (ca, out) ;
+	    block2_response (ca->blocks_, in, out) ;
+	}
+    }
 
     // send the packet
-    if (! sendMsg (out, dest))
+    if (! queue_msg (ca, OQ_CONTROL, out, dest))
 		printf ("%s", RED ("Cannot send the assoc answer message")) ;
 
     freel2addr_154(dest) ;
@@ -921,6 +2477,43 @@ void send_assoc_answer (Casan *ca, Msg *in, Msg *out)
 Debug methods
 ******************************************************************************/
 
+/**
+ * @brief Return operational statistics of the CASAN engine
+ */
+
+CasanStat *get_casan_stat (Casan *ca)
+{
+    return &ca->stat_ ;
+}
+
+
+/**
+ * @brief Return RTT/RTO estimation for the current master
+ *
+ * @return estimation, or NULL if no CON message has been acknowledged
+ *	by the current master
+ */
+
+rtoest *get_rto_stat (Casan *ca)
+{
+    if (ca->master_ == NULL)
+	return NULL ;
+    return getRtoRetrans (ca->retrans_, ca->master_) ;
+}
+
+
+/**
+ * @brief Return statistics of a class of the outbound queue
+ *
+ * @param cls traffic class (OQ_CONTROL, OQ_RESPONSE, etc.)
+ */
+
+oqstat *get_outq_stat (Casan *ca, oqclass_t cls)
+{
+    return getStatOutq (ca->outq_, cls) ;
+}
+
+
 /**
  * @brief Print the list of resources, used for debug purpose
  */
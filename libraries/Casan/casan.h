@@ -8,13 +8,12 @@
 
 #include "resource.h"		// => msg.h => l2.h + option.h
 #include "retrans.h"		// => time.h
-
-
-
-#define	COAP_CODE_OK		COAP_RETURN_CODE (2, 5)
-#define	COAP_CODE_BAD_REQUEST	COAP_RETURN_CODE (4, 0)
-#define	COAP_CODE_NOT_FOUND	COAP_RETURN_CODE (4, 4)
-#define	COAP_CODE_TOO_LARGE	COAP_RETURN_CODE (4,13)
+#include "pending.h"
+#include "block.h"
+#include "dedup.h"
+#include "outq.h"
+#include "nvstore.h"
+#include "prng.h"
 
 
 
@@ -25,8 +24,11 @@
  * methods (to be called in the `setup` application function) and a
  * `loop` method (to be called in the `loop` application function).
  *
- * There must be one and only one instance of this class, which
- * must be created in the application.
+ * The engine has no global state: all of it (current time, random
+ * generator, radio buffers in the L2 object) is held by the Casan
+ * instance and the l2net_154 object it is given. Hence, a host program
+ * may run several engines, each with its own l2net_154 object.
+ * On a node, there is only one radio, hence only one instance.
  * As this class relies on a separate library (L2-*) to provide
  * network access, a specific network object must be given to the
  * Casan object during creation.
@@ -46,14 +48,49 @@
  * `Casan::loop` method. It is advised to use the `Debug` class
  * in order to monitor available memory and detect memory leaks.
  *
+ * Alternatively, with Contiki, the application may call
+ * `start_casan_process` instead: the engine then runs in its own
+ * process, woken up by the radio and by its timers only.
+ *
+ * A battery-powered slave may use the queue mode (see `set_queue_mode`):
+ * once associated, the radio is off most of the time. The slave wakes
+ * up periodically, sends an "awake" message and listens during a short
+ * window, while the master sends the requests it has queued. The window
+ * is extended, up to CASAN_ACKWAIT_MAX, while CON messages sent by the
+ * slave are not acknowledged.
+ *
+ * Responses to broadcast requests are delayed by a random time within
+ * a leisure window (RFC 7252, section 8.2), which grows with the number
+ * of slaves. This group size is estimated from the Discovers of other
+ * slaves heard on the network, unless it is given with `set_leisure`.
+ *
+ * The association is renewed by the slave only when the link with
+ * its master has been quiet: any request, acknowledgement or Hello
+ * from the master postpones the renewal.
+ *
+ * With a non-volatile store (see `set_nvstore`), the master is
+ * remembered across reboots: after a reset, the slave first sends
+ * a unicast Discover to its previous master, and falls back to
+ * broadcast Discovers if it does not answer.
+ *
+ * Several masters may run on the same L2 network for redundancy. The
+ * engine keeps track of the masters it hears (hello-id, last frame
+ * received, link quality) and keeps a standby association with the
+ * best other master. If the current master does not answer
+ * CASAN_FAILOVER_TRIES renewal Discovers (CASAN_FAILOVER_WAIT apart),
+ * the slave switches to the standby master instead of starting a new
+ * discovery: observed resources are kept, and notifications are sent
+ * to the new master with the tokens of the original registrations.
+ * This assumes that redundant masters share their observe state (the
+ * registrations made through one of them are known by the others);
+ * otherwise the new master has to register again.
+ *
  * @bug Current limitations:
  * * partial support for retransmission
- * * this class supports at most one master on the current L2
- *	network. If there are more than one master, behaviour is not
- *	guaranteed.
+ * * at most CASAN_MAXMASTERS masters are tracked on the current L2
+ *	network, and only one of them is kept as a standby
  * * no support for master pairing
  * * no support for DTLS cryptography
- * * no support for block transfer
  * * no support for resource observation
  */
 
@@ -68,6 +105,77 @@
 	} slave_status;
 
 
+#define	CASAN_RXDEPTH_HIST	16	// size of rx_depth histogram
+#define	CASAN_MAXMASTERS	3	// max # of tracked masters
+#define	CASAN_GROUPMAP_BITS	256	// slaves heard (linear counting)
+#define	CASAN_FAILOVER_TRIES	2	// unanswered renewal Discovers
+#define	CASAN_FAILOVER_WAIT	500	// answer delay for a renewal Discover (ms)
+#define	CASAN_ACKWAIT_MAX	ACK_TIMEOUT_MAX	// max listen extension for ACKs (ms)
+
+	/**
+	 * Operational statistics of the CASAN engine
+	 */
+
+	typedef struct CasanStat
+	{
+	    int resp_suppressed ;	// responses suppressed by No-Response
+	    int resp_delayed ;		// responses to broadcast requests
+	    int assoc_valid ;		// assoc answered with catalog version
+	    int cat_delta ;		// catalog changes pushed to master
+	    int notif_sent ;		// observe notifications sent
+	    int notif_queued ;		// notifications waiting for NSTART
+	    int notif_rejected ;	// notifications refused (queue full)
+	    int dup_replayed ;		// duplicate requests answered from cache
+	    int dup_dropped ;		// duplicate requests without response
+	    int rx_frames ;		// frames received
+	    int rx_depth_max ;		// max # of frames waiting in loop
+	    int rx_depth [CASAN_RXDEPTH_HIST] ;	// # of loops per frames waiting
+	    int wakeups ;		// listen windows (queue mode)
+	    uint32_t awake_ms ;		// time with radio on (queue mode)
+	    uint32_t asleep_ms ;	// time with radio off (queue mode)
+	    int ackwaits ;		// listen windows extended for ACKs
+	    int nv_saved ;		// master records written
+	    int nv_restored ;		// master records read at boot
+	    int standby_assoc ;		// associations with a standby master
+	    int failovers ;		// switches to the standby master
+	    int alive_frames ;		// frames from master postponing renewal
+	    int renew_sent ;		// renewal Discovers sent
+	    int discover_heard ;	// Discovers from other slaves overheard
+	} CasanStat;
+
+
+	/**
+	 * Master record in non-volatile storage
+	 */
+
+	typedef struct CasanNv
+	{
+	    uint16_t magic ;		// CASAN_NV_MAGIC
+	    addr2_t master ;		// master address
+	    int32_t hlid ;		// hello-id (-1 if unknown)
+	    int32_t mtu ;		// negociated MTU
+	    uint32_t sttl ;		// slave TTL (ms)
+	    uint16_t sum ;		// checksum of the previous fields
+	} CasanNv;
+
+
+	/**
+	 * Masters heard on the L2 network
+	 */
+
+	typedef struct casanmaster
+	{
+	    bool used ;			// entry in use
+	    l2addr_154 addr ;		// master address
+	    long int hlid ;		// last hello-id (-1 if unknown)
+	    time_t lastseen ;		// time of last frame received
+	    uint8_t lq ;		// link quality (smoothed LQI)
+	    time_t sttl ;		// slave ttl of the association (0: none)
+	    int mtu ;			// mtu given in the association
+	    time_t assoctime ;		// time of the association
+	} casanmaster;
+
+
 	typedef struct reslist
 	{
 	    Resource *res ;
@@ -78,8 +186,13 @@
 	typedef struct casan {
 		reslist *reslist_ ;
 
-		time_t curtime_ ;
+		time_t curtime_ ;		// current time of this engine
+		Prng prng_ ;			// random generator of this engine
 		Retrans *retrans_ ;
+		Pending *pending_ ;		// delayed responses
+		Blocks *blocks_ ;		// block-wise transfers
+		Dedup *dedup_ ;			// recently processed requests
+		Outq *outq_ ;			// frames waiting to be sent
 		l2addr_154 *master_ ;		// NULL <=> broadcast
 		l2net_154 *l2_ ;
 		int defmtu_ ;			// default (user specified) MTU
@@ -89,10 +202,35 @@
 		time_t sttl_ ;			// slave ttl, given in assoc msg
 		long int hlid_ ;		// hello ID
 		int curid_ ;			// current message id
-
-		// various timers handled by function
-		Twait  *twait_ ;
-		Trenew *trenew_ ;
+		uint32_t catver_ ;		// resource catalog version (hash)
+		int groupsize_ ;		// estimated # of slaves on the PAN
+		bool groupfixed_ ;		// groupsize_ given by set_leisure
+		uint32_t groupmap_ [CASAN_GROUPMAP_BITS / 32] ;	// slaves heard
+		int groupheard_ ;		// # of bits set in groupmap_
+		time_t maxleisure_ ;		// upper bound of leisure (ms)
+		int rxbudget_ ;			// max # of frames handled by loop
+		int txbudget_ ;			// max # of frames sent by loop
+
+		// queue mode (sleepy node)
+		time_t sleepperiod_ ;		// wakeup period (0: radio always on)
+		time_t listen_ ;		// listen window after each wakeup
+		bool awake_ ;			// radio on
+		time_t radiosince_ ;		// time of last radio switch
+		time_t ackwait_ ;		// end of listen extension (0: none)
+
+		NvStore *nv_ ;			// master record store (or NULL)
+		CasanNv nvlast_ ;		// last record read or written
+
+		casanmaster masters_ [CASAN_MAXMASTERS] ;	// known masters
+		int standby_ ;			// standby master index (or -1)
+		int renewtries_ ;		// unanswered renewal Discovers
+
+		// engine timers, and state of Discover/association timers
+		Timers timers_ ;
+		Twait  twait_ ;
+		Trenew trenew_ ;
+
+		CasanStat stat_ ;
 	}Casan;
 
 
@@ -110,32 +248,96 @@
 
 	void change_master (Casan *ca, long int hlid, int mtu);
 
+	casanmaster *track_master (Casan *ca, l2addr_154 *a, long int hlid);
+
+	casanmaster *get_standby (Casan *ca);
+
 	void register_resource (Casan *ca, Resource *res);
 
+	void unregister_resource (Casan *ca, Resource *res);
+
+	uint32_t catalog_version (Casan *ca);
+
+	void push_catalog_etag (Msg *m, optcode_t c, uint32_t ver);
+
+	bool is_catalog_etag (Msg *m, uint32_t ver);
+
+	void send_catalog_delta (Casan *ca, Resource *res, bool added, uint32_t oldver);
+
 	void process_request (Casan *ca, Msg *in, Msg *out);
 
 	void request_resource (Msg *pin, Msg *pout, Resource *res);
 
+	bool is_response_suppressed (Msg *in, uint8_t code);
+
+	void set_leisure (Casan *ca, int groupsize, time_t maxleisure);
+
+	void group_heard (Casan *ca, l2addr_154 *src);
+
+	void set_rx_budget (Casan *ca, int budget);
+
+	void set_tx_budget (Casan *ca, int budget);
+
+	void set_queue_mode (Casan *ca, time_t period, time_t listen);
+
+	void set_nvstore (Casan *ca, NvStore *nv);
+
+	bool save_master (Casan *ca);
+
+	bool restore_master (Casan *ca);
+
+	time_t get_leisure (Casan *ca, Msg *out);
+
+	void send_response (Casan *ca, Msg *in, Msg *out, l2addr_154 *dest);
+
+	bool deduplicate (Casan *ca, Msg *in, l2addr_154 *src);
+
 	void check_observed_resources (Casan *ca, Msg *out);
 
+	constatus_t send_confirmable (Casan *ca, Msg *m, l2addr_154 *dest, con_cb_t cb, void *arg);
+
+	constatus_t notify_resource (Casan *ca, Resource *res);
+
+	char *render_well_known (Casan *ca, size_t *len);
+
 	bool get_well_known (Casan *ca, Msg *out);
 
 	Resource *get_resource (Casan *ca, const char *name);
 
 	void loop (Casan *ca);
 
+	time_t casan_next_deadline (Casan *ca);
+
 	bool is_ctl_msg (Msg *m);
 
+	bool is_request (Msg *m);
+
 	bool is_hello (Msg *m, long int *hlid);
 
+	bool is_discover (Msg *m);
+
 	bool is_assoc (Msg *m, time_t *sttl, int *mtu);
 
 	void mk_ctl_msg (Msg *out);
 
 	void send_discover (Casan *ca, Msg *out);
 
+	void send_awake (Casan *ca, Msg *out);
+
 	void send_assoc_answer (Casan *ca, Msg *in, Msg *out);
 
+	PROCESS_NAME (casan_process);
+
+	void start_casan_process (Casan *ca);
+
+	void casan_poll (void);
+
+	CasanStat *get_casan_stat (Casan *ca);
+
+	rtoest *get_rto_stat (Casan *ca);
+
+	oqstat *get_outq_stat (Casan *ca, oqclass_t cls);
+
 	void print_resources (Casan *ca);
 
 	void print_coap_ret_type (l2_recv_t ret);
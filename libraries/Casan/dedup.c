@@ -0,0 +1,116 @@
+#include "dedup.h"
+
+static void del_entry (dedupent *de)
+{
+    free (de->frame) ;
+    de->frame = NULL ;
+    de->len = 0 ;
+    de->used = false ;
+}
+
+/*Destructor*/
+void freeDedup (Dedup *dd)
+{
+    resetDedup (dd) ;
+    free (dd) ;
+}
+
+Dedup *initDedup (void)
+{
+	Dedup *dd = (Dedup *) malloc (sizeof (Dedup)) ;
+	if (dd == NULL)
+		printf("Memory allocation failed\n");
+    memset (dd, 0, sizeof *dd) ;
+    return dd ;
+}
+
+
+void resetDedup (Dedup *dd)
+{
+    int i ;
+
+    for (i = 0 ; i < DEDUP_MAX ; i++)
+		if (dd->de_ [i].used)
+		    del_entry (&dd->de_ [i]) ;
+}
+
+
+// forget requests whose exchange lifetime is over
+void loopDedup (Dedup *dd, time_t *curtime)
+{
+    int i ;
+
+    for (i = 0 ; i < DEDUP_MAX ; i++)
+		if (dd->de_ [i].used && dd->de_ [i].expire <= *curtime)
+		    del_entry (&dd->de_ [i]) ;
+}
+
+
+/*
+ * Look for a request already processed. Returns NULL if this
+ * request (source address, message id) is new.
+ */
+
+dedupent *getDedup (Dedup *dd, l2addr_154 *src, uint16_t id)
+{
+    int i ;
+
+    for (i = 0 ; i < DEDUP_MAX ; i++)
+    {
+		dedupent *de = &dd->de_ [i] ;
+
+		if (de->used && de->id == id && isEqualAddr (&de->src, src))
+		    return de ;
+    }
+    return NULL ;
+}
+
+
+/*
+ * Remember a processed request, with a copy of the encoded response
+ * if one has been sent (resp may be NULL or not encoded if the
+ * response was suppressed). If the cache is full, the entry with
+ * the nearest expiration (i.e. the oldest one) is reused.
+ * Returns false if the response cannot be copied.
+ */
+
+bool addDedup (Dedup *dd, l2addr_154 *src, uint16_t id, Msg *resp, time_t *curtime)
+{
+    dedupent *de ;
+    int i ;
+
+    de = getDedup (dd, src, id) ;
+    if (de == NULL)
+    {
+		de = &dd->de_ [0] ;
+		for (i = 0 ; i < DEDUP_MAX ; i++)
+		{
+		    if (! dd->de_ [i].used)
+		    {
+				de = &dd->de_ [i] ;
+				break ;
+		    }
+		    if (dd->de_ [i].expire < de->expire)
+				de = &dd->de_ [i] ;
+		}
+    }
+    if (de->used)
+		del_entry (de) ;
+
+    if (resp != NULL && resp->encoded_ != NULL && resp->enclen_ > 0)
+    {
+		de->frame = (uint8_t *) malloc (resp->enclen_) ;
+		if (de->frame == NULL)
+		{
+		    printf("Memory allocation failed\n");
+		    return false ;
+		}
+		memcpy (de->frame, resp->encoded_, resp->enclen_) ;
+		de->len = resp->enclen_ ;
+    }
+    copyAddr (&de->src, src) ;
+    de->id = id ;
+    de->expire = *curtime + EXCHANGE_LIFETIME ;
+    de->used = true ;
+    return true ;
+}
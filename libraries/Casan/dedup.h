@@ -0,0 +1,55 @@
+#ifndef __DEDUP_H__
+#define __DEDUP_H__
+
+/*
+ * Message deduplication (RFC 7252 section 4.5)
+ *
+ * This class remembers the requests recently processed, keyed by
+ * the source address and the message id, for EXCHANGE_LIFETIME.
+ * The encoded response is kept along with the request, such that a
+ * duplicate request (retransmitted by the master because our ACK was
+ * lost) is answered by sending the same bytes again, without calling
+ * the resource handler another time. Thus, handlers with side effects
+ * (actuators) are not triggered twice, and the response is the same.
+ *
+ * The cache is bounded: when it is full, the oldest entry is
+ * forgotten. The loop function must be called periodically in order
+ * to expire entries.
+ */
+
+#include "msg.h"
+#include "time.h"
+
+#define	DEDUP_MAX	8		// max number of remembered requests
+
+
+typedef struct dedupent
+{
+    bool used ;			// entry in use
+    l2addr_154 src ;		// source of the request (key)
+    uint16_t id ;		// message id of the request (key)
+    time_t expire ;		// end of exchange lifetime
+    uint8_t *frame ;		// encoded response (NULL if none sent)
+    uint16_t len ;		// length of encoded response
+} dedupent;
+
+
+typedef struct dedup {
+	dedupent de_ [DEDUP_MAX] ;
+} Dedup;
+
+
+Dedup *initDedup (void);
+
+void freeDedup (Dedup *dd);
+
+void resetDedup (Dedup *dd);
+
+void loopDedup (Dedup *dd, time_t *curtime);
+
+dedupent *getDedup (Dedup *dd, l2addr_154 *src, uint16_t id);
+
+bool addDedup (Dedup *dd, l2addr_154 *src, uint16_t id, Msg *resp, time_t *curtime);
+
+
+#endif
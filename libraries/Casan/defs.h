@@ -50,7 +50,16 @@
 #define	ACK_RANDOM_FACTOR	1.5
  // CoAP maximum number of retransmissions
 #define MAX_RETRANSMIT	4
-
-#define ALEA(x) x
+// CoAP maximum number of outstanding CON messages for a peer
+#define	NSTART		1
+// upper bound of the initial timeout for CON messages
+#define	ACK_TIMEOUT_MAX	((uint32_t) (ACK_TIMEOUT * ACK_RANDOM_FACTOR))
+// CoAP maximum time a datagram is expected to take (milliseconds)
+#define	MAX_LATENCY	100000
+// CoAP time from the first transmission of a CON to its last retransmission
+#define	MAX_TRANSMIT_SPAN	((uint32_t) (ACK_TIMEOUT_MAX * ((1 << MAX_RETRANSMIT) - 1)))
+// CoAP time from the first transmission of a CON until the sender gives up
+// (RFC 7252 section 4.8.2, processing delay taken as ACK_TIMEOUT)
+#define	EXCHANGE_LIFETIME	(MAX_TRANSMIT_SPAN + 2 * MAX_LATENCY + ACK_TIMEOUT)
 
 #endif
\ No newline at end of file
@@ -28,8 +28,8 @@ Constructor, destructor, operators
 
 /* free Msg */
 void freeMsg(Msg *m){
-	free(m->payload_);
-	free(m->encoded_);
+	resetMsg(m);
+	free(m->token_);
 	free(m);
 }
 
@@ -94,10 +94,15 @@ void resetMsg(Msg *m) {
 	l2 = m->l2_;
 	if(m->payload_ != NULL)
 		free (m->payload_);
+	m->payload_ = NULL;
+	m->paylen_ = 0;
 	if (m->encoded_ != NULL)
 		free (m->encoded_);
+	m->encoded_ = NULL;
+	m->enclen_ = 0;
 	while (m->optlist_ != NULL)
 		freeOption(pop_option(m));
+	m->curopt_initialized_ = false;
 	m->l2_ = l2;
 }
 
@@ -129,7 +134,7 @@ uint8_t *get_payload_msg (Msg *m)	{ return m->payload_ ; }
 void set_type    (Msg *m, uint8_t t)	{ m->type_ = t ; }
 void set_code    (Msg *m, uint8_t c)	{ m->code_ = c ; }
 void set_id      (Msg *m, uint16_t id)	{ m->id_ = id ; }
-void set_token_msg   (Msg *m, token *tok)	{ m->token_ = tok ; }
+void set_token_msg   (Msg *m, token *tok)	{ *m->token_ = *tok ; }
 
 
 
@@ -338,24 +343,45 @@ bool coap_decode (Msg *m, uint8_t rbuf [], size_t len, bool truncated)
 bool sendMsg (Msg *m, l2addr_154 *dest) 
 {
 	int success ;
+
+	success = encodeMsg (m) ;
+	if (success)
+    {	
+		success = send (m->l2_, dest, m->encoded_, m->enclen_) ;
+		if (! success)
+		    printf ("%s",RED ("Cannot L2-send the message\n")) ;	
+    }
+    return success;
+}
+
+
+
+/**
+ * @brief Encode a message, if not already done
+ *
+ * Memory is allocated for the encoded message (see `sendMsg`),
+ * which is then available in the `encoded_` and `enclen_` attributes.
+ *
+ * @return true if encoding was successfull
+ */
+
+bool encodeMsg (Msg *m)
+{
+	int success ;
+
 	if (m->encoded_ == NULL)
     {
     	m->enclen_ = maxpayload (m->l2_) ;// exploitable size
 		m->encoded_ = (uint8_t *) malloc (m->enclen_) ;
 		success = coap_encode (m, m->encoded_, &m->enclen_) ;
 		if (! success)
+		{
 	   		printf ("%s",RED ("Cannot encode the message\n")) ;
+	    	free (m->encoded_) ;
+			m->encoded_ = NULL ;
+		}
 	} else success = true ;			// if msg is already encoded
 
-	if (success)
-    {	
-		success = send (m->l2_, dest, m->encoded_, m->enclen_) ;
-		if (! success)
-		    printf ("%s",RED ("Cannot L2-send the message\n")) ;	
-    } else {
-    	free (m->encoded_) ;
-		m->encoded_ = NULL ;
-    }
     return success;
 }
 
@@ -451,6 +477,7 @@ bool coap_encode (Msg *m, uint8_t sbuf [], uint16_t *sbuflen)
 		    }
 		    else if (opt_len >= 13)		// len \in [13..268] => 1 byte
 		    {
+				opt_len -= 13 ;
 				sbuf [i++] = BYTE_LOW (opt_len) ;
 				sbuf [posoptheader] |= 0x0d ;
 		    }
@@ -765,7 +792,7 @@ content_format get_content_format (Msg *m)
     cf = cf_none ;		// not found by default ;
     for (ol = m->optlist_ ; ol != NULL ; ol = ol->next)
     {
-		if (getOptCode (ol->o) == MO_Content_Format)
+		if (getOptcode (ol->o) == MO_Content_Format)
 		{
 		    cf = (content_format) getOptvalInteger (ol->o) ;
 		    break ;
@@ -807,7 +834,7 @@ void set_content_format (Msg *m, bool reset, content_format cf)
     {
 		option *ocf ;
 
-		ocf = initOptionInteger (MO_Content_Format, cf_text_plain) ;
+		ocf = initOptionInteger (MO_Content_Format, cf) ;
 		push_option (m, ocf) ;
 		freeOption(ocf) ;
     }
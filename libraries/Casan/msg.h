@@ -14,6 +14,17 @@
 
 #define COAP_RETURN_CODE(x,y) ((x << 5) | (y & 0x1f))
 
+#define	COAP_CODE_VALID		COAP_RETURN_CODE (2, 3)
+#define	COAP_CODE_OK		COAP_RETURN_CODE (2, 5)
+#define	COAP_CODE_CONTINUE	COAP_RETURN_CODE (2,31)
+#define	COAP_CODE_BAD_REQUEST	COAP_RETURN_CODE (4, 0)
+#define	COAP_CODE_BAD_OPTION	COAP_RETURN_CODE (4, 2)
+#define	COAP_CODE_NOT_FOUND	COAP_RETURN_CODE (4, 4)
+#define	COAP_CODE_NOT_ALLOWED	COAP_RETURN_CODE (4, 5)
+#define	COAP_CODE_INCOMPLETE	COAP_RETURN_CODE (4, 8)
+#define	COAP_CODE_TOO_LARGE	COAP_RETURN_CODE (4,13)
+#define	COAP_CODE_UNPROCESSABLE	COAP_RETURN_CODE (4,22)	// RFC 8132
+
 // the offset to get pieces of information in the MAC payload
 #define	COAP_OFFSET_TYPE	0
 #define	COAP_OFFSET_TKL		0
@@ -28,9 +39,14 @@ typedef enum coap_code {
     COAP_CODE_GET,
     COAP_CODE_POST,
     COAP_CODE_PUT,
-    COAP_CODE_DELETE
+    COAP_CODE_DELETE,
+    COAP_CODE_FETCH,			// RFC 8132
+    COAP_CODE_PATCH,			// RFC 8132
+    COAP_CODE_IPATCH,			// RFC 8132
 } coap_code_t;
 
+#define	COAP_NB_METHODS		(COAP_CODE_IPATCH + 1)
+
 /** CoAP message types */
 typedef enum coap_type {
     COAP_TYPE_CON = 0,
@@ -49,8 +65,9 @@ typedef enum coap_type {
  * received from the network.
  *
  * Message attributes are tied to CoAP specification: a message has
- * a type (CON, NON, ACK, RST), a code (GET, POST, PUT, DELETE, or a numeric
- * value for an answer in an ACK), an Id, a token, some options and
+ * a type (CON, NON, ACK, RST), a code (GET, POST, PUT, DELETE, FETCH,
+ * PATCH, iPATCH, or a numeric value for an answer in an ACK), an Id,
+ * a token, some options and
  * a payload.
  *
  * In order to be sent to the network, a message is transparently
@@ -122,6 +139,8 @@ typedef enum coap_type {
 
 	bool sendMsg (Msg *m, l2addr_154 *dest);
 
+	bool encodeMsg (Msg *m);
+
 	bool coap_encode (Msg *m, uint8_t sbuf [], uint16_t *sbuflen);
 
 	size_t coap_size (Msg *m, bool emulpayload);
@@ -0,0 +1,96 @@
+#include "nvstore.h"
+#include "cfs/cfs.h"
+
+/******************************************************************************
+ * CFS store
+ */
+
+static bool cfs_read_record (NvStore *nv, void *buf, size_t len)
+{
+    int fd, n ;
+
+    fd = cfs_open (nv->name_, CFS_READ) ;
+    if (fd < 0)
+		return false ;
+    n = cfs_read (fd, buf, len) ;
+    cfs_close (fd) ;
+    return n == (int) len ;
+}
+
+
+static bool cfs_write_record (NvStore *nv, const void *buf, size_t len)
+{
+    int fd, n ;
+
+    cfs_remove (nv->name_) ;		// write a new record from scratch
+    fd = cfs_open (nv->name_, CFS_WRITE) ;
+    if (fd < 0)
+		return false ;
+    n = cfs_write (fd, buf, len) ;
+    cfs_close (fd) ;
+    return n == (int) len ;
+}
+
+
+/******************************************************************************
+ * Store
+ */
+
+/*Destructor*/
+void freeNvStore (NvStore *nv)
+{
+    free (nv) ;
+}
+
+NvStore *initNvStore (nvread_t rd, nvwrite_t wr, void *arg)
+{
+	NvStore *nv = (NvStore *) malloc (sizeof (NvStore)) ;
+	if (nv == NULL)
+		printf("Memory allocation failed\n");
+    nv->read_ = rd ;
+    nv->write_ = wr ;
+    nv->arg_ = arg ;
+    nv->name_ [0] = '\0' ;
+    return nv ;
+}
+
+
+/**
+ * @brief Create a store in a CFS file
+ *
+ * @param name file name (truncated to NVSTORE_NAMELEN-1 characters)
+ */
+
+NvStore *initNvCfs (const char *name)
+{
+    NvStore *nv ;
+
+    nv = initNvStore (cfs_read_record, cfs_write_record, NULL) ;
+    strncpy (nv->name_, name, NVSTORE_NAMELEN - 1) ;
+    nv->name_ [NVSTORE_NAMELEN - 1] = '\0' ;
+    return nv ;
+}
+
+
+/**
+ * @brief Read the record
+ *
+ * @return false if there is no record (or a shorter one)
+ */
+
+bool readNvStore (NvStore *nv, void *buf, size_t len)
+{
+    return (*nv->read_) (nv, buf, len) ;
+}
+
+
+/**
+ * @brief Write the record
+ *
+ * @return false if the record cannot be written
+ */
+
+bool writeNvStore (NvStore *nv, const void *buf, size_t len)
+{
+    return (*nv->write_) (nv, buf, len) ;
+}
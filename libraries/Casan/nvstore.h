@@ -0,0 +1,50 @@
+#ifndef __NVSTORE_H__
+#define __NVSTORE_H__
+
+/*
+ * Non-volatile storage
+ *
+ * This class provides a small record which survives a reboot. The
+ * CASAN engine uses it to remember its master (see `set_nvstore`).
+ *
+ * The storage is pluggable: a store is a pair of read/write functions.
+ * The default implementation uses the Contiki File System (CFS), i.e.
+ * the Coffee file system in flash memory on a node, or a regular file
+ * with the native platform on a host. Another store (EEPROM, etc.)
+ * may be provided by the application with `initNvStore`.
+ *
+ * The whole record is read or written at once. Writes should be rare
+ * (flash memory wears out): the caller must only write a changed record.
+ */
+
+#include "defs.h"
+#include "contiki.h"
+#include "stdbool.h"
+
+#define	NVSTORE_NAMELEN	16		// max length of a CFS file name
+
+struct nvstore ;
+
+typedef bool (*nvread_t) (struct nvstore *nv, void *buf, size_t len) ;
+typedef bool (*nvwrite_t) (struct nvstore *nv, const void *buf, size_t len) ;
+
+typedef struct nvstore {
+	nvread_t read_ ;
+	nvwrite_t write_ ;
+	void *arg_ ;			// argument for the store functions
+	char name_ [NVSTORE_NAMELEN] ;	// file name (CFS store)
+} NvStore;
+
+
+NvStore *initNvStore (nvread_t rd, nvwrite_t wr, void *arg);
+
+NvStore *initNvCfs (const char *name);
+
+void freeNvStore (NvStore *nv);
+
+bool readNvStore (NvStore *nv, void *buf, size_t len);
+
+bool writeNvStore (NvStore *nv, const void *buf, size_t len);
+
+
+#endif
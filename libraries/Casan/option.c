@@ -6,13 +6,11 @@
 #include "option.h"
 
 
-static uint8_t errno_ = 0 ;
-
-
 #define RESET(op)       do {                    \
                 op->optcode_ = MO_None ;        \
                 op->optlen_ = 0 ;           \
                 op->optval_ = 0 ;           \
+                op->errno_ = 0 ;            \
             } while (false)             // no " ;"
 #define COPY_VAL(op,p) do {                    \
                 byte *b ;               \
@@ -56,7 +54,7 @@ static uint8_t errno_ = 0 ;
             } while (false)             // no " ;"
 
 
-static optdesc optdesc_ [] =
+static const optdesc optdesc_ [] =
 {
     { MO_Content_Format,	OF_OPAQUE,	0, 8	},
     { MO_Etag,			OF_OPAQUE,	1, 8	},
@@ -72,7 +70,12 @@ static optdesc optdesc_ [] =
     { MO_Accept,		OF_UINT,	0, 2	},
     { MO_If_None_Match,		OF_EMPTY,	0, 0	},
     { MO_If_Match,		OF_OPAQUE,	0, 8	},
-    { MO_Observe,		OF_UINT,	0, 3	}
+    { MO_Observe,		OF_UINT,	0, 3	},
+    { MO_Block2,		OF_UINT,	0, 3	},
+    { MO_Block1,		OF_UINT,	0, 3	},
+    { MO_Size2,			OF_UINT,	0, 4	},
+    { MO_Size1,			OF_UINT,	0, 4	},
+    { MO_No_Response,		OF_UINT,	0, 1	},
 } ;
 
 
@@ -80,9 +83,17 @@ static optdesc optdesc_ [] =
  * Utilities
  */
 
-byte uint_to_byte (uint val, int *len) {
+/**
+ * Pack an integer value in the minimal string of bytes (network byte
+ * order, without leading null bytes) according to CoAP specification
+ *
+ * @param val integer value
+ * @param stbin buffer of at least sizeof (uint) bytes
+ * @param len address of an integer which will contain the length
+ */
+
+void uint_to_byte (uint val, byte *stbin, int *len) {
 
-    byte stbin [sizeof (uint)] ;
     int shft ;
 
     // translate in network byte order, without leading null bytes
@@ -92,10 +103,9 @@ byte uint_to_byte (uint val, int *len) {
         byte b ;
 
         b = (val >> (shft * 8)) & 0xff ;
-        if (len != 0 || b != 0)
-            stbin [*len++] = b ;
+        if (*len != 0 || b != 0)
+            stbin [(*len)++] = b ;
     }
-    return *stbin ;
 }
 
 
@@ -135,14 +145,13 @@ option *initOptionEmpty (optcode_t optcode) {
     option *op = (option *) malloc (sizeof(struct option));
     if (op == NULL)
         printf("Memory allocation failed\n");
-    op->optlen_ = 0;
+    RESET(op);
     bool err = false ;
     CHK_OPTCODE (optcode, err) ;
     if (err) {
         printf("option::optval err: CHK_OPTCODE 1\n" );
-        errno_ = OPT_ERR_OPTCODE ;
+        op->errno_ = OPT_ERR_OPTCODE ;
     }
-    RESET(op);
     op->optcode_ = optcode;
     return op;
 }
@@ -164,18 +173,18 @@ option *initOptionEmpty (optcode_t optcode) {
     option *op = (option *)malloc (sizeof(struct option));
     if (op == NULL)
         printf("Memory allocation failed\n");
+    RESET(op) ;
     bool err = false ;
     CHK_OPTCODE (optcode, err) ;
     if (err) {
         printf("option::optval err: CHK_OPTCODE 2") ;
-        errno_ = OPT_ERR_OPTCODE ;
+        op->errno_ = OPT_ERR_OPTCODE ;
     }
     CHK_OPTLEN (optcode, optlen, err) ;
     if (err) {
         printf("option::optval err: CHK_OPTLEN 2") ;
-        errno_ = OPT_ERR_OPTLEN ;
+        op->errno_ = OPT_ERR_OPTLEN ;
     }
-    RESET(op) ;
     op->optcode_ = optcode ;
     op->optlen_ = optlen ;
     COPY_VAL(op, optval);   
@@ -200,22 +209,22 @@ option *initOptionInteger (optcode_t optcode, uint optval)
     if (op == NULL)
         printf("Memory allocation failed\n");
     bool err ;
-    byte stbin ; 
+    byte stbin [sizeof (uint)] ;
     int len;
 
-    stbin = uint_to_byte (optval, &len) ;
+    RESET(op) ;
+    uint_to_byte (optval, stbin, &len) ;
     err = false ;
     CHK_OPTCODE (optcode, err) ;
     if (err) {
         printf("option::optval err: CHK_OPTCODE 3\n") ;
-        errno_ = OPT_ERR_OPTCODE ;
+        op->errno_ = OPT_ERR_OPTCODE ;
     }
     CHK_OPTLEN (optcode, len, err) ;
     if (err) {
         printf ("option::optval err: CHK_OPTLEN 3\n") ;
-        errno_ = OPT_ERR_OPTLEN ;
+        op->errno_ = OPT_ERR_OPTLEN ;
     }       
-    RESET(op) ;
     op->optcode_ = optcode ;
     op->optlen_ = len ;
     COPY_VAL (op,stbin) ;
@@ -348,7 +357,7 @@ uint getOptvalInteger (option *o)
     v = 0 ;
     b = (o->optval_ == 0) ? o->staticval_ : o->optval_ ;
     for (i = 0 ; i < o->optlen_ ; i++)
-        v = (v << 8) & b [i] ;
+        v = (v << 8) | b [i] ;
     return v ;
 }
 
@@ -393,16 +402,16 @@ void setOptvalOpaque (option *o, void *val, int len)
 void setOptvalInteger (option *o, uint val)
 {
     bool err ;
-    byte stbin ;
+    byte stbin [sizeof (uint)] ;
     int len ;
 
-    stbin = uint_to_byte (val, &len) ;
+    uint_to_byte (val, stbin, &len) ;
     err = false ;
     CHK_OPTLEN (o->optcode_, len, err) ;
     if (err)
     {
         printf("option::optval err: CHK_OPTLEN\n") ;
-        errno_ = OPT_ERR_OPTLEN ;
+        o->errno_ = OPT_ERR_OPTLEN ;
         return ;
     }
     o->optlen_ = len ;
@@ -425,18 +434,18 @@ int getOptlen (const option *o)
 
 
 /**
- * Returns the last error encountered during an option assignment
+ * Returns the last error encountered during an assignment of this option
  */
 
-uint8_t get_errno (void)
+uint8_t get_errno (const option *o)
 {
-    return errno_ ;
+    return o->errno_ ;
 }
 
 void printOption (const option *o)
 {
     printf ("%s : %s=", YELLOW ("OPTION"), RED ("optcode")) ;
-    switch ((unsigned char) o->optcode_)
+    switch ((int) o->optcode_)
     {
     case MO_None        : printf("MO_None") ; break ;
     case MO_Content_Format  : printf("MO_Content_Format") ; break;
@@ -453,9 +462,15 @@ void printOption (const option *o)
     case MO_Accept      : printf("MO_Accept") ; break ;
     case MO_If_None_Match   : printf("MO_If_None_Match") ; break ;
     case MO_If_Match    : printf("MO_If_Match") ; break ;
+    case MO_Size1       : printf("MO_Size1") ; break ;
+    case MO_Observe     : printf("MO_Observe") ; break ;
+    case MO_Block2      : printf("MO_Block2") ; break ;
+    case MO_Block1      : printf("MO_Block1") ; break ;
+    case MO_Size2       : printf("MO_Size2") ; break ;
+    case MO_No_Response : printf("MO_No_Response") ; break ;
     default :
         printf ("%s", RED ("ERROR")) ;
-        printf("%d", (unsigned char) o->optcode_) ;
+        printf("%d", (int) o->optcode_) ;
         break ;
     }
     printf ("/%d", o->optcode_) ;
@@ -483,7 +498,7 @@ void printOption (const option *o)
 }
 
 
-void reset_errno (void)
+void reset_errno (option *o)
 {
-    errno_ = 0 ;
+    o->errno_ = 0 ;
 }
\ No newline at end of file
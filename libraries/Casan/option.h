@@ -71,9 +71,22 @@
 	    MO_If_Match		= 1,
 	    MO_Size1		= 60,
 	    MO_Observe		= 6,		// Observe draft
+	    MO_Block2		= 23,		// RFC 7959
+	    MO_Block1		= 27,		// RFC 7959
+	    MO_Size2		= 28,		// RFC 7959
+	    MO_No_Response	= 258,		// RFC 7967
 	} optcode_t ;
 	typedef unsigned long int uint ;
 
+	/*
+	 * No-Response option values (RFC 7967): each bit expresses
+	 * the requester's disinterest in a response class
+	 */
+
+#define	NR_SUPPRESS_2XX		0x02	// not interested in 2.xx responses
+#define	NR_SUPPRESS_4XX		0x08	// not interested in 4.xx responses
+#define	NR_SUPPRESS_5XX		0x10	// not interested in 5.xx responses
+
 
 	typedef enum {
 	    cf_none		= -1,		// non-existent option
@@ -88,10 +101,9 @@
 		int optlen_ ;
 		byte *optval_ ;			// 0 if staticval is used
 		byte staticval_ [8 + 1] ;	// keep a \0 after, just in case
+		uint8_t errno_ ;		// last error on this option (or 0)
 	} option;
 
-	static uint8_t errno_ ;
-
 	typedef enum
 	{
 	    OF_NONE		 = 0,
@@ -108,9 +120,8 @@
 	    int minlen ;
 	    int maxlen ;
 	} optdesc;
-	static optdesc optdesc_ [] ;
 
-	byte uint_to_byte (uint val, int *len) ;
+	void uint_to_byte (uint val, byte *stbin, int *len) ;
 
 	void freeOption( option *op);
 
@@ -152,10 +163,10 @@
 
 	int getOptlen (const option *o);
 
-	uint8_t get_errno (void);
+	uint8_t get_errno (const option *o);
 
 	void printOption (const option *o);
 
-	void reset_errno (void);
+	void reset_errno (option *o);
 
 #endif
@@ -0,0 +1,135 @@
+#include "outq.h"
+
+static const uint8_t depth [OQ_NCLASS] =
+{
+    OUTQ_DEPTH_CONTROL,
+    OUTQ_DEPTH_RESPONSE,
+    OUTQ_DEPTH_RETRANS,
+    OUTQ_DEPTH_NOTIFY,
+} ;
+
+/*Destructor*/
+void freeOutq (Outq *oq)
+{
+    free (oq) ;
+}
+
+Outq *initOutq (l2net_154 *l2)
+{
+	Outq *oq = (Outq *) malloc (sizeof (Outq)) ;
+	int c, base ;
+
+	if (oq == NULL)
+		printf("Memory allocation failed\n");
+    memset (oq, 0, sizeof *oq) ;
+    oq->l2_ = l2 ;
+    base = 0 ;
+    for (c = 0 ; c < OQ_NCLASS ; c++)
+    {
+		oq->fifo_ [c].base = base ;
+		oq->fifo_ [c].max = depth [c] ;
+		base += depth [c] ;
+    }
+    return oq ;
+}
+
+
+// forget all waiting frames (statistics are kept)
+void resetOutq (Outq *oq)
+{
+    int c ;
+
+    for (c = 0 ; c < OQ_NCLASS ; c++)
+		oq->fifo_ [c].head = oq->fifo_ [c].n = 0 ;
+}
+
+
+/**
+ * @brief Queue a frame for transmission
+ *
+ * The frame is copied, such that the caller may reuse its buffer
+ * as soon as this function returns.
+ *
+ * @param cls traffic class of the frame
+ * @param dest destination address
+ * @param frame encoded message
+ * @param len length of encoded message
+ * @return false if the frame has been dropped (FIFO of this class
+ *	full, or frame too large)
+ */
+
+bool addOutq (Outq *oq, oqclass_t cls, l2addr_154 *dest, const uint8_t *frame, size_t len)
+{
+    oqfifo *q = &oq->fifo_ [cls] ;
+    outframe *f ;
+
+    if (q->n >= q->max || len > OUTQ_FRAMEMAX)
+    {
+		q->stat.dropped++ ;
+		return false ;
+    }
+
+    f = &oq->slot_ [q->base + (q->head + q->n) % q->max] ;
+    f->dest = *dest ;
+    f->len = len ;
+    memcpy (f->frame, frame, len) ;
+
+    q->n++ ;
+    q->stat.queued++ ;
+    if (q->n > q->stat.depth_max)
+		q->stat.depth_max = q->n ;
+    return true ;
+}
+
+
+/**
+ * @brief Send waiting frames, highest priority class first
+ *
+ * A lower priority frame is sent only if all higher priority FIFOs
+ * are empty.
+ *
+ * @param budget max number of frames sent by this call
+ * @return number of frames sent
+ */
+
+int loopOutq (Outq *oq, int budget)
+{
+    int c, nsent ;
+
+    nsent = 0 ;
+    for (c = 0 ; c < OQ_NCLASS && nsent < budget ; c++)
+    {
+		oqfifo *q = &oq->fifo_ [c] ;
+
+		while (q->n > 0 && nsent < budget)
+		{
+		    outframe *f = &oq->slot_ [q->base + q->head] ;
+
+		    if (! send (oq->l2_, &f->dest, f->frame, f->len))
+				printf ("%s", RED ("Cannot L2-send the queued frame\n")) ;
+		    q->head = (q->head + 1) % q->max ;
+		    q->n-- ;
+		    q->stat.sent++ ;
+		    nsent++ ;
+		}
+    }
+    return nsent ;
+}
+
+
+// number of frames waiting in all classes
+int lenOutq (Outq *oq)
+{
+    int c, n ;
+
+    n = 0 ;
+    for (c = 0 ; c < OQ_NCLASS ; c++)
+		n += oq->fifo_ [c].n ;
+    return n ;
+}
+
+
+oqstat *getStatOutq (Outq *oq, oqclass_t cls)
+{
+    return &oq->fifo_ [cls].stat ;
+}
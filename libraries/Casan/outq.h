@@ -0,0 +1,93 @@
+#ifndef __OUTQ_H__
+#define __OUTQ_H__
+
+/*
+ * Outbound frame scheduler
+ *
+ * Frames sent by the CASAN engine (control messages, responses,
+ * retransmissions, observe notifications) are not sent immediately:
+ * they are copied in this queue, and sent by the loop function in
+ * strict priority order:
+ *	control > responses > retransmissions > notifications
+ * Hence, a burst of notifications cannot delay a Discover or an
+ * association answer: association health does not depend on the
+ * application traffic.
+ *
+ * Each class has its own FIFO with a depth limit. When a FIFO is
+ * full, the new frame is dropped and counted in the statistics of
+ * its class.
+ *
+ * Frames are stored in fixed slots, without any dynamic allocation.
+ */
+
+#include "msg.h"
+
+#define	OUTQ_DEPTH_CONTROL	2	// max # of control frames
+#define	OUTQ_DEPTH_RESPONSE	4	// max # of responses
+#define	OUTQ_DEPTH_RETRANS	4	// max # of retransmissions
+#define	OUTQ_DEPTH_NOTIFY	4	// max # of notifications
+#define	OUTQ_SLOTS	(OUTQ_DEPTH_CONTROL + OUTQ_DEPTH_RESPONSE \
+			    + OUTQ_DEPTH_RETRANS + OUTQ_DEPTH_NOTIFY)
+#define	OUTQ_FRAMEMAX	I154_MTU	// max size of a queued frame
+
+/** Traffic classes, by decreasing priority */
+typedef enum
+{
+    OQ_CONTROL = 0,			// Discover, association answer
+    OQ_RESPONSE,			// responses to requests
+    OQ_RETRANS,				// retransmissions of CON messages
+    OQ_NOTIFY,				// first transmission of CON messages
+    OQ_NCLASS
+} oqclass_t ;
+
+
+typedef struct oqstat
+{
+    int queued ;		// frames accepted in the queue
+    int sent ;			// frames sent
+    int dropped ;		// frames dropped (FIFO full or too large)
+    int depth_max ;		// max # of frames waiting in the FIFO
+} oqstat;
+
+
+typedef struct outframe
+{
+    l2addr_154 dest ;
+    uint8_t len ;
+    uint8_t frame [OUTQ_FRAMEMAX] ;
+} outframe;
+
+
+typedef struct oqfifo
+{
+    uint8_t base ;		// first slot of this class in slot_
+    uint8_t max ;		// depth limit (# of slots)
+    uint8_t head ;		// oldest frame (index from base)
+    uint8_t n ;			// # of frames waiting
+    oqstat stat ;
+} oqfifo;
+
+
+typedef struct outq {
+	l2net_154 *l2_ ;
+	oqfifo fifo_ [OQ_NCLASS] ;
+	outframe slot_ [OUTQ_SLOTS] ;
+} Outq;
+
+
+Outq *initOutq (l2net_154 *l2);
+
+void freeOutq (Outq *oq);
+
+void resetOutq (Outq *oq);
+
+bool addOutq (Outq *oq, oqclass_t cls, l2addr_154 *dest, const uint8_t *frame, size_t len);
+
+int loopOutq (Outq *oq, int budget);
+
+int lenOutq (Outq *oq);
+
+oqstat *getStatOutq (Outq *oq, oqclass_t cls);
+
+
+#endif
@@ -0,0 +1,158 @@
+/**
+ * @file patch.c
+ * @brief Helpers for partial resource access (FETCH/PATCH/iPATCH)
+ */
+
+#include "patch.h"
+
+/*
+ * Look for a key in a key/value document. If found, returns true and
+ * set start (beginning of key) and end (end of value, i.e. position of
+ * the separator or of the final '\0') indexes.
+ */
+
+static bool find_pair (const char *doc, const char *key, size_t klen, size_t *start, size_t *end)
+{
+    size_t i, j ;
+
+    i = 0 ;
+    while (doc [i] != '\0')
+    {
+	// find end of current pair
+	for (j = i ; doc [j] != '\0' && doc [j] != KV_SEP ; j++)
+	    ;
+	if (j - i >= klen && memcmp (doc + i, key, klen) == 0
+		&& (i + klen == j || doc [i + klen] == KV_EQ))
+	{
+	    *start = i ;
+	    *end = j ;
+	    return true ;
+	}
+	i = (doc [j] == KV_SEP) ? j + 1 : j ;
+    }
+    return false ;
+}
+
+
+/**
+ * @brief Extract some pairs from a key/value document (FETCH)
+ *
+ * @param doc key/value document (terminated by '\0')
+ * @param keys list of keys (FETCH request payload)
+ * @param keyslen length of keys
+ * @param buf buffer for the extracted pairs (terminated by '\0')
+ * @param maxlen size of buffer
+ * @return length of extracted pairs (without final '\0'), or -1 if
+ *	they do not fit in the buffer
+ */
+
+int kv_fetch (const char *doc, const uint8_t *keys, size_t keyslen, char *buf, size_t maxlen)
+{
+    size_t i, j, len ;
+
+    if (maxlen == 0)
+	return -1 ;
+
+    len = 0 ;
+    buf [0] = '\0' ;
+    for (i = 0 ; i < keyslen ; i = j + 1)
+    {
+	size_t start, end ;
+
+	for (j = i ; j < keyslen && keys [j] != KV_SEP ; j++)
+	    ;
+	if (j > i && find_pair (doc, (const char *) keys + i, j - i, &start, &end))
+	{
+	    if (len + (len > 0) + (end - start) + 1 > maxlen)
+		return -1 ;
+	    if (len > 0)
+		buf [len++] = KV_SEP ;
+	    memcpy (buf + len, doc + start, end - start) ;
+	    len += end - start ;
+	    buf [len] = '\0' ;
+	}
+    }
+    return (int) len ;
+}
+
+
+/**
+ * @brief Apply a list of changes to a key/value document (PATCH/iPATCH)
+ *
+ * Changes are applied on a copy of the document, which is replaced
+ * only if all changes succeed.
+ *
+ * @param doc key/value document (terminated by '\0'), modified in place
+ * @param maxlen size of the buffer containing the document
+ * @param patch list of changes (PATCH or iPATCH request payload)
+ * @param patchlen length of patch
+ * @return new length of document, or -1 if the patch is malformed
+ *	or if the result does not fit in the buffer
+ */
+
+int kv_patch (char *doc, size_t maxlen, const uint8_t *patch, size_t patchlen)
+{
+    char *tmp ;
+    size_t len, i, j ;
+
+    len = strlen (doc) ;
+    if (len + 1 > maxlen)
+	return -1 ;
+
+    tmp = (char *) malloc (maxlen) ;
+    if (tmp == NULL)
+    {
+	printf("Memory allocation failed\n");
+	return -1 ;
+    }
+    memcpy (tmp, doc, len + 1) ;
+
+    for (i = 0 ; i < patchlen ; i = j + 1)
+    {
+	size_t klen, start, end ;
+	const char *key ;
+
+	for (j = i ; j < patchlen && patch [j] != KV_SEP ; j++)
+	    ;
+	if (j == i)
+	    continue ;				// empty change
+
+	key = (const char *) patch + i ;
+	for (klen = 0 ; i + klen < j && key [klen] != KV_EQ ; klen++)
+	    ;
+	if (klen == 0)
+	{
+	    free (tmp) ;
+	    return -1 ;				// no key
+	}
+
+	if (find_pair (tmp, key, klen, &start, &end))
+	{
+	    // remove the existing pair and its separator
+	    if (tmp [end] == KV_SEP)
+		end++ ;
+	    else if (start > 0)
+		start-- ;			// last pair: remove previous sep
+	    memmove (tmp + start, tmp + end, len - end + 1) ;
+	    len -= end - start ;
+	}
+
+	if (i + klen < j)			// "key=value": add the pair
+	{
+	    if (len + (len > 0) + (j - i) + 1 > maxlen)
+	    {
+		free (tmp) ;
+		return -1 ;
+	    }
+	    if (len > 0)
+		tmp [len++] = KV_SEP ;
+	    memcpy (tmp + len, key, j - i) ;
+	    len += j - i ;
+	    tmp [len] = '\0' ;
+	}
+    }
+
+    memcpy (doc, tmp, len + 1) ;
+    free (tmp) ;
+    return (int) len ;
+}
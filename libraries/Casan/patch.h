@@ -0,0 +1,42 @@
+/**
+ * @file patch.h
+ * @brief Helpers for partial resource access (FETCH/PATCH/iPATCH)
+ */
+
+#ifndef __PATCH_H__
+#define __PATCH_H__
+
+#include "defs.h"
+#include "contiki.h"
+#include "stdbool.h"
+
+/**
+ * @brief Partial access to key/value resource representations
+ *
+ * These functions help handlers of FETCH, PATCH and iPATCH requests
+ * (RFC 8132) for resources (typically configuration resources) whose
+ * representation is a list of key/value pairs:
+ *	key1=value1;key2=value2;...
+ *
+ * A FETCH request payload is a list of keys ("key1;key3"), and the
+ * response contains only the matching pairs.
+ *
+ * A PATCH or iPATCH request payload is a list of changes:
+ * * `key=value` sets the value of an existing key, or adds the pair
+ * * `key` removes the pair
+ * Changes are applied in order. Since all changes are idempotent,
+ * the same helper may be used for PATCH and iPATCH.
+ *
+ * Hence, reading or updating a few fields only needs a small
+ * request and response, which fit in a single frame.
+ */
+
+#define	KV_SEP		';'		// separator between pairs
+#define	KV_EQ		'='		// separator between key and value
+
+
+int kv_fetch (const char *doc, const uint8_t *keys, size_t keyslen, char *buf, size_t maxlen) ;
+
+int kv_patch (char *doc, size_t maxlen, const uint8_t *patch, size_t patchlen) ;
+
+#endif
@@ -0,0 +1,129 @@
+#include "pending.h"
+
+// register the earliest send time in the engine timer service
+static void pending_timer (Pending *pd)
+{
+    if (pd->timers_ == NULL)
+		return ;
+    if (pd->pendq_ != NULL)
+		setTimer (pd->timers_, TM_PENDING, TICKS (pd->pendq_->timesend)) ;
+    else
+		stopTimer (pd->timers_, TM_PENDING) ;
+}
+
+/*Destructor*/
+void freePending (Pending *pd)
+{
+    resetPending (pd) ;
+    free (pd) ;
+}
+
+Pending *initPending (void)
+{
+	Pending *pd = (Pending *) malloc (sizeof (Pending)) ;
+	if (pd == NULL)
+		printf("Memory allocation failed\n");
+    pd->pendq_ = NULL ;
+    pd->npend_ = 0 ;
+    pd->timers_ = NULL ;
+    pd->outq_ = NULL ;
+    return pd ;
+}
+
+
+void resetPending (Pending *pd)
+{
+    while (pd->pendq_ != NULL)
+    {
+		pendq *next ;
+
+		next = pd->pendq_->next ;
+		free (pd->pendq_->frame) ;
+		free (pd->pendq_) ;
+		pd->pendq_ = next ;
+    }
+    pd->npend_ = 0 ;
+    pending_timer (pd) ;
+}
+
+
+/*
+ * Insert an encoded copy of the message in the pending list, sorted
+ * by send time. Returns false if the message cannot be delayed (list
+ * full or encoding error): the caller should send it immediately.
+ */
+
+bool addPending (Pending *pd, Msg *m, l2addr_154 *dest, time_t timesend)
+{
+    pendq *n, *cur, *prev ;
+
+    if (pd->npend_ >= PENDING_MAX || ! encodeMsg (m))
+		return false ;
+
+    n = (pendq *) malloc (sizeof (pendq)) ;
+    if (n == NULL)
+    {
+		printf("Memory allocation failed\n");
+		return false ;
+    }
+    n->frame = (uint8_t *) malloc (m->enclen_) ;
+    if (n->frame == NULL)
+    {
+		printf("Memory allocation failed\n");
+		free (n) ;
+		return false ;
+    }
+    memcpy (n->frame, m->encoded_, m->enclen_) ;
+    n->len = m->enclen_ ;
+    copyAddr (&n->dest, dest) ;
+    n->timesend = timesend ;
+
+    prev = NULL ;
+    for (cur = pd->pendq_ ; cur != NULL && cur->timesend <= timesend ; cur = cur->next)
+		prev = cur ;
+    n->next = cur ;
+    if (prev == NULL)
+		pd->pendq_ = n ;
+    else
+		prev->next = n ;
+    pd->npend_++ ;
+    pending_timer (pd) ;
+
+    return true ;
+}
+
+
+// send responses whose time has come (list is sorted by send time)
+void loopPending (Pending *pd, l2net_154 *l2, time_t *curtime)
+{
+    while (pd->pendq_ != NULL && pd->pendq_->timesend <= *curtime)
+    {
+		pendq *cur ;
+
+		cur = pd->pendq_ ;
+		pd->pendq_ = cur->next ;
+		pd->npend_-- ;
+
+		if (pd->outq_ != NULL)
+		    (void) addOutq (pd->outq_, OQ_RESPONSE, &cur->dest, cur->frame, cur->len) ;
+		else if (! send (l2, &cur->dest, cur->frame, cur->len))
+		    printf ("%s",RED ("Cannot L2-send the delayed response\n")) ;
+		free (cur->frame) ;
+		free (cur) ;
+    }
+    pending_timer (pd) ;
+}
+
+
+void timersPending (Pending *pd, Timers *tm)
+{
+    pd->timers_ = tm ;
+    pending_timer (pd) ;
+}
+
+
+// give responses to this outbound queue instead of sending them
+void outqPending (Pending *pd, Outq *oq)
+{
+    pd->outq_ = oq ;
+}
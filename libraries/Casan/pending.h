@@ -0,0 +1,59 @@
+#ifndef __PENDING_H__
+#define __PENDING_H__
+
+/*
+ * Pending responses handling
+ *
+ * This class provides support for a list of already encoded responses
+ * which must be sent later. It is used to answer requests received
+ * on the broadcast address: each slave waits for a random delay (the
+ * "leisure", RFC 7252 section 8.2) before sending its response, in
+ * order to avoid a collision storm when all slaves answer at once.
+ * The loop function must be called periodically in order to send
+ * responses whose time has come. The earliest send time is registered
+ * as the TM_PENDING timer of the engine (see `timersPending`).
+ * Responses are given to the engine outbound queue, if any (see
+ * `outqPending`).
+ */
+
+#include "msg.h"
+#include "time.h"
+#include "outq.h"
+
+#define	PENDING_MAX	4		// max number of pending responses
+
+
+typedef struct pendq
+{
+    uint8_t *frame ;		// encoded response
+    uint16_t len ;		// length of encoded response
+    l2addr_154 dest ;		// destination address
+    time_t timesend ;		// time to send the response
+    struct pendq *next ;	// next in queue, sorted by timesend
+} pendq;
+
+
+typedef struct pending {
+	pendq *pendq_ ;
+	int npend_ ;		// number of pending responses
+	Timers *timers_ ;	// engine timers (or NULL)
+	Outq *outq_ ;		// engine outbound queue (or NULL)
+} Pending;
+
+
+Pending *initPending (void);
+
+void freePending (Pending *pd);
+
+void resetPending (Pending *pd);
+
+bool addPending (Pending *pd, Msg *m, l2addr_154 *dest, time_t timesend);
+
+void loopPending (Pending *pd, l2net_154 *l2, time_t *curtime);
+
+void timersPending (Pending *pd, Timers *tm);
+
+void outqPending (Pending *pd, Outq *oq);
+
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * @file prng.c
+ * @brief Pseudo-random number generator for the CASAN engine
+ */
+
+#include "prng.h"
+
+#define	PRNG_NOISE_SAMPLES	16	// number of RSSI samples at seed time
+#define	PRNG_DEFAULT_STATE	2463534242u
+
+
+/**
+ * @brief Initialize the generator with a given seed
+ */
+
+void prng_seed (Prng *pr, uint32_t seed)
+{
+    pr->state_ = seed != 0 ? seed : PRNG_DEFAULT_STATE ;
+}
+
+
+/**
+ * @brief Mix some entropy into the generator state
+ */
+
+void prng_mix (Prng *pr, uint32_t x)
+{
+    pr->state_ ^= x * 2654435761u ;	// Knuth multiplicative hash
+    if (pr->state_ == 0)
+	pr->state_ = PRNG_DEFAULT_STATE ;
+    (void) prng_rand (pr) ;
+}
+
+
+/**
+ * @brief Seed the generator with node specific values
+ *
+ * The seed is derived from the node address and slave id, and
+ * from random bits sampled from the radio.
+ *
+ * @param pr generator state
+ * @param addr 802.15.4 short address of the node
+ * @param slaveid CASAN slave id
+ */
+
+void prng_seed_node (Prng *pr, uint16_t addr, long int slaveid)
+{
+    int i ;
+
+    prng_seed (pr, ((uint32_t) addr << 16) ^ (uint32_t) slaveid) ;
+    prng_mix (pr, clock_time ()) ;
+    for (i = 0 ; i < PRNG_NOISE_SAMPLES ; i++)
+	prng_mix (pr, getRssiRadio ()) ;
+}
+
+
+/**
+ * @brief Get the next pseudo-random number
+ */
+
+uint32_t prng_rand (Prng *pr)
+{
+    pr->state_ ^= pr->state_ << 13 ;
+    pr->state_ ^= pr->state_ >> 17 ;
+    pr->state_ ^= pr->state_ << 5 ;
+    return pr->state_ ;
+}
+
+
+/**
+ * @brief Get a pseudo-random number uniformly drawn in [lo, hi]
+ *
+ * The random number is scaled to the span with a multiplication
+ * (high 32 bits of the 64-bit product).
+ */
+
+uint32_t prng_range (Prng *pr, uint32_t lo, uint32_t hi)
+{
+    uint64_t span ;
+
+    if (hi <= lo)
+	return lo ;
+    span = (uint64_t) (hi - lo) + 1 ;
+    return lo + (uint32_t) (((uint64_t) prng_rand (pr) * span) >> 32) ;
+}
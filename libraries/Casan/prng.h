@@ -0,0 +1,44 @@
+/**
+ * @file prng.h
+ * @brief Pseudo-random number generator for the CASAN engine
+ */
+
+#ifndef __PRNG_H__
+#define __PRNG_H__
+
+#include "defs.h"
+#include "contiki.h"
+#include "stdbool.h"
+
+/**
+ * @brief Small and fast pseudo-random number generator
+ *
+ * This generator (xorshift32) provides all random delays needed by
+ * the CASAN engine (initial retransmission timeout, leisure before
+ * answering a broadcast request, etc.).
+ *
+ * Nodes of a PAN are often started at the same time with the same
+ * firmware: if all of them draw the same sequence, they keep
+ * colliding when they retransmit. Hence, the generator is seeded
+ * from the node address and from radio noise (RSSI random bits,
+ * see getRssiRadio in the radio driver).
+ *
+ * The generator state is held by the caller (one per engine), such
+ * that several engines in the same process draw independent sequences.
+ */
+
+typedef struct prng
+{
+    uint32_t state_ ;			// xorshift32 must not be zero
+} Prng ;
+
+void prng_seed (Prng *pr, uint32_t seed) ;
+void prng_mix (Prng *pr, uint32_t x) ;
+void prng_seed_node (Prng *pr, uint16_t addr, long int slaveid) ;
+uint32_t prng_rand (Prng *pr) ;
+uint32_t prng_range (Prng *pr, uint32_t lo, uint32_t hi) ;
+
+// provided by the radio driver (radio-rf2xx.c)
+uint8_t getRssiRadio (void) ;
+
+#endif
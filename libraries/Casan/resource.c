@@ -14,7 +14,7 @@
 char *get_name (Resource *rs)       { return rs->name_ ; }
 bool get_observed (Resource *rs)        { return rs->observed_ ; }
 uint32_t next_serial (Resource *rs)     { return ++rs->obs_serial_ ; }
-token *get_token (Resource *rs)     { return rs->obs_token_ ; }
+token *get_token (Resource *rs)     { return &rs->obs_token_ ; }
 
 /** @brief Copy constructor
  */
@@ -58,18 +58,21 @@ void freeResource (Resource *rs) {
 
 void setHandlerResource (Resource *rs, coap_code_t op, handler_res_t h)
 {
-    rs->handler_ [op] = h ;
+    if ((int) op >= 0 && (int) op < NTAB (rs->handler_))
+	rs->handler_ [op] = h ;
 }
 
 
 /** @brief Get resource handler
  *
  * @param op CoAP operation (see coap_code_t type)
- * @return Handler for this operation
+ * @return Handler for this operation, or NULL if op is not a known method
  */
 
 handler_res_t getHandlerResource (Resource *rs, coap_code_t op)
 {
+    if ((int) op < 0 || (int) op >= NTAB (rs->handler_))
+	return NULL ;
     return rs->handler_ [op] ;
 }
 
@@ -111,7 +114,7 @@ void observedResource (Resource *rs, bool onoff, Msg *m)
 		    if (rs->obs_reg_ != NULL)
 			(*rs->obs_reg_) (m) ;
 		    rs->obs_serial_ = 2 ;			/* starting value */
-		    rs->obs_token_ = get_token_msg (m) ;
+		    rs->obs_token_ = *get_token_msg (m) ;
 		}
     }
 }
@@ -134,7 +137,8 @@ int check_trigger (Resource *rs)
  * The format of a "well-known"-type text is:
  *	<temp>;title="Temperature";rt="celcius"
  *
- * @param buf buffer where the textual representation must be stored
+ * @param buf buffer where the textual representation must be stored,
+ *	or NULL to only get the needed length
  * @param maxlen size of buffer
  * @return length of string (including final \0), or -1 if it not fits
  *	in the given buffer
@@ -146,7 +150,9 @@ int well_known (Resource *rs , char *buf, size_t maxlen)
     
     len = sizeof "<>;title=..;rt=.." ;		// including '\0'
     len += strlen (rs->name_) + strlen (rs->title_) + strlen (rs->rt_) ;
-    if (len > (int) maxlen)
+    if (buf == NULL)
+		;					// only compute length
+    else if (len > (int) maxlen)
 		len = -1 ;
     else
 		sprintf (buf, "<%s>;title=\"%s\";rt=\"%s\"", rs->name_, rs->title_, rs->rt_) ;
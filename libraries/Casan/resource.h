@@ -7,6 +7,7 @@
 #define __RESOURCE_H__
 
 #include "msg.h"
+#include "time.h"
 
 /**
  * @brief An object of class Resource represents a resource which
@@ -14,7 +15,7 @@
  *
  * This class represents a resource. A resource has:
  * - some attributes: name, title, etc.
- * - a handler for each CoAP operation (GET, PUT, etc.)
+ * - a handler for each CoAP operation (GET, PUT, FETCH, PATCH, etc.)
  * - a textual representation for `/.well-known/casan` aggregation
  * - observe information
  *
@@ -64,7 +65,7 @@
 
 
 	typedef struct resource {
-		handler_res_t handler_ [5] ;		// indexed by coap_code_t
+		handler_res_t handler_ [COAP_NB_METHODS] ;	// indexed by coap_code_t
 
 		char *name_ ;
 		char *title_ ;
@@ -75,7 +76,8 @@
 		obs_deregister_t obs_dereg_ ;		// unregister an observer
 		obs_trigger_t obs_trig_ ;		// detect observe event
 		uint32_t obs_serial_ ;			// increasing value for option
-		token *obs_token_ ;
+		token obs_token_ ;			// token of the observer
+		tick_t obs_last_ ;			// time of last notification
 	} Resource;
 
 
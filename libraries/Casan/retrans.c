@@ -1,25 +1,309 @@
 #include "retrans.h"
+#include "prng.h"
+
+/******************************************************************************
+ * Index of messages, keyed by (message id, peer address)
+ */
+
+static int hash (uint16_t id, addr2_t peer)
+{
+    return (int) ((id * 40503u) ^ (peer * 31u)) & (RETRANS_INDEX - 1) ;
+}
+
+
+// find the index position of a message, or RETRANS_NONE
+static int index_find (Retrans *rt, uint16_t id, addr2_t peer)
+{
+    int i, s ;
+
+    for (i = hash (id, peer) ; (s = rt->index_ [i]) != RETRANS_NONE ;
+				i = (i + 1) & (RETRANS_INDEX - 1))
+    {
+		if (rt->slot_ [s].f.id == id && rt->slot_ [s].f.dest.addr_ == peer)
+		    return i ;
+    }
+    return RETRANS_NONE ;
+}
+
+
+static void index_add (Retrans *rt, int s)
+{
+    int i ;
+
+    i = hash (rt->slot_ [s].f.id, rt->slot_ [s].f.dest.addr_) ;
+    while (rt->index_ [i] != RETRANS_NONE)
+		i = (i + 1) & (RETRANS_INDEX - 1) ;
+    rt->index_ [i] = s ;
+}
+
+
+/*
+ * Remove the index entry at position i, and shift back following
+ * entries of the same probe sequence (no tombstone needed)
+ */
+
+static void index_del (Retrans *rt, int i)
+{
+    int j, h ;
+
+    rt->index_ [i] = RETRANS_NONE ;
+    for (j = (i + 1) & (RETRANS_INDEX - 1) ; rt->index_ [j] != RETRANS_NONE ;
+				j = (j + 1) & (RETRANS_INDEX - 1))
+    {
+		retransq *r = &rt->slot_ [rt->index_ [j]] ;
+
+		h = hash (r->f.id, r->f.dest.addr_) ;
+		// can entry j move to the hole at i (is h cyclically outside ]i, j]) ?
+		if ((j > i && (h <= i || h > j)) || (j < i && (h <= i && h > j)))
+		{
+		    rt->index_ [i] = rt->index_ [j] ;
+		    rt->index_ [j] = RETRANS_NONE ;
+		    i = j ;
+		}
+    }
+}
+
+
+/******************************************************************************
+ * Heap of messages, ordered by time of next transmission
+ *
+ * heap_ [0..nused_-1] is a binary min-heap of used slots, and
+ * heap_ [nused_..RETRANS_MAX-1] is the list of free slots.
+ */
+
+static void heap_set (Retrans *rt, int pos, int s)
+{
+    rt->heap_ [pos] = s ;
+    rt->slot_ [s].heappos = pos ;
+}
+
+
+static bool heap_before (Retrans *rt, int p1, int p2)
+{
+    return TICK_BEFORE (rt->slot_ [rt->heap_ [p1]].timenext, rt->slot_ [rt->heap_ [p2]].timenext) ;
+}
+
+
+static void heap_swap (Retrans *rt, int p1, int p2)
+{
+    int s1 = rt->heap_ [p1] ;
+
+    heap_set (rt, p1, rt->heap_ [p2]) ;
+    heap_set (rt, p2, s1) ;
+}
+
+
+// register the earliest deadline in the engine timer service
+static void heap_timer (Retrans *rt)
+{
+    if (rt->timers_ == NULL)
+		return ;
+    if (rt->nused_ > 0)
+		setTimer (rt->timers_, TM_RETRANS, rt->slot_ [rt->heap_ [0]].timenext) ;
+    else
+		stopTimer (rt->timers_, TM_RETRANS) ;
+}
+
+
+// move an element to its place in the heap after a change of timenext
+static void heap_fix (Retrans *rt, int pos)
+{
+    int child ;
+
+    while (pos > 0 && heap_before (rt, pos, (pos - 1) / 2))
+    {
+		heap_swap (rt, pos, (pos - 1) / 2) ;
+		pos = (pos - 1) / 2 ;
+    }
+    while ((child = 2 * pos + 1) < rt->nused_)
+    {
+		if (child + 1 < rt->nused_ && heap_before (rt, child + 1, child))
+		    child++ ;
+		if (! heap_before (rt, child, pos))
+		    break ;
+		heap_swap (rt, pos, child) ;
+		pos = child ;
+    }
+    heap_timer (rt) ;
+}
+
+
+// remove an element from the heap: its slot becomes free
+static void heap_del (Retrans *rt, int pos)
+{
+    int last = rt->nused_ - 1 ;
+
+    heap_swap (rt, pos, last) ;
+    rt->nused_-- ;
+    if (pos < last)
+		heap_fix (rt, pos) ;
+    else
+		heap_timer (rt) ;
+}
+
+
+/******************************************************************************
+ * Ring of encoded frames
+ *
+ * Each frame is preceded by a 2-byte header (frame length, and a flag
+ * for freed frames). Frames are allocated at the tail, and the head
+ * advances over freed frames. When a frame does not fit at the end of
+ * the ring, the remaining bytes are marked as a freed padding record.
+ */
+
+#define	RING_FREED	0x8000		// header flag: frame has been freed
+#define	RING_HDR	2		// header size
+#define	RING_REC(len)	(RING_HDR + (((len) + 1) & ~1))	// 2-byte aligned
+
+static void ring_sethdr (Retrans *rt, uint16_t pos, uint16_t hdr)
+{
+    rt->ring_ [pos] = hdr >> 8 ;
+    rt->ring_ [pos + 1] = hdr & 0xff ;
+}
+
+
+static uint16_t ring_gethdr (Retrans *rt, uint16_t pos)
+{
+    return (rt->ring_ [pos] << 8) | rt->ring_ [pos + 1] ;
+}
+
+
+/*
+ * Copy a frame in the ring. Returns false if there is not enough space.
+ */
+
+static bool ring_add (Retrans *rt, const uint8_t *frame, uint16_t len, uint16_t *off)
+{
+    uint16_t need = RING_REC (len) ;
+    uint16_t pos ;
+
+    if (rt->rused_ == 0)
+		rt->rhead_ = rt->rtail_ = 0 ;
+
+    if (rt->rused_ > 0 && rt->rtail_ <= rt->rhead_)
+    {
+		// free space is between tail and head
+		if (need > rt->rhead_ - rt->rtail_)
+		    return false ;
+		pos = rt->rtail_ ;
+    }
+    else if (need <= RETRANS_RINGSIZE - rt->rtail_)
+		pos = rt->rtail_ ;		// free space at the end
+    else
+    {
+		// not enough space at the end: pad and wrap around
+		if (need > rt->rhead_)
+		    return false ;
+		ring_sethdr (rt, rt->rtail_, RING_FREED | (RETRANS_RINGSIZE - rt->rtail_ - RING_HDR)) ;
+		rt->rused_ += RETRANS_RINGSIZE - rt->rtail_ ;
+		pos = 0 ;
+    }
+
+    ring_sethdr (rt, pos, len) ;
+    memcpy (rt->ring_ + pos + RING_HDR, frame, len) ;
+    rt->rused_ += need ;
+    rt->rtail_ = (pos + need) % RETRANS_RINGSIZE ;
+    *off = pos + RING_HDR ;
+    return true ;
+}
+
+
+/*
+ * Free a frame, and reclaim space from the head of the ring
+ */
+
+static void ring_del (Retrans *rt, uint16_t off)
+{
+    uint16_t hdr ;
+
+    hdr = ring_gethdr (rt, off - RING_HDR) ;
+    ring_sethdr (rt, off - RING_HDR, hdr | RING_FREED) ;
+
+    while (rt->rused_ > 0)
+    {
+		hdr = ring_gethdr (rt, rt->rhead_) ;
+		if (! (hdr & RING_FREED))
+		    break ;
+		hdr = RING_REC (hdr & ~RING_FREED) ;
+		rt->rused_ -= hdr ;
+		rt->rhead_ = (rt->rhead_ + hdr) % RETRANS_RINGSIZE ;
+    }
+}
+
+
+// free a message and call its callback
+static void complete (Retrans *rt, conframe *f, conevent_t ev, Msg *in, uint32_t rtt)
+{
+    ring_del (rt, f->off) ;
+    if (f->cb != NULL)
+		(*f->cb) (ev, in, rtt, f->arg) ;
+}
+
+
+// remove a message from the slot array and from the index
+static void del_slot (Retrans *rt, int s, conevent_t ev, Msg *in)
+{
+    retransq *r = &rt->slot_ [s] ;
+    int i ;
+
+    i = index_find (rt, r->f.id, r->f.dest.addr_) ;
+    if (i != RETRANS_NONE)
+		index_del (rt, i) ;
+    r->used = false ;
+    heap_del (rt, r->heappos) ;
+    sync_time (rt->curtime_) ;
+    complete (rt, &r->f, ev, in, TICKS (*rt->curtime_) - r->timefirst) ;
+}
+
+
+/******************************************************************************
+ * Retransmission list
+ */
 
 /*Destructor*/
 void freeRetrans(Retrans *rt) {
-	free(rt->retransq_);
+	resetRetrans (rt) ;
 	free(rt);
 }
 
-Retrans *initRetrans (void) 
+Retrans *initRetrans (l2net_154 *l2, time_t *curtime, Prng *prng)
 {
 	Retrans *rt = (Retrans *) malloc (sizeof(Retrans));
+	int i ;
+
 	if (rt == NULL)
 		printf("Memory allocation failed\n");
-    rt->retransq_ = NULL ;
+    rt->l2_ = l2 ;
+    rt->curtime_ = curtime ;
+    rt->prng_ = prng ;
+    for (i = 0 ; i < RETRANS_MAX ; i++)
+    {
+		rt->slot_ [i].used = false ;
+		heap_set (rt, i, i) ;		// all slots are free
+    }
+    for (i = 0 ; i < RETRANS_INDEX ; i++)
+		rt->index_ [i] = RETRANS_NONE ;
+    rt->nused_ = 0 ;
+    rt->nwait_ = 0 ;
+    rt->rhead_ = rt->rtail_ = rt->rused_ = 0 ;
+    resetRto (&rt->rto_) ;
+    rt->master_addr_ = NULL ;
+    rt->timers_ = NULL ;
+    rt->outq_ = NULL ;
     return rt;
 }
 
 
-void resetRetrans (Retrans *rt) 
+// abandon all messages
+void resetRetrans (Retrans *rt)
 {
-    while (rt->retransq_ != NULL)
-		delRetransIntern2 (rt, NULL, rt->retransq_) ;
+    int i ;
+
+    while (rt->nused_ > 0)
+		del_slot (rt, rt->heap_ [0], CON_CANCEL, NULL) ;
+    for (i = 0 ; i < rt->nwait_ ; i++)
+		complete (rt, &rt->wait_ [i], CON_CANCEL, NULL, 0) ;
+    rt->nwait_ = 0 ;
 }
 
 
@@ -29,146 +313,346 @@ void master (Retrans *rt, l2addr_154 **master)
 }
 
 
-// insert a new message in the retransmission list
-void addRetrans (Retrans *rt, Msg *msg) 
+// register the next retransmission as TM_RETRANS in this timer service
+void timersRetrans (Retrans *rt, Timers *tm)
 {
-    retransq *n ;
+    rt->timers_ = tm ;
+    heap_timer (rt) ;
+}
 
-    sync_time (&curtime) ;		// synchronize curtime
 
-    n = (retransq *) malloc (sizeof (retransq)) ;
-    if (n == NULL)
-		printf("Memory allocation failed\n");
-    n->msg = msg ;
-    n->timelast = curtime ;
-    n->timenext = curtime + ALEA (ACK_TIMEOUT * ACK_RANDOM_FACTOR) ;
+// give frames to this outbound queue instead of sending them
+void outqRetrans (Retrans *rt, Outq *oq)
+{
+    rt->outq_ = oq ;
+}
+
+
+// queue or send a frame
+static bool xmit (Retrans *rt, oqclass_t cls, conframe *f)
+{
+    if (rt->outq_ != NULL)
+		return addOutq (rt->outq_, cls, &f->dest, rt->ring_ + f->off, f->len) ;
+    return send (rt->l2_, &f->dest, rt->ring_ + f->off, f->len) ;
+}
+
+
+/*
+ * Send a message and insert it in the retransmission list
+ */
+
+static void start_con (Retrans *rt, conframe *f)
+{
+    retransq *n ;
+    int s ;
+
+    if (! xmit (rt, OQ_NOTIFY, f))
+		printf ("%s", RED ("Cannot send the CON message\n")) ;
+    // if not sent, message will be retransmitted later
+
+    s = rt->heap_ [rt->nused_] ;		// first free slot
+    n = &rt->slot_ [s] ;
+    n->f = *f ;
+
+    sync_time (rt->curtime_) ;		// synchronize engine time
+    n->timefirst = TICKS (*rt->curtime_) ;
+    // initial timeout drawn in [RTO, RTO * ACK_RANDOM_FACTOR]
+    n->rto0 = getRto (&rt->rto_, &n->f.dest, rt->curtime_) ;
+    n->timeout = prng_range (rt->prng_, n->rto0, (uint32_t) (n->rto0 * ACK_RANDOM_FACTOR)) ;
+    n->timenext = n->timefirst + n->timeout ;
     n->ntrans = 0 ;
-    n->next = rt->retransq_ ;
-    rt->retransq_ = n ;
+    n->used = true ;
+    rt->nused_++ ;
+    heap_fix (rt, n->heappos) ;
+    index_add (rt, s) ;
 }
 
 
-void delRetrans (Retrans *rt, Msg *msg) 
+// number of outstanding CON messages for a peer
+static int inflight (Retrans *rt, l2addr_154 *dest)
 {
-    delRetransIntern1 (rt, getRetrans (rt, msg)) ;
+    int p, n ;
+
+    n = 0 ;
+    for (p = 0 ; p < rt->nused_ ; p++)
+		if (isEqualAddr (&rt->slot_ [rt->heap_ [p]].f.dest, dest))
+		    n++ ;
+    return n ;
 }
 
 
-// TODO
-void loopRetrans (Retrans *rt, l2net_154 *l2, time_t *curtime)
+// can a new CON message be sent now to this peer?
+static bool can_start (Retrans *rt, l2addr_154 *dest)
 {
-    // DBGLN1 (F ("retransmit loop")) ;
+    return rt->nused_ < RETRANS_MAX && inflight (rt, dest) < NSTART ;
+}
 
-    if (*rt->master_addr_ == NULL)
-    {
-		// master has been reset by the CASAN engine (waiting-unknown state)
-		resetRetrans (rt) ;
-		return ;
-    }
-    else
+
+/*
+ * Start waiting messages, in FIFO order, for peers which have less
+ * than NSTART outstanding messages
+ */
+
+static void drain_wait (Retrans *rt)
+{
+    int i ;
+
+    i = 0 ;
+    while (i < rt->nwait_)
     {
-		retransq *cur, *prev ;
+		conframe *w = &rt->wait_ [i] ;
 
-		prev = NULL ;
-		cur = rt->retransq_ ;
-		while (cur != NULL)
+		if (can_start (rt, &w->dest))
 		{
-		    retransq *next ;
-
-		    next = cur->next ;
-		    if (cur->ntrans >= MAX_RETRANSMIT)
-		    {
-				// remove the message from the queue
-				delRetransIntern2 (rt, prev, cur) ;
-				// prev is not modified
-		    }
-		    else
-		    {
-				if (cur->timenext < *curtime)
-				{
-				    sendMsg (cur->msg, *rt->master_addr_) ;
-				    cur->ntrans++ ;
-				    cur->timenext = cur->timenext + (2* (cur->timenext - cur->timelast));
-				    sync_time (&cur->timelast) ;
-				}
-				prev = cur ;
-		    }
-		    cur = next ;
+		    start_con (rt, w) ;
+		    rt->nwait_-- ;
+		    memmove (w, w + 1, (rt->nwait_ - i) * sizeof *w) ;
 		}
+		else i++ ;
     }
 }
 
 
-void check_msg_received (Retrans *rt, Msg *in) 
+/**
+ * @brief Send a CON message
+ *
+ * The message is encoded, and the encoded frame is copied in the
+ * frame ring: the caller keeps the message, which may be reset or
+ * freed as soon as this function returns.
+ *
+ * The message is sent immediately if there are less than NSTART
+ * outstanding CON messages for the destination, or else it waits
+ * (FIFO) until an outstanding message is acknowledged or expires.
+ * It is then retransmitted until an ACK or RST is received from the
+ * destination, or until MAX_RETRANSMIT retransmissions.
+ *
+ * @param msg message to send (must be a CON with a message id)
+ * @param dest destination address or NULL for the current master
+ * @param cb completion callback, or NULL
+ * @param arg argument for the callback
+ * @return CON_SENT, CON_QUEUED, CON_FULL (waiting queue or frame ring
+ *	is full: the caller should try later) or CON_ERROR (no destination or encoding
+ *	error). The callback will be called only if the message has been
+ *	accepted (CON_SENT or CON_QUEUED).
+ */
+
+constatus_t sendConRetrans (Retrans *rt, Msg *msg, l2addr_154 *dest, con_cb_t cb, void *arg)
 {
-    switch (get_type (in))
+    conframe f ;
+    int i ;
+
+    if (dest == NULL)
+		dest = rt->master_addr_ == NULL ? NULL : *rt->master_addr_ ;
+    if (dest == NULL)
+		return CON_ERROR ;
+
+    if (rt->nwait_ >= RETRANS_WAITMAX)
+		return CON_FULL ;
+    if (! encodeMsg (msg))
+		return CON_ERROR ;
+
+    // a message with the same id for the same peer replaces the old one
+    i = index_find (rt, get_id (msg), dest->addr_) ;
+    if (i != RETRANS_NONE)
+		del_slot (rt, rt->index_ [i], CON_CANCEL, NULL) ;
+
+    // keep only the encoded frame
+    if (! ring_add (rt, msg->encoded_, msg->enclen_, &f.off))
+		return CON_FULL ;
+    f.len = msg->enclen_ ;
+    f.id = get_id (msg) ;
+    copyAddr (&f.dest, dest) ;
+    f.tok = *get_token_msg (msg) ;
+    f.cb = cb ;
+    f.arg = arg ;
+
+    if (rt->nwait_ == 0 && can_start (rt, dest))
     {
-	case COAP_TYPE_ACK :
-	    delRetrans (rt, in) ;
-	    break ;
-	default :
-	    break ;
+		start_con (rt, &f) ;
+		return CON_SENT ;
     }
+    rt->wait_ [rt->nwait_++] = f ;
+    return CON_QUEUED ;
 }
 
 
+/**
+ * @brief Is the waiting queue full?
+ *
+ * A true value means that sendConRetrans would return CON_FULL.
+ */
 
-void check_msg_sent (Retrans *rt, Msg *in) 
+bool fullRetrans (Retrans *rt)
 {
-    switch (get_type (in))
+    return rt->nwait_ >= RETRANS_WAITMAX ;
+}
+
+
+/*
+ * Remove the message acknowledged (or rejected) by an incoming message,
+ * and call its completion callback.
+ * The RTT measured from an ACK updates the RTO estimation for the peer.
+ * Returns false if the incoming message matches no waiting message.
+ */
+
+bool delRetrans (Retrans *rt, Msg *msg, l2addr_154 *peer)
+{
+    retransq *r ;
+
+    r = getRetrans (rt, msg, peer) ;
+    if (r != NULL)
     {
-	case COAP_TYPE_CON :
-	    addRetrans (rt, in) ;
-	    break ;
-	default :
-	    break ;
+		bool ack = get_type (msg) == COAP_TYPE_ACK ;
+
+		if (ack)
+		{
+		    sync_time (rt->curtime_) ;
+		    sampleRto (&rt->rto_, peer, TICKS (*rt->curtime_) - r->timefirst, r->ntrans, rt->curtime_) ;
+		}
+		del_slot (rt, r - rt->slot_, ack ? CON_ACK : CON_RST, msg) ;
+		drain_wait (rt) ;
     }
+    return r != NULL ;
 }
 
 
-// for internal use only
-void delRetransIntern1 (Retrans *rt, retransq *r) 
+/*
+ * Abandon the messages sent or waiting for a given peer (e.g. a
+ * master which is no longer known). Messages for other peers are kept.
+ */
+
+void cancelRetrans (Retrans *rt, l2addr_154 *dest)
 {
-    retransq *cur, *prev ;
+    int s, i, n ;
+
+    for (s = 0 ; s < RETRANS_MAX ; s++)
+		if (rt->slot_ [s].used && isEqualAddr (&rt->slot_ [s].f.dest, dest))
+		    del_slot (rt, s, CON_CANCEL, NULL) ;
 
-    prev = NULL ;
-    for (cur = rt->retransq_ ; cur != NULL ; cur = cur->next)
+    n = 0 ;
+    for (i = 0 ; i < rt->nwait_ ; i++)
     {
-		if (cur == r)
-		    break ;
-		prev = cur ;
+		if (isEqualAddr (&rt->wait_ [i].dest, dest))
+		    complete (rt, &rt->wait_ [i], CON_CANCEL, NULL, 0) ;
+		else rt->wait_ [n++] = rt->wait_ [i] ;
     }
+    rt->nwait_ = n ;
+    drain_wait (rt) ;
+}
+
+
+/*
+ * Retransmit messages whose time has come. Only the head of the heap
+ * (the earliest deadline) has to be checked. A message which has been
+ * sent MAX_RETRANSMIT times is removed when its last timeout expires.
+ */
+
+void loopRetrans (Retrans *rt, l2net_154 *l2, time_t *curtime)
+{
+    // DBGLN1 (F ("retransmit loop")) ;
+
+    // messages for a lost master have been cancelled (see reset_master)
+    while (rt->nused_ > 0)
+    {
+		int s = rt->heap_ [0] ;
+		retransq *cur = &rt->slot_ [s] ;
 
-    if (cur != NULL)
-	delRetransIntern2 (rt, prev, cur) ;
+		if (TICK_BEFORE (TICKS (*curtime), cur->timenext))
+		    break ;
+		if (cur->ntrans >= MAX_RETRANSMIT)
+		{
+		    // remove the message from the queue
+		    timeoutRto (&rt->rto_, &cur->f.dest) ;
+		    del_slot (rt, s, CON_TIMEOUT, NULL) ;
+		}
+		else
+		{
+		    if (! xmit (rt, OQ_RETRANS, &cur->f))
+				printf ("%s", RED ("Cannot L2-send the message\n")) ;
+		    cur->ntrans++ ;
+		    cur->timeout = backoffRto (cur->rto0, cur->timeout) ;
+		    cur->timenext = TICKS (*curtime) + cur->timeout ;
+		    heap_fix (rt, 0) ;
+		}
+    }
+    drain_wait (rt) ;
 }
 
 
+/**
+ * @brief Get the time of the next retransmission (or expiration)
+ *
+ * @param next earliest deadline, if any
+ * @return false if there is no message to retransmit
+ */
 
-// for internal use only
-void delRetransIntern2 (Retrans *rt, retransq *prev, retransq *cur) 
+bool deadlineRetrans (Retrans *rt, tick_t *next)
 {
-    if (prev == NULL)
-		rt->retransq_ = cur->next ;
-    else
-		prev->next = cur->next ;
-    if (cur->msg != NULL)
-		freeMsg (cur->msg) ;
-    free (cur) ;
+    if (rt->nused_ == 0)
+		return false ;
+    *next = rt->slot_ [rt->heap_ [0]].timenext ;
+    return true ;
 }
 
 
+/*
+ * Check if the incoming message is an ACK or a RST for one of our
+ * CON messages. Returns true if it is.
+ */
 
-// get a message to retransmit, given its message id
-retransq *getRetrans (Retrans *rt, Msg *msg) 
+bool check_msg_received (Retrans *rt, Msg *in)
 {
-    retransq *cur ;
+    l2addr_154 peer ;
+    bool found = false ;
 
-    for (cur = rt->retransq_ ; cur != NULL ; cur = cur->next)
+    switch (get_type (in))
     {
-	// TODO : maybe check the token too
-	if (get_id (cur->msg) == get_id (msg))
+	case COAP_TYPE_ACK :
+	case COAP_TYPE_RST :
+	    peer.addr_ = in->l2_->curframe_->srcaddr ;
+	    found = delRetrans (rt, in, &peer) ;
+	    break ;
+	default :
 	    break ;
     }
-    return cur ;
-}
\ No newline at end of file
+    return found ;
+}
+
+
+/*
+ * Get a message to retransmit, given the message id and the token
+ * of an incoming ACK or RST, and the address of the peer.
+ * An empty ACK or a RST carries no token. A piggybacked response
+ * must carry the token of the request.
+ */
+
+retransq *getRetrans (Retrans *rt, Msg *msg, l2addr_154 *peer)
+{
+    retransq *r ;
+    int i ;
+
+    i = index_find (rt, get_id (msg), peer->addr_) ;
+    if (i == RETRANS_NONE)
+		return NULL ;
+
+    r = &rt->slot_ [rt->index_ [i]] ;
+    if (get_type (msg) == COAP_TYPE_ACK && get_code (msg) != 0
+		&& ! isEqualToken (*get_token_msg (msg), r->f.tok))
+    {
+		printf ("%s", RED ("ACK with a wrong token\n")) ;
+		return NULL ;
+    }
+    return r ;
+}
+
+
+/**
+ * @brief Get the RTO estimation for a peer (statistics)
+ *
+ * @return estimation, or NULL if no ACK has been received from this peer
+ */
+
+rtoest *getRtoRetrans (Retrans *rt, l2addr_154 *peer)
+{
+    return getRtoEst (&rt->rto_, peer) ;
+}
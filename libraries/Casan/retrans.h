@@ -7,53 +7,159 @@
  * This class provides support for a list of messages to retransmit
  * The loop function must be called periodically in order to
  * retransmit and/or expire messages.
+ *
+ * Messages are kept in a fixed array of slots. An open-addressed
+ * index (linear probing), keyed by the message id and the peer
+ * address, gives the slot of a message such that an incoming ACK
+ * or RST retires its message in constant time.
+ *
+ * Slots are also ordered by time of next transmission with a binary
+ * min-heap, such that the loop function only checks the earliest
+ * deadline, and callers may sleep until this deadline.
+ *
+ * The initial timeout of a new message is derived from the RTO
+ * estimated for its peer (see rto.h), and updated with the RTT
+ * measured when the message is acknowledged.
+ *
+ * At most NSTART CON messages may be outstanding for a peer. Other
+ * messages wait in a bounded FIFO queue, and the caller is told when
+ * this queue is full (backpressure).
+ *
+ * A message is encoded once: this class keeps a copy of the encoded
+ * frame, such that the caller may reuse or free its message
+ * immediately. An optional callback is called when the exchange
+ * completes (ACK, RST, timeout).
+ *
+ * Encoded frames are stored in a fixed ring of bytes, without any
+ * dynamic allocation. Since messages are acknowledged in any order,
+ * a freed frame is only reclaimed when all older frames are freed.
+ *
+ * The earliest deadline is registered as the TM_RETRANS timer of the
+ * engine (see `timersRetrans`).
+ *
+ * Frames are given to the engine outbound queue, if any (see
+ * `outqRetrans`): the first transmission of a message in the OQ_NOTIFY
+ * class, and retransmissions in the higher priority OQ_RETRANS class.
  */
 
 #include "msg.h"
 #include "time.h"
+#include "rto.h"
+#include "prng.h"
+#include "outq.h"
 
 #define DEFAULT_TIMER 4000
 
+#define	RETRANS_MAX	32		// max number of messages to retransmit
+#define	RETRANS_INDEX	64		// index size (power of 2, > RETRANS_MAX)
+#define	RETRANS_NONE	(-1)		// empty index entry
+#define	RETRANS_WAITMAX	8		// max number of messages waiting for NSTART
+#define	RETRANS_RINGSIZE 1024		// size of the encoded frame ring (bytes)
+
+/** Return values of `sendConRetrans` */
+typedef enum
+{
+    CON_SENT = 0,			// message sent
+    CON_QUEUED,				// message waiting for NSTART
+    CON_FULL,				// queue or ring full: message not accepted
+    CON_ERROR,				// no destination or encoding error
+} constatus_t ;
+
+/** Completion events of a CON message */
+typedef enum
+{
+    CON_ACK = 0,			// acknowledged (maybe piggybacked response)
+    CON_RST,				// rejected by the peer
+    CON_TIMEOUT,			// no answer after MAX_RETRANSMIT
+    CON_CANCEL,				// abandoned (master lost, reset)
+} conevent_t ;
+
+/**
+ * Completion callback of a CON message
+ *
+ * @param ev completion event
+ * @param in incoming ACK or RST (NULL for CON_TIMEOUT and CON_CANCEL)
+ * @param rtt time since the first transmission (ms)
+ * @param arg argument given with the message
+ */
+typedef void (*con_cb_t) (conevent_t ev, Msg *in, uint32_t rtt, void *arg) ;
+
+
+typedef struct conframe
+{
+    uint16_t off ;		// encoded message (offset in ring_)
+    uint16_t len ;
+    uint16_t id ;		// message id (index key)
+    l2addr_154 dest ;		// peer address (index key)
+    token tok ;			// token of the message
+    con_cb_t cb ;		// completion callback (may be NULL)
+    void *arg ;			// callback argument
+} conframe;
+
 
 typedef struct retransq
 {
-    Msg *msg ;
-    time_t timelast ;		// time of last transmission
-    time_t timenext ;		// time of next transmission
-    uint8_t ntrans ;		// # of retransmissions 
-    struct retransq *next ;		// next in queue
+    conframe f ;
+    tick_t timefirst ;		// time of first transmission
+    tick_t timenext ;		// time of next transmission
+    uint32_t rto0 ;		// initial timeout (ms)
+    uint32_t timeout ;		// current timeout (ms)
+    uint8_t ntrans ;		// # of retransmissions
+    bool used ;			// slot in use
+    int8_t heappos ;		// position in heap_
 } retransq;
 
 
 typedef struct retrans {
-	retransq *retransq_ ;
+	l2net_154 *l2_ ;
+	retransq slot_ [RETRANS_MAX] ;
+	int8_t index_ [RETRANS_INDEX] ;	// (id, peer) -> slot
+	int8_t heap_ [RETRANS_MAX] ;	// used slots (heap), then free slots
+	int nused_ ;			// number of used slots (heap size)
+	conframe wait_ [RETRANS_WAITMAX] ;	// messages waiting for NSTART (FIFO)
+	int nwait_ ;
+	Rto rto_ ;			// RTO estimation for each peer
+	uint8_t ring_ [RETRANS_RINGSIZE] ;	// encoded frames
+	uint16_t rhead_ ;		// oldest frame in ring_
+	uint16_t rtail_ ;		// first free byte in ring_
+	uint16_t rused_ ;		// # of bytes used (including padding)
 	l2addr_154 **master_addr_ ;
+	Timers *timers_ ;		// engine timers (or NULL)
+	time_t *curtime_ ;		// engine current time
+	Prng *prng_ ;			// engine random generator
+	Outq *outq_ ;			// engine outbound queue (or NULL)
 }Retrans;
 
 
 void freeRetrans(Retrans *rt);
 
-Retrans *initRetrans (void);
+Retrans *initRetrans (l2net_154 *l2, time_t *curtime, Prng *prng);
 
 void resetRetrans (Retrans *rt) ;
 
+void cancelRetrans (Retrans *rt, l2addr_154 *dest) ;
+
 void master (Retrans *rt, l2addr_154 **master);
 
-void addRetrans (Retrans *rt, Msg *msg) ;
+void timersRetrans (Retrans *rt, Timers *tm);
 
-void delRetrans (Retrans *rt, Msg *msg);
+void outqRetrans (Retrans *rt, Outq *oq);
 
-void loopRetrans (Retrans *rt, l2net_154 *l2, time_t *curtime);
+constatus_t sendConRetrans (Retrans *rt, Msg *msg, l2addr_154 *dest, con_cb_t cb, void *arg) ;
+
+bool fullRetrans (Retrans *rt) ;
 
-void check_msg_received (Retrans *rt, Msg *in);
+bool delRetrans (Retrans *rt, Msg *msg, l2addr_154 *peer);
+
+void loopRetrans (Retrans *rt, l2net_154 *l2, time_t *curtime);
 
-void check_msg_sent (Retrans *rt, Msg *in) ;
+bool deadlineRetrans (Retrans *rt, tick_t *next);
 
-void delRetransIntern1 (Retrans *rt, retransq *r);
+bool check_msg_received (Retrans *rt, Msg *in);
 
-void delRetransIntern2 (Retrans *rt, retransq *prev, retransq *cur);
+retransq *getRetrans (Retrans *rt, Msg *msg, l2addr_154 *peer);
 
-retransq *getRetrans (Retrans *rt, Msg *msg);
+rtoest *getRtoRetrans (Retrans *rt, l2addr_154 *peer);
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,198 @@
+#include "rto.h"
+
+/******************************************************************************
+ * Peer estimations
+ */
+
+/*
+ * Get the estimation for a peer. If the peer is not known, the
+ * estimation of the least recently updated peer is recycled.
+ */
+
+static rtoest *find_est (Rto *ro, l2addr_154 *peer, bool create)
+{
+    rtoest *e, *old ;
+    int i ;
+
+    old = &ro->est_ [0] ;
+    for (i = 0 ; i < RTO_PEERS ; i++)
+    {
+		e = &ro->est_ [i] ;
+		if (e->used && isEqualAddr (&e->peer, peer))
+		    return e ;
+		if (! e->used || (old->used && e->lastupd < old->lastupd))
+		    old = e ;
+    }
+    if (! create)
+		return NULL ;
+
+    memset (old, 0, sizeof *old) ;
+    old->used = true ;
+    copyAddr (&old->peer, peer) ;
+    old->rto = RTO_INIT ;
+    sync_time (&old->lastupd) ;
+    return old ;
+}
+
+
+static uint32_t bound (uint32_t rto)
+{
+    return rto > RTO_MAX ? RTO_MAX : rto ;
+}
+
+
+/*
+ * Update an estimator (smoothed RTT and variation) with a new sample
+ * and return the new RTO for this estimator (RFC 6298)
+ */
+
+static uint32_t update (uint32_t *srtt, uint32_t *rttvar, bool first, uint32_t rtt, int k)
+{
+    uint32_t var ;
+
+    if (first)
+    {
+		*srtt = rtt ;
+		*rttvar = rtt / 2 ;
+    }
+    else
+    {
+		var = *srtt > rtt ? *srtt - rtt : rtt - *srtt ;
+		*rttvar = (3 * *rttvar + var) / 4 ;
+		*srtt = (7 * *srtt + rtt) / 8 ;
+    }
+    var = k * *rttvar ;
+    return bound (*srtt + (var > RTO_G ? var : RTO_G)) ;
+}
+
+
+/*
+ * Age the overall RTO if it has not been updated for a while: a small
+ * RTO grows back, and a large RTO slowly returns to the default value
+ */
+
+static void age (rtoest *e, time_t *cur)
+{
+    if (e->rto < 1000 && *cur - e->lastupd > 16 * (time_t) e->rto)
+    {
+		e->rto = 2 * e->rto ;
+		e->lastupd = *cur ;
+    }
+    else if (e->rto > 3000 && *cur - e->lastupd > 4 * (time_t) e->rto)
+    {
+		e->rto = (RTO_INIT + e->rto) / 2 ;
+		e->lastupd = *cur ;
+    }
+}
+
+
+/******************************************************************************
+ * RTO
+ */
+
+void resetRto (Rto *ro)
+{
+    int i ;
+
+    for (i = 0 ; i < RTO_PEERS ; i++)
+		ro->est_ [i].used = false ;
+}
+
+
+/**
+ * @brief Get the RTO to use for a new CON exchange with a peer
+ *
+ * @return overall RTO (ms), or RTO_INIT if the peer is not known
+ */
+
+uint32_t getRto (Rto *ro, l2addr_154 *peer, time_t *cur)
+{
+    rtoest *e ;
+
+    e = find_est (ro, peer, false) ;
+    if (e == NULL)
+		return RTO_INIT ;
+    age (e, cur) ;
+    return e->rto ;
+}
+
+
+/**
+ * @brief Update estimation with a new RTT sample
+ *
+ * @param rtt time between the first transmission and the ACK (ms)
+ * @param ntrans number of retransmissions before the ACK
+ */
+
+void sampleRto (Rto *ro, l2addr_154 *peer, uint32_t rtt, int ntrans, time_t *cur)
+{
+    rtoest *e ;
+
+    if (ntrans > RTO_WEAK_MAXTRANS)
+		return ;			// ambiguous sample
+
+    e = find_est (ro, peer, true) ;
+    e->lastrtt = rtt ;
+    if (ntrans == 0)
+    {
+		e->rto_s = update (&e->srtt_s, &e->rttvar_s, e->nstrong == 0, rtt, RTO_K_STRONG) ;
+		e->nstrong++ ;
+		e->rto = (e->rto_s + e->rto) / 2 ;
+    }
+    else
+    {
+		e->rto_w = update (&e->srtt_w, &e->rttvar_w, e->nweak == 0, rtt, RTO_K_WEAK) ;
+		e->nweak++ ;
+		e->rto = (e->rto_w + 3 * e->rto) / 4 ;
+    }
+    e->lastupd = *cur ;
+}
+
+
+/**
+ * @brief Account for an exchange which has not been acknowledged
+ */
+
+void timeoutRto (Rto *ro, l2addr_154 *peer)
+{
+    rtoest *e ;
+
+    e = find_est (ro, peer, false) ;
+    if (e != NULL)
+		e->ntimeout++ ;
+}
+
+
+/**
+ * @brief Compute the next timeout (variable back-off factor)
+ *
+ * The back-off factor depends on the initial RTO of the exchange:
+ * small RTOs grow faster, large RTOs grow slower.
+ *
+ * @param rto0 initial RTO of the exchange (ms)
+ * @param timeout current timeout (ms)
+ * @return next timeout (ms)
+ */
+
+uint32_t backoffRto (uint32_t rto0, uint32_t timeout)
+{
+    if (rto0 < 1000)
+		timeout = 3 * timeout ;
+    else if (rto0 > 3000)
+		timeout = (3 * timeout) / 2 ;
+    else
+		timeout = 2 * timeout ;
+    return bound (timeout) ;
+}
+
+
+/**
+ * @brief Get the estimation for a peer (statistics)
+ *
+ * @return estimation, or NULL if the peer is not known
+ */
+
+rtoest *getRtoEst (Rto *ro, l2addr_154 *peer)
+{
+    return find_est (ro, peer, false) ;
+}
@@ -0,0 +1,71 @@
+#ifndef __RTO_H__
+#define __RTO_H__
+
+/*
+ * Adaptive retransmission timeout (CoCoA, draft-ietf-core-cocoa)
+ *
+ * This class keeps, for a few peers, an estimation of the round-trip
+ * time from the ACKs received for CON messages:
+ * - the strong estimator uses ACKs of messages which have not been
+ *	retransmitted (unambiguous RTT)
+ * - the weak estimator uses ACKs of messages retransmitted once or
+ *	twice (RTT measured from the first transmission)
+ * Each estimator computes an RTO from a smoothed RTT and its variance
+ * (RFC 6298). The overall RTO, used to start new CON exchanges, is a
+ * weighted average of both. It ages when no new sample is received,
+ * and the back-off factor depends on the current RTO.
+ */
+
+#include "../L2-154/l2-154.h"
+#include "time.h"
+
+#define	RTO_PEERS	4		// number of peers with an estimation
+#define	RTO_INIT	ACK_TIMEOUT	// initial RTO (ms)
+#define	RTO_MAX		60000		// upper bound for RTO (ms)
+#define	RTO_G		10		// clock granularity (ms)
+#define	RTO_K_STRONG	4		// variance factor, strong estimator
+#define	RTO_K_WEAK	1		// variance factor, weak estimator
+#define	RTO_WEAK_MAXTRANS 2		// ignore ACKs after more retransmissions
+
+
+typedef struct rtoest
+{
+    l2addr_154 peer ;
+    bool used ;
+    time_t lastupd ;		// time of last update of rto
+    // strong estimator
+    uint32_t srtt_s ;		// smoothed RTT (ms)
+    uint32_t rttvar_s ;		// RTT variation (ms)
+    uint32_t rto_s ;
+    // weak estimator
+    uint32_t srtt_w ;
+    uint32_t rttvar_w ;
+    uint32_t rto_w ;
+    uint32_t rto ;		// overall RTO (ms)
+    // statistics
+    int nstrong ;		// # of samples for the strong estimator
+    int nweak ;			// # of samples for the weak estimator
+    int ntimeout ;		// # of exchanges without ACK
+    uint32_t lastrtt ;		// last measured RTT (ms)
+} rtoest;
+
+
+typedef struct rto {
+	rtoest est_ [RTO_PEERS] ;
+} Rto;
+
+
+void resetRto (Rto *ro) ;
+
+uint32_t getRto (Rto *ro, l2addr_154 *peer, time_t *cur) ;
+
+void sampleRto (Rto *ro, l2addr_154 *peer, uint32_t rtt, int ntrans, time_t *cur) ;
+
+void timeoutRto (Rto *ro, l2addr_154 *peer) ;
+
+uint32_t backoffRto (uint32_t rto0, uint32_t timeout) ;
+
+rtoest *getRtoEst (Rto *ro, l2addr_154 *peer) ;
+
+
+#endif
@@ -9,12 +9,13 @@
  * Timers values (expressed in ms)
  */
 
-#define	TIMER_WAIT_START	1*500		// initial between discover msg
-#define	TIMER_WAIT_INC		1*1000
-#define	TIMER_WAIT_INC_MAX	10*1000
+#define	TIMER_WAIT_START	1*500		// min Trickle interval (Imin)
+#define	TIMER_WAIT_INC_MAX	8*1000		// max Trickle interval (Imax)
+#define	TIMER_WAIT_K		2		// redundancy constant (k)
 #define	TIMER_WAIT_MAX		30*1000		// time in waiting_known
 
 #define	TIMER_RENEW_MIN		500		// min time between discover
+#define	TIMER_RENEW_MAXTTL	(7*24*3600*1000UL)	// fits in ticks
 
 
 /*
@@ -30,10 +31,7 @@
  * Current time
  */
 
-time_t curtime ;			// global variable
-
 // synchronize current time with help of millis ()
-// Should be used on curtime global variable, but can also be used on any var
 void sync_time (time_t *cur)		
 {
     unsigned long int ms ;
@@ -57,6 +55,63 @@ void print_time (time_t *t)
 
 
 
+/*******************************************************************************
+ * Timer service
+ */
+
+void resetTimers (Timers *tm)
+{
+    tm->active_ = 0 ;
+}
+
+void setTimer (Timers *tm, timerid_t id, tick_t when)
+{
+    tm->when_ [id] = when ;
+    tm->active_ |= 1 << id ;
+}
+
+void stopTimer (Timers *tm, timerid_t id)
+{
+    tm->active_ &= ~ (1 << id) ;
+}
+
+bool activeTimer (Timers *tm, timerid_t id)
+{
+    return (tm->active_ & (1 << id)) != 0 ;
+}
+
+/** @brief Is the timer armed and its deadline reached?
+ */
+
+bool expiredTimer (Timers *tm, timerid_t id, tick_t now)
+{
+    return activeTimer (tm, id) && TICK_REACHED (now, tm->when_ [id]) ;
+}
+
+/** @brief Earliest deadline of all armed timers
+ *
+ * @return false if no timer is armed
+ */
+
+bool nextTimer (Timers *tm, tick_t *next)
+{
+    bool found = false ;
+    int i ;
+
+    for (i = 0 ; i < TM_MAX ; i++)
+    {
+	if ((tm->active_ & (1 << i))
+		&& (! found || TICK_BEFORE (tm->when_ [i], *next)))
+	{
+	    *next = tm->when_ [i] ;
+	    found = true ;
+	}
+    }
+    return found ;
+}
+
+
+
 /*******************************************************************************
  * Timers
  */
@@ -66,46 +121,104 @@ void print_time (time_t *t)
  *      states
  */
 
+// begin a new Trickle interval, and draw its Discover point
+static void trickle_interval (Twait *tw, tick_t start)
+{
+    tick_t half = tw->inc_ / 2 ;
+
+    tw->end_ = start + tw->inc_ ;
+    tw->heard_ = 0 ;
+    tw->fired_ = false ;
+    tw->quiet_ = true ;
+    setTimer (tw->tm_, TM_DISCOVER, start + prng_range (tw->prng_, half, tw->inc_ - 1)) ;
+}
+
+
 /** @brief Initialize the timer with the current time
  */
 
-Twait *initTwait (time_t *cur)
+void initTwait (Twait *tw, Timers *tm, time_t *cur, Prng *pr)
 {
-	Twait *tw = (Twait *) malloc(sizeof(Twait));
-    if (tw == NULL)
-        printf("Memory allocation failed\n");
-    tw->limit_ = *cur + TIMER_WAIT_MAX ;
+    tick_t now = TICKS (*cur) ;
+
+    tw->tm_ = tm ;
+    tw->prng_ = pr ;
     tw->inc_ = TIMER_WAIT_START ;
-    tw->next_ = *cur + tw->inc_ ;
-    return tw;
+    trickle_interval (tw, now) ;
+    setTimer (tm, TM_EXPIRE, now + TIMER_WAIT_MAX) ;
+}
+
+
+/** @brief Restart with the minimum interval (hello-id change)
+ *
+ * The TM_EXPIRE deadline is not modified.
+ */
+
+void resetTwait (Twait *tw, time_t *cur)
+{
+    tw->inc_ = TIMER_WAIT_START ;
+    trickle_interval (tw, TICKS (*cur)) ;
 }
 
 
 /** @brief Is it the time to send a new Discover message?
+ *
+ * At the Discover point of the interval, the answer is yes unless
+ * the Discover is suppressed. At the end of the interval, the next
+ * (doubled) interval begins.
  */
 
 bool nextTwait (Twait *tw, time_t *cur)
 {
     bool itstime = false ;
-    if (*cur >= tw->next_)
+
+    if (expiredTimer (tw->tm_, TM_DISCOVER, TICKS (*cur)))
     {
-		itstime = true ;
-		tw->inc_ += TIMER_WAIT_INC ;
-		if (tw->inc_ > TIMER_WAIT_INC_MAX)
-		    tw->inc_ = TIMER_WAIT_INC_MAX ;
-		tw->next_ += tw->inc_ ;
+		if (! tw->fired_)
+		{
+		    itstime = ! (tw->quiet_ && tw->heard_ >= TIMER_WAIT_K) ;
+		    tw->fired_ = true ;
+		    setTimer (tw->tm_, TM_DISCOVER, tw->end_) ;
+		}
+		else
+		{
+		    tw->inc_ *= 2 ;
+		    if (tw->inc_ > TIMER_WAIT_INC_MAX)
+				tw->inc_ = TIMER_WAIT_INC_MAX ;
+		    trickle_interval (tw, tw->end_) ;
+		}
     }
     return itstime ;
 }
 
 
+/** @brief A Discover from another slave has been overheard
+ */
+
+void overheardTwait (Twait *tw)
+{
+    if (tw->heard_ < 255)
+		tw->heard_++ ;
+}
+
+
+/** @brief A master has been heard: Discovers are not suppressed
+ *	in this interval.
+ */
+
+void masterTwait (Twait *tw)
+{
+    tw->quiet_ = false ;
+}
+
+
 /** @brief Is it the time for a transition from the waiting_known
  *	to the waiting_unknown state?
  */
 
 bool expiredTwait (Twait *tw, time_t *cur)
 {
-    return *cur >= tw->limit_ ;
+    return expiredTimer (tw->tm_, TM_EXPIRE, TICKS (*cur)) ;
 }
 
 
@@ -113,16 +226,17 @@ bool expiredTwait (Twait *tw, time_t *cur)
  *	returned by the master in its Assoc message.
  */
 
-Trenew *initTrenew ( time_t *cur, time_t sttl)
+void initTrenew (Trenew *tr, Timers *tm, time_t *cur, time_t sttl)
 {
-	Trenew *tr = (Trenew *) malloc (sizeof(Trenew));
-    if (tr == NULL)
-        printf("Memory allocation failed\n");
-    tr->inc_ = sttl / 2 ;
+    tick_t now = TICKS (*cur) ;
 
-    tr->next_ = *cur + tr->inc_ ;
-    tr->limit_ = *cur + sttl ;
-    return tr;
+    if (sttl > TIMER_RENEW_MAXTTL)
+		sttl = TIMER_RENEW_MAXTTL ;
+    tr->tm_ = tm ;
+    tr->sttl_ = (tick_t) sttl ;
+    tr->inc_ = sttl / 2 ;
+    setTimer (tm, TM_DISCOVER, now + tr->inc_) ;
+    setTimer (tm, TM_EXPIRE, now + (tick_t) sttl) ;
 }
 
 
@@ -132,8 +246,6 @@ Trenew *initTrenew ( time_t *cur, time_t sttl)
 
 bool renewTrenew (Trenew *tr, time_t *cur)
 {
-    // printf("ici renew\n");
-    // printf("%d    %d    %d\n",cur , &cur, *cur);
     return nextTrenew (tr, cur) ;
 }
 
@@ -145,13 +257,13 @@ bool nextTrenew (Trenew *tr, time_t *cur)
 {
     bool itstime = false ;
     
-    if (*cur >= tr->next_)
+    if (expiredTimer (tr->tm_, TM_DISCOVER, TICKS (*cur)))
     {
 		itstime = true ;
 		tr->inc_ /= 2 ;
 		if (tr->inc_ <= TIMER_RENEW_MIN)
 		    tr->inc_ = TIMER_RENEW_MIN ;
-		tr->next_ += tr->inc_ ;
+		setTimer (tr->tm_, TM_DISCOVER, tr->tm_->when_ [TM_DISCOVER] + tr->inc_) ;
     }
     return itstime ;
 }
@@ -162,5 +274,19 @@ bool nextTrenew (Trenew *tr, time_t *cur)
 
 bool expiredTrenew (Trenew *tr, time_t *cur)
 {
-    return *cur >= tr->limit_ ;
-}
\ No newline at end of file
+    return expiredTimer (tr->tm_, TM_EXPIRE, TICKS (*cur)) ;
+}
+
+
+/** @brief The master has shown it is alive (request, ACK, hello):
+ *	restart the timer as if the association had just been renewed.
+ */
+
+void aliveTrenew (Trenew *tr, time_t *cur)
+{
+    tick_t now = TICKS (*cur) ;
+
+    tr->inc_ = tr->sttl_ / 2 ;
+    setTimer (tr->tm_, TM_DISCOVER, now + tr->inc_) ;
+    setTimer (tr->tm_, TM_EXPIRE, now + tr->sttl_) ;
+}
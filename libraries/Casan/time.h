@@ -12,6 +12,7 @@
 #include "defs.h"
 #include "contiki.h"
 #include "stdbool.h"
+#include "prng.h"
 
 /** @brief Type for current time value in milliseconds since last start
  * 
@@ -29,22 +30,15 @@ typedef uint64_t time_t ;
 
 typedef uint64_t timediff_t ;
 
-/** @brief Current time
- *
- * This variable is globally declared, such as every application
- * can make use of it.
- */
-
-extern time_t curtime ;
-
 /** @brief Synchronize current time
  *
  * This function synchronizes time in a variable with the help of
  * the `millis()` function (standard Arduino library).
  *
- * It is meant to be used with the `curtime` global variable, but can
- * be used with any variable of type `time_t` (provided that it is
- * correctly initialized).
+ * There is no global current time: each engine keeps its own
+ * (`curtime_` in the Casan structure) and gives a pointer to it to
+ * the classes which need it. Any variable of type `time_t` may be
+ * used (provided that it is correctly initialized).
  *
  * Note that time synchronization cannot work if calls to this function
  * are spaced with more than ~50 days. As such, this function should be
@@ -59,6 +53,57 @@ extern void sync_time (time_t *cur) ;
 extern void print_time (time_t *t) ;
 
 
+/** @brief Type for timer deadlines: low 32 bits of a `time_t`
+ *
+ * Ticks are milliseconds, and roll over after ~50 days. They must
+ * always be compared with the `TICK_BEFORE` or `TICK_REACHED` macros,
+ * which are correct as long as compared ticks are less than ~25 days
+ * apart. This avoids 64-bit arithmetic in timer checks.
+ */
+
+typedef uint32_t tick_t ;
+
+#define	TICKS(t)		((tick_t) (t))
+#define	TICK_BEFORE(a,b)	((int32_t) ((tick_t) (a) - (tick_t) (b)) < 0)
+#define	TICK_REACHED(now,t)	(! TICK_BEFORE ((now), (t)))
+
+
+/**
+ * @brief Timers of the CASAN engine
+ *
+ * All engine timers are registered in this small static array, one
+ * entry for each timer. There is no allocation when a timer is
+ * (re)started, and the earliest deadline is found in constant time.
+ *
+ * An armed timer must be either consumed (restarted or stopped) when
+ * it expires, or it will be reported as due over and over.
+ */
+
+typedef enum
+{
+    TM_DISCOVER = 0,			// next Discover (or entering renew)
+    TM_EXPIRE,				// end of waiting_known or association
+    TM_RETRANS,				// next retransmission (see Retrans)
+    TM_PENDING,				// next delayed response (see Pending)
+    TM_OBSERVE,				// next check of observed resources
+    TM_SLEEP,				// next wakeup or end of listen window
+    TM_STANDBY,				// next refresh of the standby association
+    TM_MAX
+} timerid_t ;
+
+typedef struct timers {
+	tick_t when_ [TM_MAX] ;
+	uint8_t active_ ;		// bit i set <=> timer i armed
+} Timers;
+
+void resetTimers (Timers *tm) ;
+void setTimer (Timers *tm, timerid_t id, tick_t when) ;
+void stopTimer (Timers *tm, timerid_t id) ;
+bool activeTimer (Timers *tm, timerid_t id) ;
+bool expiredTimer (Timers *tm, timerid_t id, tick_t now) ;
+bool nextTimer (Timers *tm, tick_t *next) ;
+
+
 /**
  * @brief CASAN timer used in waiting_unknown and waiting_known states
  *
@@ -66,24 +111,46 @@ extern void print_time (time_t *t) ;
  * CASAN Discover messages while the CASAN engine is in waiting_unknown
  * or waiting_known state.
  *
- * Note: this timer only keeps timepoints such that, when called,
- * it can tell if the event should occur. It does not keep an
- * active time measure, nor it does not provide callbacks.
+ * Discover messages are scheduled with a Trickle timer (RFC 6206):
+ * * each interval begins with the minimum length, and its length
+ *	doubles after each interval, up to a maximum length
+ * * a Discover is sent at a random point in the second half of
+ *	each interval, such that slaves which enter this state at the
+ *	same time (after a master restart) do not send in lockstep
+ * * the Discover is suppressed if, in the same interval, the slave
+ *	has overheard k Discovers from other slaves while no master
+ *	has been heard (see `overheardTwait` and `masterTwait`)
+ * * the interval is reset to its minimum length when the hello-id
+ *	changes (see `resetTwait`)
+ *
+ * Note: this timer only keeps the Trickle state. Timepoints are
+ * registered in the timer service (TM_DISCOVER and TM_EXPIRE), such
+ * that, when called, it can tell if the event should occur.
  */
 
 
 typedef struct twait {
-	time_t next_ ;
-	time_t inc_ ;
-	time_t limit_ ;
+	Timers *tm_ ;
+	Prng *prng_ ;
+	tick_t inc_ ;			// current interval length (I)
+	tick_t end_ ;			// end of the current interval
+	uint8_t heard_ ;		// Discovers overheard in this interval (c)
+	bool fired_ ;			// Discover point of this interval passed
+	bool quiet_ ;			// no master heard in this interval
 }Twait;
 
-Twait *initTwait(time_t *cur);
+void initTwait (Twait *tw, Timers *tm, time_t *cur, Prng *pr);
+
+void resetTwait (Twait *tw, time_t *cur);
 
 bool nextTwait (Twait *tw, time_t *cur);
 
 bool expiredTwait (Twait *tw, time_t *cur);
 
+void overheardTwait (Twait *tw);
+
+void masterTwait (Twait *tw);
+
 
 /** @class Trenew
  * @brief CASAN timer used in running and renew states
@@ -91,21 +158,24 @@ bool expiredTwait (Twait *tw, time_t *cur);
  * This class abstracts parameters for the timer used to keep
  * association running.
  *
- * Note: this timer only keeps timepoints such that, when called,
- * it can tell if the event should occur. It does not keep an
- * active time measure, nor it does not provide callbacks.
+ * Note: as Twait, this timer only keeps the current increment (and
+ * the slave TTL), and uses TM_DISCOVER and TM_EXPIRE in the timer
+ * service.
+ *
+ * Any evidence that the master is alive (see `aliveTrenew`) restarts
+ * the timer: renewal Discovers are only sent when the link is quiet.
  */
 
 typedef struct trenew {
-	time_t mid_ ;
-	time_t inc_ ;
-	time_t next_ ;
-	time_t limit_ ;
+	Timers *tm_ ;
+	tick_t inc_ ;
+	tick_t sttl_ ;
 }	Trenew;
 
-Trenew *initTrenew (time_t *cur, time_t sttl) ;
+void initTrenew (Trenew *tr, Timers *tm, time_t *cur, time_t sttl) ;
 bool renewTrenew (Trenew *tr, time_t *cur) ;		// time to enter renew state
 bool nextTrenew (Trenew *tr, time_t *cur) ;		// next discover
 bool expiredTrenew (Trenew *tr, time_t *cur) ;		// time to enter waiting_known
+void aliveTrenew (Trenew *tr, time_t *cur) ;		// master is alive: postpone renew
 
 #endif
@@ -65,8 +65,8 @@ token *initTokenChar(char *str) {
 
 token *initTokenToken(uint8_t *val, size_t len) {
  	token *to = (token *) malloc (sizeof (struct Token));
-    if (to == NULL)
-        printf("Memory allocation failed\n");
+ 	if (to == NULL)
+ 		printf("Memory allocation failed\n");
  	if (len > 0 && len < NTAB (to->token_)) {
  		to->toklen_ = len;
  		memcpy( to->token_, val, len);
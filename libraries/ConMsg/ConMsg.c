@@ -1,4 +1,5 @@
 #include "ConMsg.h"
+#include "net/packetbuf.h"
 
 
 
@@ -12,43 +13,76 @@
 #define I154_ADDRLEN 2
 
 
-ConMsg *conmsg ;
+/*
+ * Instance bound to the radio: the radio driver calls the usr_radio_*
+ * functions from its interrupt routine, without any context.
+ */
+
+static ConMsg *radio_cm ;
+
+
+ConStat *getstat (ConMsg *cm) { return &cm->stat_ ; }
 
+int getMsgbufsize (ConMsg *cm) { return cm->msgbufsize_ ; }
 
-ConStat *getstat () { return &conmsg->stat_ ; }
+addr2_t getAddr2 (ConMsg *cm) { return cm->addr2_ ; }
 
-int getMsgbufsize () { return conmsg->msgbufsize_ ; }
+addr8_t getAddr8 (ConMsg *cm) { return cm->addr8_ ; }
 
-addr2_t getAddr2 () { return conmsg->addr2_ ; }
+panid_t getPanid (ConMsg *cm) { return cm->panid_ ; }
 
-addr8_t getAddr8 () { return conmsg->addr8_ ; }
+channel_t getChannel (ConMsg *cm) { return cm->chan_ ; }
 
-panid_t getPanid () { return conmsg->panid_ ; }
+void setMsgbufsize (ConMsg *cm, int msgbufsize) { cm->msgbufsize_ = msgbufsize ; }
 
-channel_t getChannel () { return conmsg->chan_ ; }
+void setAddr2 (ConMsg *cm, addr2_t addr) { cm->addr2_ = addr ; }
 
-void setMsgbufsize ( int msgbufsize) { conmsg->msgbufsize_ = msgbufsize ; }
+void setAddr8 (ConMsg *cm, addr8_t addr) { cm->addr8_ = addr ; }
 
-void setAddr2 ( addr2_t addr) { conmsg->addr2_ = addr ; }
+void setPanid (ConMsg *cm, panid_t panid) { cm->panid_ = panid ; }
 
-void setAddr8 ( addr8_t addr) { conmsg->addr8_ = addr ; }
+void setChannel (ConMsg *cm, channel_t chan) {  cm->chan_ = chan ; }
 
-void setPanid ( panid_t panid) { conmsg->panid_ = panid ; }
+void setProcess (ConMsg *cm, struct process *p) { cm->proc_ = p ; }
 
-void setChannel ( channel_t chan) {  conmsg->chan_ = chan ; }
+bool getRadio (ConMsg *cm) { return cm->radio_on_ ; }
+
+void setTransport (ConMsg *cm, contx_t tx, void *arg) { cm->tx_ = tx ; cm->txarg_ = arg ; }
+
+
+/*
+ * Switch the radio on or off. No frame can be received while the
+ * radio is off.
+ */
+
+void setRadio (ConMsg *cm, bool on)
+{
+    if (on == cm->radio_on_)
+	return ;
+    if (on)
+	NETSTACK_RADIO.on () ;
+    else
+	NETSTACK_RADIO.off () ;
+    cm->radio_on_ = on ;
+}
 
 
 uint8_t *usr_radio_receive_frame (uint8_t len, uint8_t *frm) {
-	return it_receive_frame( len, frm);
+	if (radio_cm == NULL)
+	    return frm ;
+	// link quality of this frame, as given by the driver
+	radio_cm->rbuffer_ [radio_cm->rbuflast_].lqi =
+			packetbuf_attr (PACKETBUF_ATTR_LINK_QUALITY) ;
+	return it_receive_frame(radio_cm, len, frm);
 }
 
-uint8_t *it_receive_frame ( uint8_t len, uint8_t *frm)
+uint8_t *it_receive_frame (ConMsg *cm, uint8_t len, uint8_t *frm)
 {
 	//printf ("reçu\n");
-	int newlast = (conmsg->rbuflast_ + 1) % conmsg->msgbufsize_ ;
+	int newlast = (cm->rbuflast_ + 1) % cm->msgbufsize_ ;
 
-	if (newlast == conmsg->rbuffirst_)
-	    conmsg->stat_.rx_overrun++ ;
+	if (newlast == cm->rbuffirst_)
+	    cm->stat_.rx_overrun++ ;
 	else
 	{
 	    /*
@@ -56,17 +90,42 @@ uint8_t *it_receive_frame ( uint8_t len, uint8_t *frm)
 	     * - update the message with length and lqi
 	     * - update the frame buffer pointer
 	     */
-	    conmsg->rbuffer_ [conmsg->rbuflast_].len = len ;
+	    cm->rbuffer_ [cm->rbuflast_].len = len ;
 
-	    conmsg->rbuflast_ = newlast ;
+	    cm->rbuflast_ = newlast ;
 
-	    frm = (uint8_t *) conmsg->rbuffer_ [newlast].frame ;
+	    frm = (uint8_t *) cm->rbuffer_ [newlast].frame ;
 	}
-	//printf("%d   :   %d\n", conmsg->rbuffirst_, conmsg->rbuflast_);
+	//printf("%d   :   %d\n", cm->rbuffirst_, cm->rbuflast_);
+
+	// wake up the process waiting for frames (even on overrun)
+	if (cm->proc_ != NULL)
+	    process_poll (cm->proc_) ;
     return frm;
 }
 
 
+/*
+ * Called by a transport (see setTransport) when a frame is received:
+ * the frame is copied in the reception buffer, as the radio driver
+ * does. Returns false if the buffer is full.
+ */
+
+bool deliver_frame (ConMsg *cm, const uint8_t *frame, uint8_t len, uint8_t lqi)
+{
+    uint8_t *frm ;
+    int last ;
+
+    if (len > MAX_PAYLOAD || ! cm->radio_on_)
+		return false ;
+    last = cm->rbuflast_ ;
+    frm = (uint8_t *) cm->rbuffer_ [last].frame ;
+    memcpy (frm, frame, len) ;
+    cm->rbuffer_ [last].lqi = lqi ;
+    return it_receive_frame (cm, len, frm) != frm ;
+}
+
+
 /*
  * Called by interrupt routine (see radio_rfa.c) when a transmission
  * is done. Update statistics.
@@ -74,56 +133,64 @@ uint8_t *it_receive_frame ( uint8_t len, uint8_t *frm)
 
 void usr_radio_tx_done ()
 {
-	it_tx_done();
+	if (radio_cm != NULL)
+	    it_tx_done(radio_cm);
 }
 
 
-void it_tx_done ()
+void it_tx_done (ConMsg *cm)
 {
 	
-    conmsg->writing_ = false ;
+    cm->writing_ = false ;
+    if (cm->proc_ != NULL)
+	process_poll (cm->proc_) ;
 }
 
 
 
-void init() {
-	conmsg->chan_ = 13;
-	conmsg->writing_ = false;
+void init(ConMsg *cm) {
+	cm->chan_ = 13;
+	cm->writing_ = false;
 }
 
 
-void start() {
+void start(ConMsg *cm) {
 	
-	if (conmsg->msgbufsize_ == 0)		// prevent stupid errors...
-		conmsg->msgbufsize_ = DEFAULT_MSGBUF_SIZE ;
+	if (cm->msgbufsize_ == 0)		// prevent stupid errors...
+		cm->msgbufsize_ = DEFAULT_MSGBUF_SIZE ;
 
-	if (conmsg->rbuffer_ != NULL) {
-		conmsg->rbuffer_ =NULL ;	
+	if (cm->rbuffer_ != NULL) {
+		cm->rbuffer_ =NULL ;	
 	}
 	
-    conmsg->rbuffer_ = (ConBuf *)malloc(sizeof(struct ConBuf)*conmsg->msgbufsize_) ;
-    if (conmsg->rbuffer_ == NULL)
+    cm->rbuffer_ = (ConBuf *)calloc(cm->msgbufsize_, sizeof(struct ConBuf)) ;
+    if (cm->rbuffer_ == NULL)
     	printf("Memory allocation failed\n");
 
-    conmsg->rbuffirst_ = 0 ;
-    conmsg->rbuflast_ = 0 ;
+    cm->rbuffirst_ = 0 ;
+    cm->rbuflast_ = 0 ;
     
-    conmsg->writing_ = false;
-    conmsg->seqnum_ = 0;
+    cm->writing_ = false;
+    cm->seqnum_ = 0;
+    cm->proc_ = NULL ;
+    memset (&cm->stat_, 0, sizeof cm->stat_) ;
 
-    setChannelRadio(conmsg->chan_);
+    radio_cm = cm ;			// the radio now delivers to this instance
+    setChannelRadio(cm->chan_);
     NETSTACK_RADIO.init();
-    initBuf((uint8_t *) conmsg->rbuffer_ [conmsg->rbuflast_].frame, MAX_PAYLOAD);
+    initBuf((uint8_t *) cm->rbuffer_ [cm->rbuflast_].frame, MAX_PAYLOAD);
     NETSTACK_RADIO.on();
+    cm->radio_on_ = true ;
 
 }
 
 
 
-bool sendto (  addr2_t a,  const uint8_t payload[], uint8_t len ) {
+bool sendto (ConMsg *cm, addr2_t a,  const uint8_t payload[], uint8_t len ) {
 	uint8_t frame[MAX_PAYLOAD];
 	uint16_t fcf ;
 	int frmlen ;
+	int ret ;
 	frmlen = 9 + len ;
 	if(frmlen > MAX_PAYLOAD)
 		return false;
@@ -142,10 +209,10 @@ bool sendto (  addr2_t a,  const uint8_t payload[], uint8_t len ) {
 	    ;
 
 	Z_SET_INT16 (&frame [0], fcf) ;		// fcf
-    frame [2] = ++conmsg->seqnum_ ; ;			// seq
-    Z_SET_INT16 (&frame [3], conmsg->panid_) ;		// dst panid
+    frame [2] = ++cm->seqnum_ ; ;			// seq
+    Z_SET_INT16 (&frame [3], cm->panid_) ;		// dst panid
     Z_SET_INT16 (&frame [5], a) ;		// dst addr
-    Z_SET_INT16 (&frame [7], conmsg->addr2_) ;		// src addr
+    Z_SET_INT16 (&frame [7], cm->addr2_) ;		// src addr
 
     memcpy (frame + 9, payload, len) ;
 
@@ -156,23 +223,48 @@ bool sendto (  addr2_t a,  const uint8_t payload[], uint8_t len ) {
     // }
     // printf("\n");
     //printf("envoyé\n" );
-    conmsg->writing_ = true ;
-    NETSTACK_RADIO.send (frame, frmlen) ;
+    if (cm->tx_ != NULL)
+		ret = (*cm->tx_) (cm->txarg_, frame, frmlen) ;
+    else
+    {
+		cm->writing_ = true ;
+		ret = NETSTACK_RADIO.send (frame, frmlen) ;
+
+		// the driver calls usr_radio_tx_done only for a frame
+		// actually sent: on error (busy radio, PLL) do not wait
+		if (ret == RADIO_TX_OK)
+		    while (cm->writing_);
+		else cm->writing_ = false ;
+    }
 
-    while (conmsg->writing_);
-	return true;
+    switch (ret)
+    {
+	case RADIO_TX_OK :
+	    cm->stat_.tx_sent++ ;
+	    break ;
+	case RADIO_TX_COLLISION :
+	    cm->stat_.tx_error_cca++ ;
+	    break ;
+	case RADIO_TX_NOACK :
+	    cm->stat_.tx_error_noack++ ;
+	    break ;
+	default :
+	    cm->stat_.tx_error_fail++ ;
+	    break ;
+    }
+	return ret == RADIO_TX_OK;
 }
 
 
-ConReceivedFrame *get_received () {
+ConReceivedFrame *get_received (ConMsg *cm) {
 	ConReceivedFrame *r ;
     ConBuf *b ;
 
     platform_enter_critical();
-    if (conmsg->rbuffirst_ == conmsg->rbuflast_) {
+    if (cm->rbuffirst_ == cm->rbuflast_) {
 		b = NULL ;
 	}
-    else  b = &conmsg->rbuffer_ [conmsg->rbuffirst_] ;
+    else  b = &cm->rbuffer_ [cm->rbuffirst_] ;
     platform_exit_critical();
     if (b == NULL){
 		r = NULL ;
@@ -183,7 +275,7 @@ ConReceivedFrame *get_received () {
     	uint8_t *p = (uint8_t *) b->frame ;
 		int intrapan ;
 
-		r = & conmsg->rframe_ ;
+		r = & cm->rframe_ ;
 		r->rawframe = (uint8_t *) b->frame ;
 		r->rawlen = b->len ;
 		r->lqi = b->lqi;
@@ -248,12 +340,25 @@ ConReceivedFrame *get_received () {
 
 
 
-void skip_received ()
+int nb_received (ConMsg *cm)
+{
+    int n ;
+
+    platform_enter_critical();
+    n = cm->rbuflast_ - cm->rbuffirst_ ;
+    platform_exit_critical();
+    if (n < 0)
+		n += cm->msgbufsize_ ;
+    return n ;
+}
+
+
+void skip_received (ConMsg *cm)
 {
 
     platform_enter_critical();
-    if (conmsg->rbuffirst_ != conmsg->rbuflast_)
-		conmsg->rbuffirst_ = (conmsg->rbuffirst_ + 1) % conmsg->msgbufsize_ ;
+    if (cm->rbuffirst_ != cm->rbuflast_)
+		cm->rbuffirst_ = (cm->rbuffirst_ + 1) % cm->msgbufsize_ ;
     platform_exit_critical();
 }
 
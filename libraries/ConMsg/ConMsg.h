@@ -95,8 +95,8 @@
 	    int rx_overrun ;
 	    int rx_crcfail ;
 	    int tx_sent ;
-	    int tx_error_cca ;
-	    int tx_error_noack ;
+	    int tx_error_cca ;		// radio busy (RADIO_TX_COLLISION)
+	    int tx_error_noack ;	// transport only: rf2xx never returns NOACK
 	    int tx_error_fail ;
 	} ConStat;
 
@@ -112,6 +112,17 @@
 	} ConBuf ;
 
 
+	/**
+	 * Frame transport: sends a complete frame (MAC header included,
+	 * FCS excluded) and returns a RADIO_TX_* code. When a transport
+	 * is set (see `setTransport`), it replaces the radio driver: a
+	 * host program may thus run several instances, each attached to
+	 * its own (simulated or bridged) network.
+	 */
+
+	typedef int (*contx_t) (void *arg, const uint8_t *frame, uint8_t len) ;
+
+
 	typedef struct ConMsg {
 		ConStat stat_ ;
 
@@ -132,27 +143,33 @@
 
 		uint8_t seqnum_ ;		// to be placed in MAC header
 		volatile bool writing_ ;
+
+		struct process *proc_ ;		// polled on RX and TX done (or NULL)
+		bool radio_on_ ;		// radio in RX mode
+
+		contx_t tx_ ;			// frame transport (NULL: radio)
+		void *txarg_ ;			// argument of the transport
 	}ConMsg;
 
 
-	ConStat *getstat () ; 
+	ConStat *getstat (ConMsg *cm) ; 
 
-	void init();
+	void init(ConMsg *cm);
 
 	/** Accessor method to get the size (in number of frames) of the receive buffer */
-	int getMsgbufsize () ; 
+	int getMsgbufsize (ConMsg *cm) ; 
 
 	/** Accessor method to get the channel id (11 ... 26) */
-	channel_t getChannel () ;
+	channel_t getChannel (ConMsg *cm) ;
 
 	/** Accessor method to get our 802.15.4 hardware address (16 bits) */
-	addr2_t getAddr2 ()  ; 
+	addr2_t getAddr2 (ConMsg *cm) ; 
 
 	/** Accessor method to get our 802.15.4 hardware address (64 bits) */
-	addr8_t getAddr8 () ; 
+	addr8_t getAddr8 (ConMsg *cm) ; 
 
 	/** Accessor method to get our 802.15.4 PAN id */
-	panid_t getPanid (); 
+	panid_t getPanid (ConMsg *cm) ; 
 
 	/** Accessor method to get the TX power (-17 ... +3 dBM) */
 	//txpwr_t txpower (void) { return txpower_ ; }	// -17 .. +3 dBm
@@ -161,41 +178,60 @@
 	//bool promiscuous (void) { return promisc_ ; }
 
 	/** Mutator method to set the size (in number of frames) of the receive buffer */
-	void setMsgbufsize ( int msgbufsize) ; 
+	void setMsgbufsize (ConMsg *cm, int msgbufsize) ; 
 
 	/** Mutator method to set the channel id (11 ... 26) */
-	void setChannel ( channel_t chan) ;	// 11..26
+	void setChannel (ConMsg *cm, channel_t chan) ;	// 11..26
 
 	/** Mutator method to set our 802.15.4 hardware address (16 bits) */
-	void setAddr2 ( addr2_t addr) ; 
+	void setAddr2 (ConMsg *cm, addr2_t addr) ; 
 
 	/** Mutator method to set our 802.15.4 hardware address (16 bits) */
-	void setAddr8 ( addr8_t addr)  ; 
+	void setAddr8 (ConMsg *cm, addr8_t addr) ; 
 
 	/** Mutator method to set our 802.15.4 PAN id */
-	void setPanid ( panid_t panid)  ; 
+	void setPanid (ConMsg *cm, panid_t panid) ; 
 
 	/** Mutator method to set the TX power (-17 ... +3 dBM) */
 	//void txpower (txpwr_t txpower) { txpower_ = txpower ; }
 
+	/** Mutator method to set the process polled when a frame is
+	 * received or a transmission is done (NULL for none) */
+	void setProcess (ConMsg *cm, struct process *p) ;
+
+	/** Mutator method to switch the radio on (RX mode) or off (sleep) */
+	void setRadio (ConMsg *cm, bool on) ;
+
+	/** Accessor method to get the radio status */
+	bool getRadio (ConMsg *cm) ;
+
+	/** Mutator method to send frames with a transport instead of
+	 * the radio (NULL to use the radio again) */
+	void setTransport (ConMsg *cm, contx_t tx, void *arg) ;
+
 	/** Mutator method to set promiscuous status */
 	//void promiscuous (bool promisc) { promisc_ = promisc ; }
 
-	// Start radio processing
+	// Start radio processing. The radio driver has no context: its
+	// interrupt routine delivers frames to the last started instance.
 
-	void start () ;
+	void start (ConMsg *cm) ;
 
 
 		// Not really public: interrupt functions are designed to
 	// be called outside of an interrupt
-	uint8_t *it_receive_frame ( uint8_t len, uint8_t *frm) ;
-	void it_tx_done () ;
+	uint8_t *it_receive_frame (ConMsg *cm, uint8_t len, uint8_t *frm) ;
+	void it_tx_done (ConMsg *cm) ;
+
+	// Frame received by a transport (copied in the reception buffer)
+	bool deliver_frame (ConMsg *cm, const uint8_t *frame, uint8_t len, uint8_t lqi) ;
 
 	// Send and receive frames
 
-	bool sendto ( addr2_t a,  const uint8_t payload [], uint8_t len) ;
-	ConReceivedFrame *get_received () ;	// get current frame (or NULL)
-	void skip_received () ;	// skip to next read frame
+	bool sendto (ConMsg *cm, addr2_t a, const uint8_t payload [], uint8_t len) ;
+	ConReceivedFrame *get_received (ConMsg *cm) ;	// get current frame (or NULL)
+	void skip_received (ConMsg *cm) ;	// skip to next read frame
+	int nb_received (ConMsg *cm) ;	// number of frames waiting in the buffer
 
 	/**
 	 * Return operational statistics
@@ -203,7 +239,6 @@
 	 * Note that returned ZigMsg::ZigStat structure may still be
 	 * modified by an interrupt routine.
 	 */
-	
-	extern ConMsg *conmsg;
+
 
 #endif
\ No newline at end of file
@@ -1,8 +1,7 @@
 #include "l2-154.h"
 
 
-l2addr_154 *l2addr_154_broadcast;
-addr2_t addr2_broadcast = CONST16 (0xff, 0xff) ;
+static const addr2_t addr2_broadcast = CONST16 (0xff, 0xff) ;
 
 
 /*
@@ -68,20 +67,12 @@ l2addr_154 *init_l2addr_154_char(const char *a)
     }
     if (i < I154_ADDRLEN)
 	buf [i] = b ;
-	
-	addr-> addr_ = CONST16 (buf [0], buf [1]) ;
-    return addr;
-}
-
 
-void setBroasdcastAddr(void) {
-	l2addr_154_broadcast = init_l2addr_154_char("ff:ff");	
+    addr-> addr_ = CONST16 (buf [0], buf [1]) ;
+    return addr;
 }
 
 
-
-
-
 l2addr_154 *init_l2addr_154_addr(const l2addr_154 *x){
 	l2addr_154 *addr =(l2addr_154 *)malloc(sizeof(struct l2addr_154));
 	if (addr == NULL)
@@ -143,20 +134,20 @@ l2net_154* startL2_154 ( l2addr_154 *a, channel_t chan, panid_t panid) {
 	if (l2 == NULL)
 		printf("Memory allocation failed\n");
 	l2->myaddr_ = a ->addr_;
+	l2->bcast_.addr_ = addr2_broadcast ;
 
-	conmsg = (ConMsg * ) malloc (sizeof(ConMsg));
-	if (conmsg == NULL)
+	l2->cm_ = (ConMsg * ) calloc (1, sizeof(ConMsg));
+	if (l2->cm_ == NULL)
 		printf("Memory allocation failed\n");
-    setAddr2 ( l2->myaddr_) ;
-    setChannel ( chan) ;
-    setPanid ( panid) ;
-    setMsgbufsize(10);
-    setBroasdcastAddr();
+    setAddr2 (l2->cm_, l2->myaddr_) ;
+    setChannel (l2->cm_, chan) ;
+    setPanid (l2->cm_, panid) ;
+    setMsgbufsize(l2->cm_, 10);
     l2->mtu_ = I154_MTU ;
 
     l2->curframe_ = NULL;   // no currently received frame
 
-    start () ;
+    start (l2->cm_) ;
     return l2;
 
 }
@@ -170,7 +161,7 @@ bool send (l2net_154 *l2, l2addr_154 *dest, const uint8_t *data, size_t len) {
 	bool success = false;
 
 	if (len <= l2->mtu_ - (I154_SIZE_HEADER + I154_SIZE_FCS))
-		success = sendto ( ( dest)->addr_, data, len) ;
+		success = sendto (l2->cm_, ( dest)->addr_, data, len) ;
 	return success;
 }
 
@@ -192,10 +183,10 @@ l2_recv_t recv (l2net_154 *l2)
 {
     l2_recv_t r ;
     if (l2->curframe_ != NULL) {
-    	skip_received();
+    	skip_received(l2->cm_);
     }
 
-    l2->curframe_ = get_received();
+    l2->curframe_ = get_received(l2->cm_);
     if (l2->curframe_ != NULL
 	    && l2->curframe_->frametype == Z_FT_DATA
 	    && Z_GET_DST_ADDR_MODE (l2->curframe_->fcf) == Z_ADDRMODE_ADDR2
@@ -215,17 +206,35 @@ l2_recv_t recv (l2net_154 *l2)
 }
 
 
+/**
+ * @brief Number of received frames waiting to be read by `recv`
+ *
+ * The frame currently read (if any) is still in the ConMsg buffer
+ * until the next call to `recv`: it is not counted.
+ */
+
+int pending_frames (l2net_154 *l2)
+{
+    int n ;
+
+    n = nb_received (l2->cm_) ;
+    if (l2->curframe_ != NULL && n > 0)
+		n-- ;
+    return n ;
+}
+
+
 /**
  * @brief Returns the broadcast IEEE 802.15.4 address
  *
- * The broadcast IEEE 802.15.4 address is located in a global variable.
- * This method returns its address.
+ * The broadcast IEEE 802.15.4 address is located in the l2net_154
+ * instance. This method returns its address.
  *
  * @return address of an existing l2addr_154 object (do not free it)
  */
 
-l2addr_154 *bcastaddr (void) {
-	return l2addr_154_broadcast;
+l2addr_154 *bcastaddr (l2net_154 *l2) {
+	return &l2->bcast_;
 }
 
 
@@ -269,6 +278,60 @@ l2addr_154 *get_dst (l2net_154 *l2)
 
 
 
+/**
+ * @brief Was the received frame sent to the broadcast address?
+ *
+ * @return true if the destination of the received frame is the
+ *	broadcast address
+ */
+
+bool is_bcast_dst (l2net_154 *l2)
+{
+    return l2->curframe_->dstaddr == addr2_broadcast ;
+}
+
+
+
+/**
+ * @brief Link quality of the received frame
+ *
+ * @return Link Quality Indicator given by the radio (0..255)
+ */
+
+uint8_t get_lqi (l2net_154 *l2)
+{
+    return l2->curframe_->lqi ;
+}
+
+
+
+/**
+ * @brief Switch the radio on or off
+ *
+ * When the radio is off, no frame can be received. It must be
+ * switched on before sending a frame.
+ *
+ * @param on true to switch the radio on (RX mode)
+ */
+
+void set_radio (l2net_154 *l2, bool on)
+{
+    setRadio (l2->cm_, on) ;
+}
+
+
+
+/**
+ * @brief Is the radio on?
+ */
+
+bool is_radio_on (l2net_154 *l2)
+{
+    return getRadio (l2->cm_) ;
+}
+
+
+
 /**
  * @brief Returns the address of the received payload
  *
@@ -319,7 +382,7 @@ void dump_packet (l2net_154 *l2, size_t start, size_t maxlen)
     for (i = start ; i < n ; i++)
     {
 		if (i > start)
-		    printf (' ') ;
+		    printf (" ") ;
 		printf("%x", (l2->curframe_->rawframe [i] >> 4) & 0xf) ;
 		printf("%x", (l2->curframe_->rawframe [i]) & 0xf) ;
     }
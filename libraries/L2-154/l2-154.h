@@ -34,8 +34,10 @@
 
 
 	typedef struct l2net_154 {
+		ConMsg *cm_;		// radio instance (one per l2net_154)
 		ConReceivedFrame *curframe_;
 		addr2_t myaddr_;
+		l2addr_154 bcast_;	// broadcast address (see bcastaddr)
 
 		/** Current MTU value
 		 *
@@ -49,8 +51,6 @@
 	}l2net_154;
 
 
-	extern l2addr_154 *l2addr_154_broadcast;
-
 	void freel2addr_154(l2addr_154 *addr);
 
 	l2addr_154 *init_l2addr_154_char(const char*);
@@ -71,8 +71,6 @@
 
 	bool send (l2net_154 *l2, l2addr_154 *dest, const uint8_t *data, size_t len) ;
 
-	void setBroadcastAddr(void);
-
 	void setMTU(l2net_154 *l2, size_t mtu);
 
 	size_t getMTU(l2net_154 *l2);
@@ -80,10 +78,16 @@
 	// the "recv" method copy the received packet in
 	// the instance private variable (see rbuf_/rbuflen_ below)
 	l2_recv_t recv (l2net_154 *l2) ;
+	int pending_frames (l2net_154 *l2) ;	// received frames not yet read
 
-	l2addr_154 *bcastaddr (void) ;	// return a static variable
+	l2addr_154 *bcastaddr (l2net_154 *l2) ;	// do not free it
 	l2addr_154 *get_src (l2net_154 *l2) ;	// get a new l2addr_154
 	l2addr_154 *get_dst (l2net_154 *l2) ;	// get a new l2addr_154
+	bool is_bcast_dst (l2net_154 *l2) ;	// received on broadcast addr?
+	uint8_t get_lqi (l2net_154 *l2) ;	// link quality of received frame
+
+	void set_radio (l2net_154 *l2, bool on) ;	// radio on (RX) or off
+	bool is_radio_on (l2net_154 *l2) ;
 
 	// Payload (not including MAC header, of course)
 	uint8_t *get_payload (l2net_154 *l2,int offset) ;
@@ -63,8 +63,6 @@ Resource *r2;
 
 PROCESS_THREAD(test, ev, data)
 {
-	static struct etimer et;
-	
 	PROCESS_BEGIN();
 		// LPS331AP pressure sensor initialisation
 	    lps331ap_powerdown();
@@ -86,14 +84,8 @@ PROCESS_THREAD(test, ev, data)
 
 		print_resources (ca) ;
 
-		while(1) {    
-
-			
-	        etimer_set(&et,1.5*CLOCK_SECOND); 
-        	PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
-        	loop(ca);
-
-	     }
+		// the engine runs on radio events and on its own timers
+		start_casan_process (ca) ;
 
  	PROCESS_END();
 
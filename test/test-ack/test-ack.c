@@ -0,0 +1,323 @@
+/*
+ * Test program for the reception of ACK messages by the CASAN engine
+ *
+ * A slave and an emulated master are connected through an in-memory
+ * frame transport (see `setTransport`). Once associated, the slave
+ * sends a CON message to the master, which answers with an empty
+ * ACK. The ACK goes through `loop`: it must complete the CON message,
+ * and must not be answered (it is not a request).
+ *
+ * The master then sends a request with the message id of the CON
+ * message: ids of the master and of the slave come from different
+ * spaces, so this request must be processed, and not taken for a
+ * duplicate.
+ *
+ * At last, the slave is put in queue mode, and the master answers a
+ * CON message after the end of the listen window: the slave must keep
+ * its radio on until the ACK is received, and then go to sleep.
+ */
+
+#include "../../libraries/L2-154/l2-154.h"
+#include "../../libraries/Casan/casan.h"
+
+#define	CHANNEL		17
+#define	PANID		CONST16 (0xca, 0xfe)
+#define	MTU		0
+
+#define	TTL		400		// association: 400 * 50 ms = 20 s
+#define	CASAN_HELLO	"hello=%ld"	// see casan.c
+#define	CASAN_ASSOC_TTL	"ttl=%ld"
+#define	CASAN_ASSOC_MTU	"mtu=%ld"
+
+#define	STEP		10		// ms between two engine loops
+#define	TIMEOUT		8000		// max duration of a phase (ms)
+#define	QUIET		300		// time to wait for an unwanted frame (ms)
+#define	PERIOD		5000		// queue mode: wakeup period (ms)
+#define	LISTEN		100		// queue mode: listen window (ms)
+#define	ACKDELAY	300		// queue mode: ACK sent after the window (ms)
+
+PROCESS(test, "ack test");
+AUTOSTART_PROCESSES(&test);
+
+typedef struct node
+{
+    l2addr_154 *addr ;
+    l2net_154 *l2 ;
+    uint16_t curid ;
+    Msg *in ;
+    Msg *out ;
+} node ;
+
+node slave, mnode ;
+Casan *ca ;
+int slaveid = 169 ;
+int nerr = 0 ;
+
+// frames received by the master since its last ACK
+int rx_after_ack ;
+int last_type, last_code ;
+uint16_t con_id ;			// id of the last CON from the slave
+time_t ackat ;				// time of a delayed ACK (0: none)
+
+conevent_t event ;
+int ncalls ;
+
+void check (bool cond, const char *what)
+{
+    printf ("%s: %s\n", cond ? "ok  " : "FAIL", what) ;
+    if (! cond)
+		nerr++ ;
+}
+
+
+void completed (conevent_t e, Msg *in, uint32_t rtt, void *arg)
+{
+    event = e ;
+    ncalls++ ;
+}
+
+
+/*
+ * Transport: give the frame to the other node
+ */
+
+int transmit (void *arg, const uint8_t *frame, uint8_t len)
+{
+    node *to = (node *) arg == &slave ? &mnode : &slave ;
+
+    (void) deliver_frame (to->l2->cm_, frame, len, 255) ;
+    return RADIO_TX_OK ;
+}
+
+
+void push_query (Msg *m, const char *fmt, long int val)
+{
+    char tmpstr [20] ;
+    option *o ;
+
+    snprintf (tmpstr, sizeof tmpstr, fmt, val) ;
+    o = initOptionOpaque (MO_Uri_Query, tmpstr, strlen (tmpstr)) ;
+    push_option (m, o) ;
+    freeOption (o) ;
+}
+
+
+void send_hello (node *m)
+{
+    resetMsg (m->out) ;
+    set_id (m->out, m->curid++) ;
+    set_type (m->out, COAP_TYPE_NON) ;
+    set_code (m->out, COAP_CODE_POST) ;
+    mk_ctl_msg (m->out) ;
+    push_query (m->out, CASAN_HELLO, 1000) ;
+    (void) sendMsg (m->out, bcastaddr (m->l2)) ;
+}
+
+
+void send_ack (node *m, l2addr_154 *dest)
+{
+    resetMsg (m->out) ;
+    set_id (m->out, con_id) ;
+    set_type (m->out, COAP_TYPE_ACK) ;
+    (void) sendMsg (m->out, dest) ;
+    rx_after_ack = 0 ;
+}
+
+
+// master: answer Discovers with an Assoc, and acknowledge CON messages
+// (after ACKDELAY if the slave is in queue mode)
+void run_master (node *m)
+{
+    l2addr_154 *src ;
+
+    while (pending_frames (m->l2) > 0)
+    {
+		if (recvMsg (m->in) != RECV_OK)
+		    continue ;
+		rx_after_ack++ ;
+		last_type = get_type (m->in) ;
+		last_code = get_code (m->in) ;
+		src = get_src (m->l2) ;
+		resetMsg (m->out) ;
+		if (is_ctl_msg (m->in) && is_discover (m->in))
+		{
+		    set_id (m->out, m->curid++) ;
+		    set_type (m->out, COAP_TYPE_CON) ;
+		    set_code (m->out, COAP_CODE_POST) ;
+		    mk_ctl_msg (m->out) ;
+		    push_query (m->out, CASAN_ASSOC_TTL, TTL) ;
+		    push_query (m->out, CASAN_ASSOC_MTU, 127) ;
+		    (void) sendMsg (m->out, src) ;
+		}
+		else if (get_type (m->in) == COAP_TYPE_CON)
+		{
+		    con_id = get_id (m->in) ;
+		    if (ca->sleepperiod_ > 0)
+				ackat = ca->curtime_ + ACKDELAY ;
+		    else send_ack (m, src) ;
+		}
+		freel2addr_154 (src) ;
+    }
+    if (ackat != 0 && ca->curtime_ >= ackat)
+    {
+		ackat = 0 ;
+		send_ack (m, slave.addr) ;
+    }
+}
+
+
+void start_node (node *n, const char *addr)
+{
+    n->addr = init_l2addr_154_char (addr) ;
+    n->l2 = startL2_154 (n->addr, CHANNEL, PANID) ;
+    setTransport (n->l2->cm_, transmit, n) ;
+    n->curid = 1 ;
+    n->in = initMsg (n->l2) ;
+    n->out = initMsg (n->l2) ;
+}
+
+
+void send_con (void)
+{
+    Msg *m ;
+    option *up ;
+
+    m = initMsg (slave.l2) ;
+    set_code (m, COAP_CODE_POST) ;
+    up = initOptionOpaque (MO_Uri_Path, (void *) "event", 5) ;
+    push_option (m, up) ;
+    freeOption (up) ;
+    check (send_confirmable (ca, m, NULL, completed, NULL) == CON_SENT,
+				"CON message sent to the master") ;
+    freeMsg (m) ;
+}
+
+
+// master: request the list of resources, reusing the id of the CON
+void send_request (node *m)
+{
+    option *up ;
+
+    resetMsg (m->out) ;
+    set_id (m->out, con_id) ;
+    set_type (m->out, COAP_TYPE_CON) ;
+    set_code (m->out, COAP_CODE_GET) ;
+    up = initOptionOpaque (MO_Uri_Path, (void *) "resources", 9) ;
+    push_option (m->out, up) ;
+    freeOption (up) ;
+    rx_after_ack = 0 ;
+    (void) sendMsg (m->out, slave.addr) ;
+}
+
+
+/*
+ * Test phases: each one waits for a condition, checked after each
+ * engine loop, and fails after TIMEOUT.
+ */
+
+enum { PH_ASSOC, PH_ACK, PH_QUIET, PH_REQUEST, PH_QUEUE, PH_DONE } ;
+
+int phase = PH_ASSOC ;
+time_t phstart ;
+
+void next_phase (bool ok, const char *what)
+{
+    check (ok, what) ;
+    phase = ok ? phase + 1 : PH_DONE ;
+    phstart = ca->curtime_ ;
+}
+
+void step (void)
+{
+    time_t elapsed = ca->curtime_ - phstart ;
+
+    switch (phase)
+    {
+		case PH_ASSOC :			// associate with the master
+		    if (ca->status_ == SL_RUNNING)
+		    {
+				next_phase (true, "associated") ;
+				send_con () ;
+		    }
+		    else if (elapsed > TIMEOUT)
+				next_phase (false, "associated") ;
+		    break ;
+
+		case PH_ACK :			// the ACK completes the CON
+		    if (ncalls > 0)
+		    {
+				check (ncalls == 1 && event == CON_ACK, "CON message acknowledged") ;
+				next_phase (ca->retrans_->nused_ == 0, "retransmission stopped") ;
+		    }
+		    else if (elapsed > TIMEOUT)
+				next_phase (false, "CON message acknowledged") ;
+		    break ;
+
+		case PH_QUIET :			// the ACK is not answered
+		    if (rx_after_ack > 0)
+		    {
+				printf ("unexpected frame type %d code %d.%02d\n",
+					last_type, last_code >> 5, last_code & 0x1f) ;
+				next_phase (false, "no answer to the ACK") ;
+		    }
+		    else if (elapsed > QUIET)
+		    {
+				next_phase (true, "no answer to the ACK") ;
+				send_request (&mnode) ;
+		    }
+		    break ;
+
+		case PH_REQUEST :		// request with the same id
+		    if (rx_after_ack > 0)
+		    {
+				check (last_type == COAP_TYPE_ACK && last_code == COAP_CODE_OK,
+							"request with the id of the CON answered 2.05") ;
+				next_phase (ca->stat_.dup_replayed == 0, "request not taken for a duplicate") ;
+				ncalls = 0 ;
+				set_queue_mode (ca, PERIOD, LISTEN) ;
+				send_con () ;
+		    }
+		    else if (elapsed > TIMEOUT)
+				next_phase (false, "request answered") ;
+		    break ;
+
+		case PH_QUEUE :			// ACK after the listen window
+		    if (ncalls > 0)
+		    {
+				check (event == CON_ACK && ca->stat_.ackwaits == 1,
+							"listen window extended until the ACK") ;
+				next_phase (! ca->awake_ && elapsed < LISTEN + CASAN_ACKWAIT_MAX,
+							"radio off once the CON is acknowledged") ;
+		    }
+		    else if (elapsed > TIMEOUT)
+				next_phase (false, "CON acknowledged after the listen window") ;
+		    break ;
+    }
+}
+
+
+PROCESS_THREAD(test, ev, data)
+{
+	static struct etimer et;
+
+	PROCESS_BEGIN();
+
+		start_node (&slave, "45:67") ;
+		start_node (&mnode, "00:0a") ;
+		ca = initCasan (slave.l2, MTU, slaveid) ;
+		phstart = ca->curtime_ ;
+		send_hello (&mnode) ;
+
+		while (phase != PH_DONE) {
+			run_master (&mnode) ;
+			loop (ca) ;
+			step () ;
+
+	        etimer_set(&et,STEP*CLOCK_SECOND/1000);
+        	PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+	    }
+
+		printf ("%s (%d errors)\n", nerr == 0 ? "PASSED" : "FAILED", nerr) ;
+
+	PROCESS_END();
+}
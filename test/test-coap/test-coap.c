@@ -50,6 +50,8 @@ void test_send (l2net_154 *l2, l2addr_154 *dest)
     option *up2 = initOptionOpaque(MO_Uri_Path, PATH2, sizeof PATH2 - 1) ;
     option *up3 = initOptionOpaque(MO_Uri_Path, PATH3, sizeof PATH3 - 1) ;
     option *ocf = initOptionOpaque(MO_Content_Format, "abc", sizeof "abc" - 1) ;
+    // option number > 255 : exercises the extended option delta
+    option *onr = initOptionInteger(MO_No_Response, NR_SUPPRESS_2XX | NR_SUPPRESS_4XX) ;
 
     set_id (m1, 258) ;
     set_type (m1, COAP_TYPE_NON) ;
@@ -57,6 +59,7 @@ void test_send (l2net_154 *l2, l2addr_154 *dest)
     push_option (m1, up1) ;
     push_option (m1, up2) ;
     push_option (m1, up3) ;
+    push_option (m1, onr) ;
     ok = sendMsg (m1, dest) ;
     res_send (1, ok) ;
 
@@ -79,7 +82,7 @@ PROCESS_THREAD(test, ev, data)
 	PROCESS_BEGIN();
 		myaddr = init_l2addr_154_char("45:67");
 	    l2 = startL2_154( myaddr, CHANNEL, PANID); 
-	    dest = l2addr_154_broadcast;
+	    dest = bcastaddr (l2);
 	    setMTU(l2, MTU);
 		while(1) {    
 
@@ -124,7 +124,7 @@ void send_l2 (l2net_154 *l2, l2addr_154 *destaddr)
 
     bool r ;
 
-    r = send (l2, bcastaddr (), (uint8_t *) testpkt, sizeof testpkt - 1) ;
+    r = send (l2, bcastaddr (l2), (uint8_t *) testpkt, sizeof testpkt - 1) ;
     printf ("Sent broadcast: r = %d\n",r ) ;
 
     // r = send (l2, destaddr, (uint8_t *) testpkt, sizeof testpkt - 1) ;
@@ -134,6 +134,7 @@ void send_l2 (l2net_154 *l2, l2addr_154 *destaddr)
 PROCESS_THREAD(test, ev, data)
 {
     static struct etimer et;
+    static ConMsg *cm;
     l2addr_154 *myaddr = init_l2addr_154_char("45:67");
     l2addr_154 *destaddr = init_l2addr_154_char("12:34");
 
@@ -146,20 +147,20 @@ PROCESS_THREAD(test, ev, data)
 
     printf ("%s : %s=", YELLOW ("OPTION"), RED ("optcode")) ;
 
-    conmsg = (ConMsg * ) malloc (sizeof(ConMsg));
-    setMsgbufsize(10);
-    setChannel(17);
-    start();
+    cm = (ConMsg * ) calloc (1, sizeof(ConMsg));
+    setMsgbufsize(cm, 10);
+    setChannel(cm, 17);
+    start(cm);
     
      
     while(1) {
 
         etimer_set(&et,5*CLOCK_SECOND);
         PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
-        if(sendto( ( destaddr)->addr_, (uint8_t *) testpkt, sizeof testpkt - 1)) {
+        if(sendto(cm, ( destaddr)->addr_, (uint8_t *) testpkt, sizeof testpkt - 1)) {
             printf("message sent\n");
         }
-        if (sendto(( destaddr)->addr_, (uint8_t *) testpkt2, sizeof testpkt2 - 1)){
+        if (sendto(cm, ( destaddr)->addr_, (uint8_t *) testpkt2, sizeof testpkt2 - 1)){
             printf("message sent\n");
         }
 
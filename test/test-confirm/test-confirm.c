@@ -0,0 +1,125 @@
+/*
+ * Test program for CASAN confirmable messages (send_confirmable)
+ *
+ * The slave is not associated: messages are sent to an explicit
+ * destination. The same message is sent twice, and each transmission
+ * must carry its own message id, such that the ACK for each one is
+ * matched. Messages to an explicit destination must not be
+ * cancelled because there is no master.
+ */
+
+#include "../../libraries/L2-154/l2-154.h"
+#include "../../libraries/Casan/casan.h"
+
+#define	CHANNEL		17
+#define	PANID		CONST16 (0xca, 0xfe)
+#define	MTU		0
+
+PROCESS(test, "confirmable test");
+AUTOSTART_PROCESSES(&test);
+
+int slaveid = 169 ;
+int nerr = 0 ;
+
+conevent_t event [2] ;
+int ncalls [2] ;
+
+void completed (conevent_t e, Msg *in, uint32_t rtt, void *arg)
+{
+    int *n = (int *) arg ;
+
+    event [*n] = e ;
+    ncalls [*n]++ ;
+}
+
+void check (bool cond, const char *what)
+{
+    printf ("%s: %s\n", cond ? "ok  " : "FAIL", what) ;
+    if (! cond)
+		nerr++ ;
+}
+
+
+// message id of the frame kept by Retrans for this id (-1 if not found)
+int kept_id (Retrans *rt, uint16_t id)
+{
+    int s ;
+
+    for (s = 0 ; s < RETRANS_MAX ; s++)
+    {
+		retransq *r = &rt->slot_ [s] ;
+
+		if (r->used && r->f.id == id)
+		    return (rt->ring_ [r->f.off + 2] << 8) | rt->ring_ [r->f.off + 3] ;
+    }
+    return -1 ;
+}
+
+
+void test_send_twice (Casan *ca, l2net_154 *l2)
+{
+    static int arg [2] = { 0, 1 } ;
+    l2addr_154 *dest ;
+    Msg *m, *ack ;
+    option *up ;
+    uint16_t id1, id2 ;
+    constatus_t r ;
+
+    dest = init_l2addr_154_char ("12:34") ;
+    m = initMsg (l2) ;
+    set_code (m, COAP_CODE_GET) ;
+    up = initOptionOpaque (MO_Uri_Path, (void *) "temp", 4) ;
+    push_option (m, up) ;
+    freeOption (up) ;
+
+    r = send_confirmable (ca, m, dest, completed, &arg [0]) ;
+    id1 = get_id (m) ;
+    check (r == CON_SENT, "first message sent") ;
+    check (kept_id (ca->retrans_, id1) == id1, "first frame carries its id") ;
+
+    // same message again (e.g. after a modification of the payload):
+    // it waits for the first one (NSTART)
+    set_payload_msg (m, (uint8_t *) "x", 1) ;
+    r = send_confirmable (ca, m, dest, completed, &arg [1]) ;
+    id2 = get_id (m) ;
+    check (r == CON_SENT || r == CON_QUEUED, "second message accepted") ;
+    check (id2 != id1, "second message has a new id") ;
+
+    // no master: messages to an explicit destination are kept
+    loopRetrans (ca->retrans_, l2, &ca->curtime_) ;
+    check (ncalls [0] == 0 && ncalls [1] == 0, "messages not cancelled without master") ;
+
+    ack = initMsg (l2) ;
+    set_type (ack, COAP_TYPE_ACK) ;
+    set_id (ack, id1) ;
+    check (delRetrans (ca->retrans_, ack, dest), "ACK matches the first message") ;
+    check (ncalls [0] == 1 && event [0] == CON_ACK, "first message acknowledged") ;
+    check (kept_id (ca->retrans_, id2) == id2, "second frame carries its new id") ;
+
+    set_id (ack, id2) ;
+    check (delRetrans (ca->retrans_, ack, dest), "ACK matches the second message") ;
+    check (ncalls [1] == 1 && event [1] == CON_ACK, "second message acknowledged") ;
+
+    freeMsg (ack) ;
+    freeMsg (m) ;
+    freel2addr_154 (dest) ;
+}
+
+
+PROCESS_THREAD(test, ev, data)
+{
+	static l2addr_154 *myaddr ;
+	static l2net_154 *l2 ;
+	static Casan *ca ;
+
+	PROCESS_BEGIN();
+
+		myaddr = init_l2addr_154_char ("45:67") ;
+		l2 = startL2_154 (myaddr, CHANNEL, PANID) ;
+		ca = initCasan (l2, MTU, slaveid) ;
+
+		test_send_twice (ca, l2) ;
+		printf ("%s (%d errors)\n", nerr == 0 ? "PASSED" : "FAILED", nerr) ;
+
+	PROCESS_END();
+}
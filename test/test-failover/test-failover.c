@@ -0,0 +1,307 @@
+/*
+ * Test program for CASAN master failover
+ *
+ * A slave and two emulated masters (A and B) are connected through
+ * an in-memory frame transport (see `setTransport`): frames never go
+ * on the air. The slave associates with A, then gets a standby
+ * association with B, and answers a request from B to B itself.
+ * While A answers, renewals keep A as the master.
+ * When A stops answering, the slave must switch to B after
+ * CASAN_FAILOVER_TRIES unanswered renewal Discovers, well before the
+ * end of its association with A.
+ */
+
+#include "../../libraries/L2-154/l2-154.h"
+#include "../../libraries/Casan/casan.h"
+
+#define	CHANNEL		17
+#define	PANID		CONST16 (0xca, 0xfe)
+#define	MTU		0
+
+#define	TTL_A		80		// association with A: 80 * 50 ms = 4 s
+#define	TTL_B		400		// association with B: 20 s
+#define	CASAN_HELLO	"hello=%ld"	// see casan.c
+#define	CASAN_ASSOC_TTL	"ttl=%ld"
+#define	CASAN_ASSOC_MTU	"mtu=%ld"
+
+#define	STEP		10		// ms between two engine loops
+#define	TIMEOUT		8000		// max duration of a phase (ms)
+#define	MARGIN		200		// scheduling margin (ms)
+
+PROCESS(test, "failover test");
+AUTOSTART_PROCESSES(&test);
+
+typedef struct node
+{
+    l2net_154 *l2 ;
+    bool master ;
+    bool alive ;			// master: answers frames
+    long int hlid ;
+    uint16_t curid ;
+    Msg *in ;
+    Msg *out ;
+    int discovers ;			// master: Discovers received
+    int responses ;			// master: responses received
+} node ;
+
+#define	SLAVE	0
+#define	MA	1
+#define	MB	2
+
+node nodes [3] ;
+Casan *ca ;
+int slaveid = 169 ;
+int nerr = 0 ;
+time_t lastA ;				// last answer of master A
+
+void check (bool cond, const char *what)
+{
+    printf ("%s: %s\n", cond ? "ok  " : "FAIL", what) ;
+    if (! cond)
+		nerr++ ;
+}
+
+
+/*
+ * Transport: give the frame to its destination (or to all other
+ * nodes for a broadcast). Dead masters do not receive anything.
+ */
+
+int transmit (void *arg, const uint8_t *frame, uint8_t len)
+{
+    node *from = (node *) arg ;
+    addr2_t dst ;
+    int i ;
+
+    dst = frame [5] | (frame [6] << 8) ;
+    for (i = 0 ; i < NTAB (nodes) ; i++)
+    {
+		node *n = &nodes [i] ;
+
+		if (n == from || (n->master && ! n->alive))
+		    continue ;
+		if (dst == 0xffff || dst == getAddr2 (n->l2->cm_))
+		    (void) deliver_frame (n->l2->cm_, frame, len, 255) ;
+    }
+    return RADIO_TX_OK ;
+}
+
+
+void push_query (Msg *m, const char *fmt, long int val)
+{
+    char tmpstr [20] ;
+    option *o ;
+
+    snprintf (tmpstr, sizeof tmpstr, fmt, val) ;
+    o = initOptionOpaque (MO_Uri_Query, tmpstr, strlen (tmpstr)) ;
+    push_option (m, o) ;
+    freeOption (o) ;
+}
+
+
+void send_hello (node *m)
+{
+    resetMsg (m->out) ;
+    set_id (m->out, m->curid++) ;
+    set_type (m->out, COAP_TYPE_NON) ;
+    set_code (m->out, COAP_CODE_POST) ;
+    mk_ctl_msg (m->out) ;
+    push_query (m->out, CASAN_HELLO, m->hlid) ;
+    (void) sendMsg (m->out, bcastaddr (m->l2)) ;
+}
+
+
+// master: answer Discovers with an Assoc, and acknowledge CON messages
+void run_master (node *m, int ttl)
+{
+    l2addr_154 *src ;
+
+    while (pending_frames (m->l2) > 0)
+    {
+		if (recvMsg (m->in) != RECV_OK)
+		    continue ;
+		src = get_src (m->l2) ;
+		resetMsg (m->out) ;
+		if (is_ctl_msg (m->in) && is_discover (m->in))
+		{
+		    m->discovers++ ;
+		    set_id (m->out, m->curid++) ;
+		    set_type (m->out, COAP_TYPE_CON) ;
+		    set_code (m->out, COAP_CODE_POST) ;
+		    mk_ctl_msg (m->out) ;
+		    push_query (m->out, CASAN_ASSOC_TTL, ttl) ;
+		    push_query (m->out, CASAN_ASSOC_MTU, 127) ;
+		    (void) sendMsg (m->out, src) ;
+		}
+		else if (get_type (m->in) == COAP_TYPE_ACK && get_code (m->in) != COAP_CODE_EMPTY)
+		    m->responses++ ;
+		else if (get_type (m->in) == COAP_TYPE_CON)
+		{
+		    set_id (m->out, get_id (m->in)) ;
+		    set_type (m->out, COAP_TYPE_ACK) ;
+		    (void) sendMsg (m->out, src) ;
+		}
+		if (m == &nodes [MA])
+		    lastA = ca->curtime_ ;
+		freel2addr_154 (src) ;
+    }
+}
+
+
+// master: request the list of resources
+void send_request (node *m)
+{
+    l2addr_154 *a ;
+    option *up ;
+
+    resetMsg (m->out) ;
+    set_id (m->out, m->curid++) ;
+    set_type (m->out, COAP_TYPE_CON) ;
+    set_code (m->out, COAP_CODE_GET) ;
+    up = initOptionOpaque (MO_Uri_Path, (void *) "resources", 9) ;
+    push_option (m->out, up) ;
+    freeOption (up) ;
+    a = init_l2addr_154_char ("45:67") ;
+    (void) sendMsg (m->out, a) ;
+    freel2addr_154 (a) ;
+}
+
+
+void start_node (node *n, const char *addr, bool master, long int hlid)
+{
+    l2addr_154 *a ;
+
+    a = init_l2addr_154_char (addr) ;
+    n->l2 = startL2_154 (a, CHANNEL, PANID) ;
+    setTransport (n->l2->cm_, transmit, n) ;
+    n->master = master ;
+    n->alive = true ;
+    n->hlid = hlid ;
+    n->curid = 1 ;
+    n->in = initMsg (n->l2) ;
+    n->out = initMsg (n->l2) ;
+}
+
+
+bool is_master (node *m)
+{
+    l2addr_154 a ;
+
+    a.addr_ = getAddr2 (m->l2->cm_) ;
+    return same_master (ca, &a) ;
+}
+
+
+/*
+ * Test phases: each one waits for a condition, checked after each
+ * engine loop, and fails after TIMEOUT.
+ */
+
+enum { PH_ASSOC, PH_STANDBY, PH_REQUEST, PH_RENEW, PH_FAILOVER, PH_DONE } ;
+
+int phase = PH_ASSOC ;
+time_t phstart ;
+
+void next_phase (bool ok, const char *what)
+{
+    check (ok, what) ;
+    phase = ok ? phase + 1 : PH_DONE ;
+    phstart = ca->curtime_ ;
+}
+
+void step (void)
+{
+    time_t elapsed = ca->curtime_ - phstart ;
+
+    switch (phase)
+    {
+		case PH_ASSOC :			// associate with A
+		    if (ca->status_ == SL_RUNNING && is_master (&nodes [MA]))
+		    {
+				next_phase (true, "associated with A") ;
+				send_hello (&nodes [MB]) ;
+		    }
+		    else if (elapsed > TIMEOUT)
+				next_phase (false, "associated with A") ;
+		    break ;
+
+		case PH_STANDBY :		// standby association with B
+		    if (get_standby (ca) != NULL)
+		    {
+				next_phase (true, "standby association with B") ;
+				nodes [MA].responses = nodes [MB].responses = 0 ;
+				send_request (&nodes [MB]) ;
+		    }
+		    else if (elapsed > TIMEOUT)
+				next_phase (false, "standby association with B") ;
+		    break ;
+
+		case PH_REQUEST :		// B is answered, not A
+		    if (nodes [MB].responses > 0)
+				next_phase (nodes [MA].responses == 0, "request from B answered to B") ;
+		    else if (elapsed > TIMEOUT)
+				next_phase (false, "request from B answered to B") ;
+		    break ;
+
+		case PH_RENEW :			// A answers renewals: A is kept
+		    if (ca->stat_.renew_sent > 0 && ca->status_ == SL_RUNNING
+				&& elapsed > TTL_A * 50)
+		    {
+				check (is_master (&nodes [MA]) && ca->stat_.failovers == 0,
+							"renewed with A, no failover") ;
+				next_phase (true, "A stops answering") ;
+				nodes [MA].alive = false ;
+		    }
+		    else if (elapsed > TIMEOUT)
+				next_phase (false, "renewal with A") ;
+		    break ;
+
+		case PH_FAILOVER :		// A is dead: switch to B
+		    if (ca->stat_.failovers > 0)
+		    {
+				time_t max = TTL_A * 50 / 2 + CASAN_FAILOVER_TRIES * CASAN_FAILOVER_WAIT ;
+
+				check (is_master (&nodes [MB]) && ca->status_ == SL_RUNNING,
+							"B is the new master") ;
+				printf ("failover %ld ms after the last answer of A (max %ld, association %d ms)\n",
+							(long int) (ca->curtime_ - lastA), (long int) max, TTL_A * 50) ;
+				next_phase (ca->curtime_ - lastA <= max + MARGIN,
+							"failover after unanswered renewal Discovers") ;
+		    }
+		    else if (elapsed > TIMEOUT)
+				next_phase (false, "failover to B") ;
+		    break ;
+    }
+}
+
+
+PROCESS_THREAD(test, ev, data)
+{
+	static struct etimer et;
+
+	PROCESS_BEGIN();
+
+		start_node (&nodes [SLAVE], "45:67", false, 0) ;
+		start_node (&nodes [MA], "00:0a", true, 1000) ;
+		start_node (&nodes [MB], "00:0b", true, 2000) ;
+		ca = initCasan (nodes [SLAVE].l2, MTU, slaveid) ;
+		phstart = ca->curtime_ ;
+		send_hello (&nodes [MA]) ;
+
+		while (phase != PH_DONE) {
+			if (nodes [MA].alive)
+				run_master (&nodes [MA], TTL_A) ;
+			run_master (&nodes [MB], TTL_B) ;
+			loop (ca) ;
+			step () ;
+
+	        etimer_set(&et,STEP*CLOCK_SECOND/1000);
+        	PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+	    }
+
+		printf ("renewal Discovers %d, failovers %d\n",
+					ca->stat_.renew_sent, ca->stat_.failovers) ;
+		printf ("%s (%d errors)\n", nerr == 0 ? "PASSED" : "FAILED", nerr) ;
+
+	PROCESS_END();
+}
@@ -0,0 +1,153 @@
+/*
+ * Test program for the estimation of the group size used to delay
+ * responses to broadcast requests (leisure)
+ *
+ * Discovers of other slaves are given to the engine through an
+ * in-memory frame transport (see `setTransport`), either broadcast
+ * or sent to a master (overheard). Then, the estimation is checked
+ * for larger groups, and against a group size given to set_leisure.
+ */
+
+#include "../../libraries/L2-154/l2-154.h"
+#include "../../libraries/Casan/casan.h"
+
+#define	CHANNEL		17
+#define	PANID		CONST16 (0xca, 0xfe)
+#define	MTU		0
+
+#define	CASAN_DISCOVER_SLAVEID	"slave=%ld"	// see casan.c
+#define	DEFAULT_GROUPSIZE	10		// CASAN_DEFAULT_GROUPSIZE
+
+PROCESS(test, "leisure test");
+AUTOSTART_PROCESSES(&test);
+
+l2net_154 *l2slave, *l2other ;
+Casan *ca ;
+int slaveid = 169 ;
+int nerr = 0 ;
+
+void check (bool cond, const char *what)
+{
+    printf ("%s: %s\n", cond ? "ok  " : "FAIL", what) ;
+    if (! cond)
+		nerr++ ;
+}
+
+
+// transport of the other slave: all frames go to our slave
+int transmit (void *arg, const uint8_t *frame, uint8_t len)
+{
+    (void) deliver_frame (l2slave->cm_, frame, len, 255) ;
+    return RADIO_TX_OK ;
+}
+
+
+// Discover sent by the other slave, with its address set to addr
+void send_discover_from (const char *addr, l2addr_154 *dest)
+{
+    l2addr_154 *a ;
+    char tmpstr [20] ;
+    option *o ;
+    Msg *m ;
+
+    a = init_l2addr_154_char (addr) ;
+    setAddr2 (l2other->cm_, a->addr_) ;
+    freel2addr_154 (a) ;
+
+    m = initMsg (l2other) ;
+    set_type (m, COAP_TYPE_NON) ;
+    set_code (m, COAP_CODE_POST) ;
+    mk_ctl_msg (m) ;
+    snprintf (tmpstr, sizeof tmpstr, CASAN_DISCOVER_SLAVEID, 1000L) ;
+    o = initOptionOpaque (MO_Uri_Query, tmpstr, strlen (tmpstr)) ;
+    push_option (m, o) ;
+    freeOption (o) ;
+    (void) sendMsg (m, dest) ;
+    freeMsg (m) ;
+    loop (ca) ;
+}
+
+
+void test_heard (void)
+{
+    l2addr_154 *master ;
+
+    check (ca->groupsize_ == DEFAULT_GROUPSIZE, "default group size") ;
+
+    send_discover_from ("01:00", bcastaddr (l2other)) ;
+    check (ca->groupsize_ == 2, "broadcast Discover counted") ;
+
+    send_discover_from ("01:00", bcastaddr (l2other)) ;
+    check (ca->groupsize_ == 2, "same slave counted once") ;
+
+    master = init_l2addr_154_char ("00:01") ;
+    send_discover_from ("01:01", master) ;
+    check (ca->groupsize_ == 3, "overheard Discover counted") ;
+    freel2addr_154 (master) ;
+}
+
+
+// estimation for n slaves with consecutive addresses
+void test_estimate (void)
+{
+    static int n [] = { 10, 20, 40, 80 } ;
+    int i, k, heard ;
+    l2addr_154 a ;
+
+    heard = ca->groupheard_ ;		// addresses 01:00 and 01:01
+    a.addr_ = 0x0100 + heard ;
+    for (i = 0 ; i < NTAB (n) ; i++)
+    {
+		char what [50] ;
+		int err ;
+
+		for (k = heard ; k < n [i] ; k++)
+		{
+		    group_heard (ca, &a) ;
+		    a.addr_++ ;
+		}
+		heard = n [i] ;
+		err = 100 * (ca->groupsize_ - (n [i] + 1)) / (n [i] + 1) ;
+		printf ("%d slaves heard: group size %d (%d%%)\n", n [i], ca->groupsize_, err) ;
+		snprintf (what, sizeof what, "group of %d slaves within 25%%", n [i] + 1) ;
+		check (err >= -25 && err <= 25, what) ;
+    }
+}
+
+
+void test_fixed (void)
+{
+    int estimated = ca->groupsize_ ;
+    l2addr_154 a ;
+
+    set_leisure (ca, 5, 5000) ;
+    a.addr_ = 0x0300 ;
+    group_heard (ca, &a) ;
+    check (ca->groupsize_ == 5, "group size given to set_leisure is kept") ;
+
+    set_leisure (ca, 0, 5000) ;
+    check (ca->groupsize_ >= estimated, "back to the estimated group size") ;
+}
+
+
+PROCESS_THREAD(test, ev, data)
+{
+	static l2addr_154 *myaddr, *otheraddr ;
+
+	PROCESS_BEGIN();
+
+		myaddr = init_l2addr_154_char ("45:67") ;
+		l2slave = startL2_154 (myaddr, CHANNEL, PANID) ;
+		otheraddr = init_l2addr_154_char ("01:00") ;
+		l2other = startL2_154 (otheraddr, CHANNEL, PANID) ;
+		setTransport (l2other->cm_, transmit, NULL) ;
+		ca = initCasan (l2slave, MTU, slaveid) ;
+		loop (ca) ;			// leave the cold start
+
+		test_heard () ;
+		test_estimate () ;
+		test_fixed () ;
+		printf ("%s (%d errors)\n", nerr == 0 ? "PASSED" : "FAILED", nerr) ;
+
+	PROCESS_END();
+}
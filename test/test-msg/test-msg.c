@@ -77,11 +77,11 @@ void test_msg (void)
     push_option (m2, ouq2) ;
     printMsg (m2) ;	printf("\n") ;
 
-    if (get_errno () != 0)
+    if (get_errno (ouq2) != 0)
     {
 		printf  ("ERROR : ERRNO => ") ;
-		printf ("%d\n",get_errno ()) ;
-		reset_errno () ;
+		printf ("%d\n",get_errno (ouq2)) ;
+		reset_errno (ouq2) ;
     }
 
     clock_delay (1000) ;
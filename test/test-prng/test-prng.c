@@ -0,0 +1,165 @@
+/*
+ * Test program for the CASAN pseudo-random generator
+ *
+ * This is a model of a dense PAN, not a run of the engine: NNODES
+ * slaves send a CON message in the same slot, and all messages are
+ * lost. Each slave retransmits its message, with timeouts computed
+ * as the Retrans class does (see start_con and loopRetrans in
+ * retrans.c), using the library functions:
+ * - getRto: initial RTO for a peer without estimation
+ * - prng_range: initial timeout drawn in [RTO, RTO * ACK_RANDOM_FACTOR],
+ *	with a generator seeded for each node (prng_seed_node)
+ * - backoffRto: timeout of the next retransmission
+ * The draw is compared with a fixed initial timeout (RTO *
+ * ACK_RANDOM_FACTOR, as before the PRNG was introduced). Only the
+ * channel is modelled: two transmissions collide if they overlap in
+ * time, and a slave stops retransmitting as soon as one of its
+ * transmissions succeeds.
+ */
+
+#include "../../libraries/Casan/prng.h"
+#include "../../libraries/Casan/rto.h"
+
+#define	NNODES		40		// number of slaves in the PAN
+#define	AIRTIME		5		// frame duration (ms), 127 bytes @ 250 kb/s
+#define	NRUNS		10		// number of simulations (random mode)
+
+PROCESS(test, "prng test");
+AUTOSTART_PROCESSES(&test);
+
+
+/*
+ * Simulate retransmissions for all slaves, given their initial RTO
+ * and initial timeout. Returns the number of slaves which failed
+ * after MAX_RETRANSMIT retransmissions, and add the number of
+ * collisions to *ncoll.
+ */
+
+int simulate (uint32_t rto0 [], uint32_t timeout [], int *ncoll)
+{
+    bool done [NNODES] ;
+    uint32_t t [NNODES], tmo [NNODES] ;
+    int i, j, k, nfail ;
+
+    for (i = 0 ; i < NNODES ; i++)
+    {
+		done [i] = false ;
+		t [i] = 0 ;
+		tmo [i] = timeout [i] ;
+    }
+
+    // with the back-off, retransmission rounds do not overlap in time:
+    // only transmissions of the same round are compared
+    for (k = 1 ; k <= MAX_RETRANSMIT ; k++)
+    {
+		bool ok [NNODES] ;
+
+		for (i = 0 ; i < NNODES ; i++)
+		{
+		    t [i] += tmo [i] ;
+		    tmo [i] = backoffRto (rto0 [i], tmo [i]) ;
+		}
+
+		for (i = 0 ; i < NNODES ; i++)
+		{
+		    ok [i] = true ;
+		    if (done [i])
+				continue ;
+		    for (j = 0 ; j < NNODES ; j++)
+		    {
+				if (j != i && ! done [j]
+					&& t [i] < t [j] + AIRTIME && t [j] < t [i] + AIRTIME)
+				{
+				    ok [i] = false ;
+				    (*ncoll)++ ;
+				    break ;
+				}
+		    }
+		}
+		for (i = 0 ; i < NNODES ; i++)
+		    if (ok [i])
+				done [i] = true ;
+    }
+
+    nfail = 0 ;
+    for (i = 0 ; i < NNODES ; i++)
+		if (! done [i])
+		    nfail++ ;
+    return nfail ;
+}
+
+
+// initial RTO for a new peer, as seen by each slave
+void initial_rto (uint32_t rto0 [])
+{
+    Rto ro ;
+    l2addr_154 master ;
+    time_t cur = 0 ;
+    int i ;
+
+    resetRto (&ro) ;
+    master.addr_ = 0x0001 ;
+    for (i = 0 ; i < NNODES ; i++)
+		rto0 [i] = getRto (&ro, &master, &cur) ;
+}
+
+
+void test_fixed (void)
+{
+    uint32_t rto0 [NNODES], timeout [NNODES] ;
+    int i, ncoll, nfail ;
+
+    initial_rto (rto0) ;
+    for (i = 0 ; i < NNODES ; i++)
+		timeout [i] = (uint32_t) (rto0 [i] * ACK_RANDOM_FACTOR) ;
+
+    ncoll = 0 ;
+    nfail = simulate (rto0, timeout, &ncoll) ;
+    printf ("fixed timeout:  %d collisions, %d/%d slaves failed\n",
+    			ncoll, nfail, NNODES) ;
+}
+
+
+void test_random (void)
+{
+    uint32_t rto0 [NNODES], timeout [NNODES] ;
+    Prng pr ;
+    int i, run, ncoll, nfail ;
+
+    initial_rto (rto0) ;
+    ncoll = 0 ;
+    nfail = 0 ;
+    for (run = 0 ; run < NRUNS ; run++)
+    {
+		for (i = 0 ; i < NNODES ; i++)
+		{
+		    // each slave has its own address and slave id
+		    prng_seed_node (&pr, 0x1000 + i, 1000 * run + i) ;
+		    timeout [i] = prng_range (&pr, rto0 [i], (uint32_t) (rto0 [i] * ACK_RANDOM_FACTOR)) ;
+		}
+		nfail += simulate (rto0, timeout, &ncoll) ;
+    }
+    printf ("random timeout: %d collisions, %d/%d slaves failed (average on %d runs)\n",
+    			ncoll / NRUNS, nfail / NRUNS, NNODES, NRUNS) ;
+}
+
+
+PROCESS_THREAD(test, ev, data)
+{
+	static struct etimer et;
+
+	PROCESS_BEGIN();
+
+		while(1) {
+			printf ("%d slaves, %d retransmissions, airtime %d ms\n",
+						NNODES, MAX_RETRANSMIT, AIRTIME) ;
+			test_fixed () ;
+			test_random () ;
+			printf("\n");
+
+	        etimer_set(&et,10*CLOCK_SECOND);
+        	PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+	    }
+
+	PROCESS_END();
+}
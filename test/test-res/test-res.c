@@ -3,6 +3,8 @@
  */
 #include "../../libraries/L2-154/l2-154.h"
  #include "../../libraries/Casan/casan.h"
+#include "../../libraries/Casan/patch.h"
+#include "../../libraries/Casan/block.h"
 
 #define	CHANNEL		17
 #define	PANID		CONST16 (0xca, 0xfe)
@@ -17,6 +19,10 @@
 #define R2_title	"temperature"
 #define R2_rt		"°c"
 
+#define R3_name		"conf"
+#define R3_title	"configuration"
+#define R3_rt		"conf"
+
 #define PATH_WK		".well-known"
 #define	PATH_CASAN	"casan"
 
@@ -40,6 +46,183 @@ uint8_t process_temp (Msg *in, Msg *out)
 }
 
 
+/*
+ * Configuration resource: key/value pairs, which may be read or
+ * updated partially with FETCH and PATCH/iPATCH
+ */
+
+char conf [64] = "period=10;unit=s;mode=auto" ;
+
+uint8_t process_conf_get (Msg *in, Msg *out)
+{
+    printf ("process_conf_get\n") ;
+    set_payload_msg (out, (uint8_t *) conf, strlen (conf)) ;
+    return COAP_RETURN_CODE (2, 5) ;
+}
+
+uint8_t process_conf_fetch (Msg *in, Msg *out)
+{
+    static char buf [64] ;
+    int len ;
+
+    printf ("process_conf_fetch\n") ;
+    len = kv_fetch (conf, get_payload_msg (in), get_paylen_msg (in), buf, sizeof buf) ;
+    if (len < 0)
+	return COAP_RETURN_CODE (4, 13) ;
+    set_payload_msg (out, (uint8_t *) buf, len) ;
+    return COAP_RETURN_CODE (2, 5) ;
+}
+
+uint8_t process_conf_patch (Msg *in, Msg *out)
+{
+    printf ("process_conf_patch\n") ;
+    if (kv_patch (conf, sizeof conf, get_payload_msg (in), get_paylen_msg (in)) < 0)
+	return COAP_CODE_UNPROCESSABLE ;
+    return COAP_RETURN_CODE (2, 4) ;
+}
+
+
+uint8_t process_conf_put (Msg *in, Msg *out)
+{
+    printf ("process_conf_put\n") ;
+    if (get_paylen_msg (in) >= sizeof conf)
+	return COAP_CODE_TOO_LARGE ;
+    memcpy (conf, get_payload_msg (in), get_paylen_msg (in)) ;
+    conf [get_paylen_msg (in)] = '\0' ;
+    return COAP_RETURN_CODE (2, 4) ;
+}
+
+
+/*
+ * Block-wise transfers, with an empty token (as sent by the master)
+ */
+
+int nerr = 0 ;
+
+void check (bool cond, const char *what)
+{
+    printf ("%s: %s\n", cond ? "ok  " : "FAIL", what) ;
+    if (! cond)
+	nerr++ ;
+}
+
+Msg *block_request (l2net_154 *l2, uint8_t code, const char *name, uint16_t id)
+{
+    Msg *in = initMsg (l2) ;
+    option *up ;
+
+    set_id (in, id) ;
+    set_type (in, COAP_TYPE_CON) ;
+    set_code (in, code) ;
+    up = initOptionOpaque (MO_Uri_Path, (void *) name, strlen (name)) ;
+    push_option (in, up) ;
+    freeOption (up) ;
+    return in ;
+}
+
+// number of block-wise transfers of this type in progress
+int transfers (Casan *ca, blocktype_t type)
+{
+    int i, n = 0 ;
+
+    for (i = 0 ; i < BLOCK_MAX ; i++)
+	if (ca->blocks_->bs_ [i].type_ == type)
+	    n++ ;
+    return n ;
+}
+
+void test_blocks (Casan *ca, l2net_154 *l2)
+{
+    static uint8_t buf [512] ;
+    const char *newconf = "period=20;unit=ms;mode=manual" ;
+    char *wk ;
+    size_t wklen, len ;
+    uint32_t num ;
+    bool more ;
+    int szx, nblocks ;
+    Msg *in, *out ;
+
+    // multi-block /resources, reassembled from Block2 responses
+    wk = render_well_known (ca, &wklen) ;
+    len = 0 ;
+    nblocks = 0 ;
+    num = 0 ;
+    szx = BLOCK_SZX_MAX ;
+    do
+    {
+	in = block_request (l2, COAP_CODE_GET, "resources", 200 + num) ;
+	if (num > 0)
+	    set_block_option (in, MO_Block2, num, false, szx) ;
+	out = initMsg (l2) ;
+	process_request (ca, in, out) ;
+	more = false ;
+	if (get_block_option (out, MO_Block2, &num, &more, &szx)
+			&& len + get_paylen_msg (out) <= sizeof buf)
+	{
+	    memcpy (buf + len, get_payload_msg (out), get_paylen_msg (out)) ;
+	    len += get_paylen_msg (out) ;
+	    nblocks++ ;
+	    num++ ;
+	}
+	freeMsg (in) ;
+	freeMsg (out) ;
+    } while (more && nblocks < 20) ;
+    printf ("/resources: %d bytes in %d blocks\n", (int) len, nblocks) ;
+    check (nblocks > 1, "/resources is split in blocks") ;
+    check (wk != NULL && len == wklen && memcmp (buf, wk, len) == 0,
+    			"/resources reassembled") ;
+    if (wk != NULL)
+	free (wk) ;
+
+    // a block of another resource with the same (empty) token
+    // must not be served from the kept /resources representation
+    in = block_request (l2, COAP_CODE_GET, "resources", 220) ;
+    out = initMsg (l2) ;
+    process_request (ca, in, out) ;
+    freeMsg (in) ;
+    freeMsg (out) ;
+    in = block_request (l2, COAP_CODE_GET, R2_name, 221) ;
+    set_block_option (in, MO_Block2, 1, false, 0) ;
+    out = initMsg (l2) ;
+    process_request (ca, in, out) ;
+    check (get_code (out) == COAP_CODE_BAD_OPTION, "block 1 of /temp is not a block of /resources") ;
+    freeMsg (in) ;
+    freeMsg (out) ;
+
+    // Block1 PUT in 16-byte blocks
+    in = block_request (l2, COAP_CODE_PUT, R3_name, 230) ;
+    set_block_option (in, MO_Block1, 0, true, 0) ;
+    set_payload_msg (in, (uint8_t *) newconf, 16) ;
+    out = initMsg (l2) ;
+    process_request (ca, in, out) ;
+    check (get_code (out) == COAP_CODE_CONTINUE, "Block1: first block continued") ;
+    freeMsg (in) ;
+    freeMsg (out) ;
+
+    // the transfer is restarted: its state is reused
+    in = block_request (l2, COAP_CODE_PUT, R3_name, 232) ;
+    set_block_option (in, MO_Block1, 0, true, 0) ;
+    set_payload_msg (in, (uint8_t *) newconf, 16) ;
+    out = initMsg (l2) ;
+    process_request (ca, in, out) ;
+    check (get_code (out) == COAP_CODE_CONTINUE, "Block1: restarted first block continued") ;
+    check (transfers (ca, BL_BLOCK1) == 1, "Block1: restarted transfer uses the same state") ;
+    freeMsg (in) ;
+    freeMsg (out) ;
+
+    in = block_request (l2, COAP_CODE_PUT, R3_name, 231) ;
+    set_block_option (in, MO_Block1, 1, false, 0) ;
+    set_payload_msg (in, (uint8_t *) newconf + 16, strlen (newconf) - 16) ;
+    out = initMsg (l2) ;
+    process_request (ca, in, out) ;
+    check (get_code (out) == COAP_RETURN_CODE (2, 4), "Block1: last block changed") ;
+    check (strcmp (conf, newconf) == 0, "Block1: payload reassembled") ;
+    freeMsg (in) ;
+    freeMsg (out) ;
+
+    printf ("blocks: %s (%d errors)\n", nerr == 0 ? "PASSED" : "FAILED", nerr) ;
+}
+
 
 void test_resource (Casan *ca, l2net_154 *l2, const char *name) {
 	Msg *in = initMsg(l2) ;
@@ -74,6 +257,7 @@ const char *resname [] =
     "nonexistant",
     R1_name,
     R2_name,
+    R3_name,
 } ;
 
 l2net_154 *l2;
@@ -81,6 +265,7 @@ l2addr_154 *myaddr;
 Casan *ca;
 Resource *r1;
 Resource *r2;
+Resource *r3;
 static int n = 0 ;
 
 PROCESS_THREAD(test, ev, data)
@@ -102,6 +287,16 @@ PROCESS_THREAD(test, ev, data)
 		setHandlerResource(r2, COAP_CODE_GET, process_temp );
 		register_resource(ca, r2);
 
+		r3 = initResource (R3_name, R3_title, R3_rt) ;
+		setHandlerResource(r3, COAP_CODE_GET, process_conf_get );
+		setHandlerResource(r3, COAP_CODE_FETCH, process_conf_fetch );
+		setHandlerResource(r3, COAP_CODE_PATCH, process_conf_patch );
+		setHandlerResource(r3, COAP_CODE_IPATCH, process_conf_patch );
+		setHandlerResource(r3, COAP_CODE_PUT, process_conf_put );
+		register_resource(ca, r3);
+
+		test_blocks (ca, l2) ;
+
 		while(1) {    
 
 			if (n % NTAB (resname) == 0)
@@ -1,6 +1,8 @@
 #include "../../libraries/Casan/time.h"
 #include "rime.h"
 
+static time_t curtime ;
+
 /*
  * Test program for the "time" class
  */